@@ -53,6 +53,7 @@ create_hashtable(uint32_t minsize, uint32_t(*hashf)(const void*), int(*eqf)(
         return NULL;
     } /*oom*/
     memset(h->table, 0, size * sizeof(struct entry *));
+    h->entryPool = stPool_construct(sizeof(struct entry));
     h->tablelength = size;
     h->primeindex = pindex;
     h->entrycount = 0;
@@ -153,7 +154,7 @@ int32_t hashtable_insert(struct hashtable *h, void *k, void *v) {
             exit(1);
         }
     }
-    e = (struct entry *) st_malloc(sizeof(struct entry));
+    e = (struct entry *) stPool_malloc(h->entryPool);
     if (NULL == e) {
         --(h->entrycount);
         return 0;
@@ -208,7 +209,7 @@ hashtable_remove(struct hashtable *h, void *k, int32_t freeKey) {
             if (freeKey) {
                 h->keyFree(e->k);
             }
-            free(e);
+            stPool_free(h->entryPool, e);
             return v;
         }
         pE = &(e->next);
@@ -222,53 +223,21 @@ hashtable_remove(struct hashtable *h, void *k, int32_t freeKey) {
 void hashtable_destroy(struct hashtable *h, int32_t free_values,
         int32_t free_keys) {
     uint32_t i;
-    struct entry *e, *f;
+    struct entry *e;
     struct entry **table = h->table;
-    if (free_keys) {
-        if (free_values) {
-            for (i = 0; i < h->tablelength; i++) {
-                e = table[i];
-                while (NULL != e) {
-                    f = e;
-                    e = e->next;
-                    h->keyFree(f->k);
-                    h->valueFree(f->v);
-                    free(f);
-                }
-            }
-        } else {
-            for (i = 0; i < h->tablelength; i++) {
-                e = table[i];
-                while (NULL != e) {
-                    f = e;
-                    e = e->next;
-                    h->keyFree(f->k);
-                    free(f);
-                }
-            }
-        }
-    } else {
-        if (free_values) {
-            for (i = 0; i < h->tablelength; i++) {
-                e = table[i];
-                while (NULL != e) {
-                    f = e;
-                    e = e->next;
-                    h->valueFree(f->v);
-                    free(f);
+    if (free_keys || free_values) {
+        for (i = 0; i < h->tablelength; i++) {
+            for (e = table[i]; NULL != e; e = e->next) {
+                if (free_keys) {
+                    h->keyFree(e->k);
                 }
-            }
-        } else {
-            for (i = 0; i < h->tablelength; i++) {
-                e = table[i];
-                while (NULL != e) {
-                    f = e;
-                    e = e->next;
-                    free(f);
+                if (free_values) {
+                    h->valueFree(e->v);
                 }
             }
         }
     }
+    stPool_destruct(h->entryPool); /* frees the entries, without walking the chains */
     free(h->table);
     free(h);
 }
@@ -6,11 +6,14 @@
 
 //Cache functions
 
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "sonLibGlobalsInternal.h"
 
-struct stCache {
-    stSortedSet *cache;
-};
+const char *ST_CACHE_EXCEPTION_ID = "ST_CACHE_EXCEPTION";
 
 typedef struct _cacheRecord {
     /*
@@ -18,38 +21,110 @@ typedef struct _cacheRecord {
      */
     int64_t key, start, size;
     char *record;
+    int64_t maxSize; //the allocated size of record, so that appends can extend it in place.
+    uint8_t *dirty; //a bit per byte of record, set if the byte has been modified since the last flush. NULL if all are clean.
+    /*
+     * Position in the eviction queues.
+     */
+    struct _cacheRecord *prev, *next;
+    int32_t queue;
+    bool referenced;
 } stCacheRecord;
 
-static int cacheRecord_cmp(const void *a, const void *b) {
-    const stCacheRecord *i = a;
-    const stCacheRecord *j = b;
-    if (i->key > j->key) {
-        return 1;
-    }
-    if (i->key < j->key) {
-        return -1;
-    }
-    if (i->start > j->start) {
-        return 1;
-    }
-    if (i->start < j->start) {
-        return -1;
-    }
-    return 0;
-}
+/*
+ * Records are kept in eviction queues, doubly linked lists with the most recently added or used
+ * record at the head. LRU uses just the main queue. CLOCK uses the main queue as its ring, with
+ * the hand moving from head to tail and wrapping around. 2Q puts new records in the in queue,
+ * first in first out, and moves them to the main queue if they are used again.
+ */
+#define MAIN_QUEUE 0
+#define IN_QUEUE 1
+
+/*
+ * The fragments of one record, sorted by start. Fragments never overlap, so they are also
+ * sorted by end.
+ */
+typedef struct _keyFragments {
+    int64_t key;
+    stCacheRecord **fragments;
+    int64_t length, maxLength;
+} KeyFragments;
+
+/*
+ * The records in a cache are split between shards by key. Each shard is a complete cache, with its own
+ * share of the capacity and, if the cache is concurrent, its own lock.
+ */
+typedef struct _cacheShard {
+    stHash *keys; //KeyFragments, hashed by key.
+    int64_t size;
+    int64_t capacity;
+    stCacheEvictionPolicy policy;
+    stCacheRecord *heads[2], *tails[2];
+    int64_t queueSizes[2];
+    stCacheRecord *hand;
+    void (*evict)(int64_t key, int64_t start, int64_t size, const void *value, void *extraArg);
+    void *extraArg;
+    void (*evictDirty)(int64_t key, int64_t start, int64_t size, const void *value, void *extraArg);
+    void *evictDirtyExtraArg;
+} CacheShard;
+
+struct stCache {
+    CacheShard *shards;
+    int64_t shardNumber;
+    pthread_mutex_t *locks; //one per shard, NULL if the cache is not concurrent.
+};
+
+static bool shard_containsRecord(CacheShard *cache, int64_t key, int64_t start, int64_t size);
 
 static void cacheRecord_destruct(stCacheRecord *i) {
+    free(i->dirty);
     free(i->record);
     free(i);
 }
 
-static stCacheRecord getTempRecord(int64_t key, int64_t start, int64_t size) {
-    stCacheRecord record;
-    record.key = key;
-    record.start = start;
-    record.size = size;
-    record.record = NULL;
-    return record;
+static uint32_t keyFragments_hashKey(const KeyFragments *keyFragments) {
+    uint64_t i = keyFragments->key;
+    return (uint32_t) (i ^ (i >> 32));
+}
+
+static int keyFragments_equalsFn(const KeyFragments *keyFragments1, const KeyFragments *keyFragments2) {
+    return keyFragments1->key == keyFragments2->key;
+}
+
+static void keyFragments_destruct(KeyFragments *keyFragments) {
+    for (int64_t i = 0; i < keyFragments->length; i++) {
+        cacheRecord_destruct(keyFragments->fragments[i]);
+    }
+    free(keyFragments->fragments);
+    free(keyFragments);
+}
+
+static stHash *constructKeys(void) {
+    return stHash_construct3((uint32_t (*)(const void *)) keyFragments_hashKey,
+            (int (*)(const void *, const void *)) keyFragments_equalsFn,
+            (void (*)(void *)) keyFragments_destruct, NULL);
+}
+
+static KeyFragments *getKeyFragments(CacheShard *cache, int64_t key) {
+    KeyFragments keyFragments;
+    keyFragments.key = key;
+    return stHash_search(cache->keys, &keyFragments);
+}
+
+/*
+ * Returns the index of the last fragment starting at or before start, or -1 if there is none.
+ */
+static int64_t getLessThanOrEqualIndex(KeyFragments *keyFragments, int64_t start) {
+    int64_t min = 0, max = keyFragments->length;
+    while (min < max) {
+        int64_t mid = min + (max - min) / 2;
+        if (keyFragments->fragments[mid]->start <= start) {
+            min = mid + 1;
+        } else {
+            max = mid;
+        }
+    }
+    return min - 1;
 }
 
 static stCacheRecord *cacheRecord_construct(int64_t key,
@@ -57,25 +132,330 @@ static stCacheRecord *cacheRecord_construct(int64_t key,
     assert(value != NULL);
     assert(size >= 0);
     assert(start >= 0);
-    stCacheRecord *record = st_malloc(sizeof(stCacheRecord));
+    stCacheRecord *record = st_calloc(1, sizeof(stCacheRecord));
     record->key = key;
     record->start = start;
     record->size = size;
     record->record = copyMemory ? memcpy(st_malloc(size), value, size)
             : (char *) value;
+    record->maxSize = size;
     return record;
 }
 
-static stCacheRecord *getLessThanOrEqualRecord(stCache *cache,
+/*
+ * Appends the bytes to the end of the record, growing its buffer geometrically so that a sequence
+ * of appends is linear time. Does not update the accounting of the cache.
+ */
+static void cacheRecord_append(stCacheRecord *record, const void *value, int64_t size) {
+    if (record->size + size > record->maxSize) {
+        int64_t maxSize = record->maxSize * 2;
+        if (maxSize < record->size + size) {
+            maxSize = record->size + size;
+        }
+        char *i = realloc(record->record, maxSize);
+        if (i == NULL) {
+            st_errAbort("Failed to allocate %lld bytes for a cache record", (long long) maxSize);
+        }
+        record->record = i;
+        if (record->dirty != NULL) {
+            int64_t oldBitmapSize = (record->maxSize + 7) / 8, bitmapSize = (maxSize + 7) / 8;
+            record->dirty = realloc(record->dirty, bitmapSize);
+            if (record->dirty == NULL) {
+                st_errAbort("Failed to allocate %lld bytes for a cache record", (long long) bitmapSize);
+            }
+            memset(record->dirty + oldBitmapSize, 0, bitmapSize - oldBitmapSize);
+        }
+        record->maxSize = maxSize;
+    }
+    memcpy(record->record + record->size, value, size);
+    record->size += size;
+}
+
+static bool cacheRecord_isDirty(stCacheRecord *record, int64_t i) {
+    return record->dirty != NULL && ((record->dirty[i >> 3] >> (i & 7)) & 1);
+}
+
+/*
+ * Marks the bytes from offset to offset + size as dirty or clean.
+ */
+static void cacheRecord_setDirty(stCacheRecord *record, int64_t offset, int64_t size, bool dirty) {
+    if (record->dirty == NULL) {
+        if (!dirty) {
+            return;
+        }
+        record->dirty = st_calloc((record->maxSize + 7) / 8, 1);
+    }
+    int64_t i = offset, end = offset + size;
+    for (; i < end && (i & 7) != 0; i++) {
+        record->dirty[i >> 3] = dirty ? record->dirty[i >> 3] | (1 << (i & 7)) : record->dirty[i >> 3] & ~(1 << (i & 7));
+    }
+    if (end - i >= 8) { //whole bytes of the bitmap
+        memset(record->dirty + (i >> 3), dirty ? 0xFF : 0, (end - i) >> 3);
+        i += (end - i) & ~((int64_t) 7);
+    }
+    for (; i < end; i++) {
+        record->dirty[i >> 3] = dirty ? record->dirty[i >> 3] | (1 << (i & 7)) : record->dirty[i >> 3] & ~(1 << (i & 7));
+    }
+}
+
+/*
+ * Copies the dirty bits of the bytes from offset to offset + size in the second record to the first record,
+ * starting at offset2.
+ */
+static void cacheRecord_copyDirty(stCacheRecord *record, int64_t offset2, stCacheRecord *record2, int64_t offset,
+        int64_t size) {
+    if (record2->dirty == NULL) {
+        cacheRecord_setDirty(record, offset2, size, 0);
+        return;
+    }
+    for (int64_t i = 0; i < size; i++) {
+        cacheRecord_setDirty(record, offset2 + i, 1, cacheRecord_isDirty(record2, offset + i));
+    }
+}
+
+/*
+ * Calls write on each maximal run of dirty bytes in the record.
+ */
+static void cacheRecord_writeDirtyRuns(stCacheRecord *record,
+        void (*write)(int64_t key, int64_t start, int64_t size, const void *value, void *extraArg), void *extraArg) {
+    for (int64_t j = 0; record->dirty != NULL && j < record->size;) {
+        if (!cacheRecord_isDirty(record, j)) {
+            j++;
+            continue;
+        }
+        int64_t k = j + 1;
+        while (k < record->size && cacheRecord_isDirty(record, k)) {
+            k++;
+        }
+        write(record->key, record->start + j, k - j, record->record + j, extraArg);
+        j = k;
+    }
+}
+
+static void queue_remove(CacheShard *cache, stCacheRecord *record) {
+    if (cache->hand == record) {
+        cache->hand = record->next;
+    }
+    if (record->prev != NULL) {
+        record->prev->next = record->next;
+    } else {
+        cache->heads[record->queue] = record->next;
+    }
+    if (record->next != NULL) {
+        record->next->prev = record->prev;
+    } else {
+        cache->tails[record->queue] = record->prev;
+    }
+    record->prev = record->next = NULL;
+    cache->queueSizes[record->queue] -= record->size;
+}
+
+static void queue_insertAtHead(CacheShard *cache, stCacheRecord *record, int32_t queue) {
+    record->queue = queue;
+    record->prev = NULL;
+    record->next = cache->heads[queue];
+    if (record->next != NULL) {
+        record->next->prev = record;
+    } else {
+        cache->tails[queue] = record;
+    }
+    cache->heads[queue] = record;
+    cache->queueSizes[queue] += record->size;
+}
+
+static void queue_insertBefore(CacheShard *cache, stCacheRecord *record, stCacheRecord *nextRecord) {
+    if (nextRecord == NULL || nextRecord->prev == NULL) {
+        if (nextRecord == NULL && cache->tails[MAIN_QUEUE] != NULL) { //append at the tail
+            record->queue = MAIN_QUEUE;
+            record->next = NULL;
+            record->prev = cache->tails[MAIN_QUEUE];
+            record->prev->next = record;
+            cache->tails[MAIN_QUEUE] = record;
+            cache->queueSizes[MAIN_QUEUE] += record->size;
+            return;
+        }
+        queue_insertAtHead(cache, record, MAIN_QUEUE);
+        return;
+    }
+    record->queue = MAIN_QUEUE;
+    record->prev = nextRecord->prev;
+    record->next = nextRecord;
+    record->prev->next = record;
+    nextRecord->prev = record;
+    cache->queueSizes[MAIN_QUEUE] += record->size;
+}
+
+/*
+ * Adds a new record to the cache. If used is non-zero a record it replaces was in use, which
+ * 2Q counts as a second use.
+ */
+static void enqueueRecord(CacheShard *cache, stCacheRecord *record, bool used) {
+    switch (cache->policy) {
+        case stCacheEvictionLRU:
+            queue_insertAtHead(cache, record, MAIN_QUEUE);
+            break;
+        case stCacheEvictionClock: //it goes just behind the hand, so is the last to be looked at
+            record->referenced = 0;
+            queue_insertBefore(cache, record, cache->hand);
+            break;
+        case stCacheEviction2Q:
+            queue_insertAtHead(cache, record, used ? MAIN_QUEUE : IN_QUEUE);
+            break;
+    }
+}
+
+static void addRecord(CacheShard *cache, stCacheRecord *record, bool used) {
+    KeyFragments *keyFragments = getKeyFragments(cache, record->key);
+    if (keyFragments == NULL) {
+        keyFragments = st_calloc(1, sizeof(KeyFragments));
+        keyFragments->key = record->key;
+        stHash_insert(cache->keys, keyFragments, keyFragments);
+    }
+    if (keyFragments->length == keyFragments->maxLength) {
+        keyFragments->maxLength = keyFragments->maxLength == 0 ? 2 : keyFragments->maxLength * 2;
+        keyFragments->fragments = realloc(keyFragments->fragments,
+                keyFragments->maxLength * sizeof(stCacheRecord *));
+        if (keyFragments->fragments == NULL) {
+            st_errAbort("Failed to allocate the fragments of cache record %lld", (long long) keyFragments->key);
+        }
+    }
+    int64_t i = getLessThanOrEqualIndex(keyFragments, record->start) + 1;
+    assert(i == 0 || keyFragments->fragments[i - 1]->start < record->start);
+    memmove(keyFragments->fragments + i + 1, keyFragments->fragments + i,
+            (keyFragments->length - i) * sizeof(stCacheRecord *));
+    keyFragments->fragments[i] = record;
+    keyFragments->length++;
+    cache->size += record->size;
+    enqueueRecord(cache, record, used);
+}
+
+/*
+ * Removes the record from the cache, without freeing it.
+ */
+static void removeRecord(CacheShard *cache, stCacheRecord *record) {
+    KeyFragments *keyFragments = getKeyFragments(cache, record->key);
+    assert(keyFragments != NULL);
+    int64_t i = getLessThanOrEqualIndex(keyFragments, record->start);
+    assert(i >= 0 && keyFragments->fragments[i] == record);
+    keyFragments->length--;
+    memmove(keyFragments->fragments + i, keyFragments->fragments + i + 1,
+            (keyFragments->length - i) * sizeof(stCacheRecord *));
+    if (keyFragments->length == 0) { //don't keep empty keys around
+        stHash_remove(cache->keys, keyFragments);
+        keyFragments_destruct(keyFragments);
+    }
+    cache->size -= record->size;
+    queue_remove(cache, record);
+}
+
+static void resizeRecord(CacheShard *cache, stCacheRecord *record, int64_t newSize) {
+    cache->size += newSize - record->size;
+    cache->queueSizes[record->queue] += newSize - record->size;
+    record->size = newSize;
+}
+
+/*
+ * Records that the record has been used.
+ */
+static void touchRecord(CacheShard *cache, stCacheRecord *record) {
+    switch (cache->policy) {
+        case stCacheEvictionLRU:
+        case stCacheEviction2Q:
+            queue_remove(cache, record);
+            queue_insertAtHead(cache, record, MAIN_QUEUE);
+            break;
+        case stCacheEvictionClock:
+            record->referenced = 1;
+            break;
+    }
+}
+
+static stCacheRecord *getVictim(CacheShard *cache, stCacheRecord *protectedRecord) {
+    switch (cache->policy) {
+        case stCacheEvictionLRU:
+        case stCacheEviction2Q: {
+            int32_t queue = MAIN_QUEUE;
+            if (cache->policy == stCacheEviction2Q && cache->tails[IN_QUEUE] != NULL
+                    && (cache->queueSizes[IN_QUEUE] > cache->capacity / 4 || cache->tails[MAIN_QUEUE] == NULL
+                            || (cache->tails[MAIN_QUEUE] == protectedRecord && cache->heads[MAIN_QUEUE] == protectedRecord))) {
+                queue = IN_QUEUE;
+            }
+            stCacheRecord *record = cache->tails[queue];
+            if (record == protectedRecord) {
+                record = record->prev;
+            }
+            if (record == NULL && cache->policy == stCacheEviction2Q) { //try the other queue
+                record = cache->tails[1 - queue];
+                if (record == protectedRecord) {
+                    record = record->prev;
+                }
+            }
+            return record;
+        }
+        case stCacheEvictionClock: {
+            if (cache->heads[MAIN_QUEUE] == NULL || (cache->heads[MAIN_QUEUE] == protectedRecord
+                    && cache->tails[MAIN_QUEUE] == protectedRecord)) {
+                return NULL;
+            }
+            while (1) { //goes round at most twice, clearing the reference bits the first time round
+                if (cache->hand == NULL) {
+                    cache->hand = cache->heads[MAIN_QUEUE];
+                }
+                stCacheRecord *record = cache->hand;
+                cache->hand = record->next;
+                if (record != protectedRecord) {
+                    if (!record->referenced) {
+                        return record;
+                    }
+                    record->referenced = 0;
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Evicts records until the cache is within its capacity, or only the given record is left.
+ */
+static void evictRecords(CacheShard *cache, stCacheRecord *protectedRecord) {
+    while (cache->size > cache->capacity) {
+        stCacheRecord *record = getVictim(cache, protectedRecord);
+        if (record == NULL) {
+            break;
+        }
+        removeRecord(cache, record);
+        if (cache->evictDirty != NULL) {
+            cacheRecord_writeDirtyRuns(record, cache->evictDirty, cache->evictDirtyExtraArg);
+        }
+        if (cache->evict != NULL) {
+            cache->evict(record->key, record->start, record->size, record->record, cache->extraArg);
+        }
+        cacheRecord_destruct(record);
+    }
+}
+
+static stCacheRecord *getLessThanOrEqualRecord(CacheShard *cache,
         int64_t key, int64_t start, int64_t size) {
-    stCacheRecord record = getTempRecord(key, start, size);
-    return stSortedSet_searchLessThanOrEqual(cache->cache, &record);
+    KeyFragments *keyFragments = getKeyFragments(cache, key);
+    if (keyFragments == NULL) {
+        return NULL;
+    }
+    int64_t i = getLessThanOrEqualIndex(keyFragments, start);
+    return i >= 0 ? keyFragments->fragments[i] : NULL;
 }
 
-static stCacheRecord *getGreaterThanOrEqualRecord(stCache *cache,
+static stCacheRecord *getGreaterThanOrEqualRecord(CacheShard *cache,
         int64_t key, int64_t start, int64_t size) {
-    stCacheRecord record = getTempRecord(key, start, size);
-    return stSortedSet_searchGreaterThanOrEqual(cache->cache, &record);
+    KeyFragments *keyFragments = getKeyFragments(cache, key);
+    if (keyFragments == NULL) {
+        return NULL;
+    }
+    int64_t i = getLessThanOrEqualIndex(keyFragments, start);
+    if (i >= 0 && keyFragments->fragments[i]->start == start) {
+        return keyFragments->fragments[i];
+    }
+    return i + 1 < keyFragments->length ? keyFragments->fragments[i + 1] : NULL;
 }
 
 static bool recordContainedIn(stCacheRecord *record, int64_t key,
@@ -101,53 +481,34 @@ static bool recordOverlapsWith(stCacheRecord *record, int64_t key,
     return record->start + record->size > start;
 }
 
-static bool recordsAdjacent(stCacheRecord *record1, stCacheRecord *record2) {
-    /*
-     * Returns non-zero if the records abut with record1 immediately before record2.
-     */
-    assert(cacheRecord_cmp(record1, record2) <= 0);
-    assert(!recordOverlapsWith(record1, record2->key, record2->start, record2->size));
-    assert(!recordContainedIn(record1, record2->key, record2->start, record2->size));
-    return record1->key == record2->key && record1->start + record1->size
-            == record2->start;
-}
-
-static stCacheRecord *mergeRecords(stCacheRecord *record1,
-        stCacheRecord *record2) {
-    /*
-     * Merges two adjacenct records.
-     */
-    assert(recordsAdjacent(record1, record2));
-    int64_t i = record1->size + record2->size;
-    char *j = memcpy(st_malloc(i), record1->record, record1->size);
-    memcpy(j + record1->size, record2->record, record2->size);
-    stCacheRecord *record3 = cacheRecord_construct(record1->key, j,
-            record1->start, i, 0);
-    return record3;
-}
-
-void deleteRecord(stCache *cache, int64_t key,
+/*
+ * Removes the given range from the cache, returning non-zero if any of it was cached.
+ */
+static bool deleteRecord(CacheShard *cache, int64_t key,
         int64_t start, int64_t size) {
-    assert(!stCache_containsRecord(cache, key, start, size)); //Will not delete a record wholly contained in.
+    assert(!shard_containsRecord(cache, key, start, size)); //Will not delete a record wholly contained in.
+    bool deleted = 0;
     stCacheRecord *record = getLessThanOrEqualRecord(cache, key, start,
             size);
     while (record != NULL && recordOverlapsWith(record, key, start, size)) { //could have multiple fragments in there to remove.
+        deleted = 1;
         if (recordContainedIn(record, key, start, size)) { //We get rid of the record because it is contained in the range
-            stSortedSet_remove(cache->cache, record);
+            removeRecord(cache, record);
             cacheRecord_destruct(record);
             record = getLessThanOrEqualRecord(cache, key, start, size);
         } else { //The range overlaps with, but is not fully contained in, so we trim it..
             assert(record->start < start);
             assert(record->start + record->size > start);
-            record->size = start - record->start;
+            resizeRecord(cache, record, start - record->start);
             assert(record->size >= 0);
             break;
         }
     }
     record = getGreaterThanOrEqualRecord(cache, key, start, size);
     while (record != NULL && recordOverlapsWith(record, key, start, size)) { //could have multiple fragments in there to remove.
+        deleted = 1;
         if (recordContainedIn(record, key, start, size)) { //We get rid of the record because it is contained in the range
-            stSortedSet_remove(cache->cache, record);
+            removeRecord(cache, record);
             cacheRecord_destruct(record);
             record = getGreaterThanOrEqualRecord(cache, key, start, size);
         } else { //The range overlaps with, but is not fully contained in, so we trim it..
@@ -156,45 +517,45 @@ void deleteRecord(stCache *cache, int64_t key,
             int64_t newSize = record->size - (start + size - record->start);
             int64_t newStart = start + size;
             assert(newSize >= 0);
-            char *newMem = memcpy(st_malloc(newSize),
-                    record->record + start + size - record->start, newSize);
-            free(record->record);
-            record->record = newMem;
+            memmove(record->record, record->record + start + size - record->start, newSize);
+            cacheRecord_copyDirty(record, 0, record, start + size - record->start, newSize);
             record->start = newStart;
-            record->size = newSize;
+            resizeRecord(cache, record, newSize);
             break; //We can break at this point as we have reached the end of the range (as the record overlapped)
         }
     }
+    return deleted;
 }
 
 
 /*
- * Public functions
+ * Functions on a single shard
  */
 
-stCache *stCache_construct(void) {
-    stCache *cache = st_malloc(sizeof(stCache));
-    cache->cache = stSortedSet_construct3(cacheRecord_cmp,
-            (void(*)(void *)) cacheRecord_destruct);
-    return cache;
+static void shard_construct(CacheShard *cache, int64_t capacity, stCacheEvictionPolicy policy,
+        void (*evict)(int64_t key, int64_t start, int64_t size, const void *value, void *extraArg), void *extraArg) {
+    cache->keys = constructKeys();
+    cache->capacity = capacity;
+    cache->policy = policy;
+    cache->evict = evict;
+    cache->extraArg = extraArg;
 }
 
-void stCache_destruct(stCache *cache) {
-    stSortedSet_destruct(cache->cache);
-    free(cache);
-}
-
-void stCache_clear(stCache *cache) {
-    stSortedSet_destruct(cache->cache);
-    cache->cache = stSortedSet_construct3(cacheRecord_cmp,
-            (void(*)(void *)) cacheRecord_destruct);
+static void shard_clear(CacheShard *cache) {
+    stHash_destruct(cache->keys);
+    cache->keys = constructKeys();
+    cache->size = 0;
+    cache->heads[MAIN_QUEUE] = cache->heads[IN_QUEUE] = NULL;
+    cache->tails[MAIN_QUEUE] = cache->tails[IN_QUEUE] = NULL;
+    cache->queueSizes[MAIN_QUEUE] = cache->queueSizes[IN_QUEUE] = 0;
+    cache->hand = NULL;
 }
 
-void stCache_setRecord(stCache *cache, int64_t key,
-       int64_t start, int64_t size,  const void *value) {
+static void shard_setRecord(CacheShard *cache, int64_t key,
+       int64_t start, int64_t size,  const void *value, bool dirty) {
     //If the record is already contained we update a portion of it.
     assert(value != NULL);
-    if (stCache_containsRecord(cache, key, start, size)) {
+    if (shard_containsRecord(cache, key, start, size)) {
         stCacheRecord *record = getLessThanOrEqualRecord(cache, key,
                 start, size);
         assert(record != NULL);
@@ -202,36 +563,52 @@ void stCache_setRecord(stCache *cache, int64_t key,
         assert(record->start <= start);
         assert(record->start + record->size >= start + size);
         memcpy(record->record + start - record->start, value, size);
+        cacheRecord_setDirty(record, start - record->start, size, dirty);
+        touchRecord(cache, record);
         return;
     }
     //Get rid of bits that are contained in this record..
-    deleteRecord(cache, key, start, size);
+    bool used = deleteRecord(cache, key, start, size);
     //Now get any left and right bits
     stCacheRecord *record1 = getLessThanOrEqualRecord(cache, key, start,
             size);
-    stCacheRecord *record2 = cacheRecord_construct(key, value, start,
-            size, 1);
-    assert(record2 != NULL);
-    if (record1 != NULL && recordsAdjacent(record1, record2)) {
-        stCacheRecord *i = mergeRecords(record1, record2);
-        stSortedSet_remove(cache->cache, record1);
-        cacheRecord_destruct(record1);
-        cacheRecord_destruct(record2);
-        record2 = i;
-    }
     stCacheRecord *record3 = getGreaterThanOrEqualRecord(cache, key,
             start, size);
-    if (record3 != NULL && recordsAdjacent(record2, record3)) {
-        stCacheRecord *i = mergeRecords(record2, record3);
-        stSortedSet_remove(cache->cache, record3);
-        cacheRecord_destruct(record2);
+    if (record1 != NULL && record1->start + record1->size != start) {
+        record1 = NULL;
+    }
+    if (record3 != NULL && start + size != record3->start) {
+        record3 = NULL;
+    }
+    stCacheRecord *record2;
+    if (record1 != NULL) { //Extend the left fragment in place, so that a stream of appends is linear time
+        record2 = record1;
+        used = used || (record1->queue == MAIN_QUEUE);
+        queue_remove(cache, record2);
+        cache->size -= record2->size;
+        cacheRecord_append(record2, value, size);
+        cacheRecord_setDirty(record2, record2->size - size, size, dirty);
+    } else {
+        record2 = cacheRecord_construct(key, value, start, size, 1);
+        cacheRecord_setDirty(record2, 0, size, dirty);
+    }
+    if (record3 != NULL) {
+        used = used || (record3->queue == MAIN_QUEUE);
+        cacheRecord_append(record2, record3->record, record3->size);
+        cacheRecord_copyDirty(record2, record2->size - record3->size, record3, 0, record3->size);
+        removeRecord(cache, record3);
         cacheRecord_destruct(record3);
-        record2 = i;
     }
-    stSortedSet_insert(cache->cache, record2);
+    if (record1 != NULL) {
+        cache->size += record2->size;
+        enqueueRecord(cache, record2, used);
+    } else {
+        addRecord(cache, record2, used);
+    }
+    evictRecords(cache, record2);
 }
 
-bool stCache_containsRecord(stCache *cache, int64_t key,
+static bool shard_containsRecord(CacheShard *cache, int64_t key,
         int64_t start, int64_t size) {
     assert(start >= 0);
     assert(size >= 0);
@@ -250,9 +627,9 @@ bool stCache_containsRecord(stCache *cache, int64_t key,
     return 1;
 }
 
-void *stCache_getRecord(stCache *cache, int64_t key,
+static const void *shard_getRecordView(CacheShard *cache, int64_t key,
         int64_t start, int64_t size, int64_t *sizeRead) {
-    if (stCache_containsRecord(cache, key, start, size)) {
+    if (shard_containsRecord(cache, key, start, size)) {
         stCacheRecord *record = getLessThanOrEqualRecord(cache, key,
                 start, size);
         assert(record != NULL);
@@ -264,13 +641,378 @@ void *stCache_getRecord(stCache *cache, int64_t key,
         assert(i >= 0);
         assert(j + i <= record->size);
         *sizeRead = i;
-        char *cA = st_malloc(i);
-        memcpy(cA, record->record + j, i);
-        return cA;
+        touchRecord(cache, record);
+        return record->record + j;
     }
     return NULL;
 }
 
+static int64_t shard_getSizeOfRange(CacheShard *cache, int64_t key, int64_t start, int64_t size) {
+    assert(start >= 0);
+    assert(size >= 0);
+    int64_t end = size > INT64_MAX - start ? INT64_MAX : start + size;
+    int64_t total = 0;
+    KeyFragments *keyFragments = getKeyFragments(cache, key);
+    if (keyFragments == NULL) {
+        return 0;
+    }
+    int64_t i = getLessThanOrEqualIndex(keyFragments, start);
+    for (i = i < 0 ? 0 : i; i < keyFragments->length && keyFragments->fragments[i]->start < end; i++) {
+        stCacheRecord *record = keyFragments->fragments[i];
+        int64_t overlapStart = record->start > start ? record->start : start;
+        int64_t overlapEnd = record->start + record->size < end ? record->start + record->size : end;
+        if (overlapEnd > overlapStart) {
+            total += overlapEnd - overlapStart;
+        }
+    }
+    return total;
+}
+
+/*
+ * Calls write on each maximal run of dirty bytes in the shard, then marks them clean.
+ */
+static void shard_flush(CacheShard *cache,
+        void (*write)(int64_t key, int64_t start, int64_t size, const void *value, void *extraArg), void *extraArg) {
+    stHashIterator *it = stHash_getIterator(cache->keys);
+    KeyFragments *keyFragments;
+    while ((keyFragments = stHash_getNext(it)) != NULL) {
+        for (int64_t i = 0; i < keyFragments->length; i++) {
+            stCacheRecord *record = keyFragments->fragments[i];
+            if (record->dirty == NULL) {
+                continue;
+            }
+            cacheRecord_writeDirtyRuns(record, write, extraArg);
+            free(record->dirty);
+            record->dirty = NULL;
+        }
+    }
+    stHash_destructIterator(it);
+}
+
+static stList *shard_getDirtyRanges(CacheShard *cache, int64_t key) {
+    stList *ranges = stList_construct3(0, (void (*)(void *)) stInt64Tuple_destruct);
+    KeyFragments *keyFragments = getKeyFragments(cache, key);
+    for (int64_t i = 0; keyFragments != NULL && i < keyFragments->length; i++) {
+        stCacheRecord *record = keyFragments->fragments[i];
+        for (int64_t j = 0; record->dirty != NULL && j < record->size;) {
+            if (!cacheRecord_isDirty(record, j)) {
+                j++;
+                continue;
+            }
+            int64_t k = j + 1;
+            while (k < record->size && cacheRecord_isDirty(record, k)) {
+                k++;
+            }
+            stList_append(ranges, stInt64Tuple_construct(2, record->start + j, k - j));
+            j = k;
+        }
+    }
+    return ranges;
+}
+
+/*
+ * Snapshots are a header of the magic string and the number of fragments, then for each fragment its key,
+ * start, size and flags, its bytes and, if the flags say it has dirty bytes, its dirty bitmap. All the integers are
+ * 64 bit in the byte order of the host, and the bytes and bitmap are each padded to a multiple of 8 bytes, so every
+ * integer in a mapped snapshot is aligned.
+ */
+#define SNAPSHOT_MAGIC "STCACHE1"
+#define SNAPSHOT_DIRTY_FLAG 1
+
+static int64_t pad(int64_t size) {
+    return (size + 7) & ~((int64_t) 7);
+}
+
+static int64_t shard_getFragmentNumber(CacheShard *cache) {
+    int64_t fragmentNumber = 0;
+    stHashIterator *it = stHash_getIterator(cache->keys);
+    KeyFragments *keyFragments;
+    while ((keyFragments = stHash_getNext(it)) != NULL) {
+        fragmentNumber += keyFragments->length;
+    }
+    stHash_destructIterator(it);
+    return fragmentNumber;
+}
+
+static bool writePadded(FILE *fileHandle, const void *value, int64_t size) {
+    static const char padding[8] = { 0 };
+    return fwrite(value, 1, size, fileHandle) == (size_t) size
+            && fwrite(padding, 1, pad(size) - size, fileHandle) == (size_t) (pad(size) - size);
+}
+
+/*
+ * Writes the fragments of the shard, least valuable to evict first, so that loading them into a cache with
+ * less capacity keeps the most valuable. Returns non-zero if successful.
+ */
+static bool shard_save(CacheShard *cache, FILE *fileHandle) {
+    int32_t queues[2] = { IN_QUEUE, MAIN_QUEUE };
+    for (int32_t i = 0; i < 2; i++) {
+        for (stCacheRecord *record = cache->tails[queues[i]]; record != NULL; record = record->prev) {
+            int64_t header[4] = { record->key, record->start, record->size, record->dirty != NULL ? SNAPSHOT_DIRTY_FLAG : 0 };
+            if (fwrite(header, sizeof(int64_t), 4, fileHandle) != 4 || !writePadded(fileHandle, record->record, record->size)
+                    || (record->dirty != NULL && !writePadded(fileHandle, record->dirty, (record->size + 7) / 8))) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/*
+ * Public functions
+ */
+
+static stCache *constructCache(int64_t capacity, stCacheEvictionPolicy policy,
+        void (*evict)(int64_t key, int64_t start, int64_t size, const void *value, void *extraArg), void *extraArg,
+        int64_t shardNumber, bool concurrent) {
+    assert(capacity >= 0);
+    assert(shardNumber > 0);
+    stCache *cache = st_calloc(1, sizeof(stCache));
+    cache->shardNumber = shardNumber;
+    cache->shards = st_calloc(shardNumber, sizeof(CacheShard));
+    for (int64_t i = 0; i < shardNumber; i++) { //any remainder of the capacity goes to the first shards
+        shard_construct(&cache->shards[i], capacity == INT64_MAX ? INT64_MAX
+                : capacity / shardNumber + (i < capacity % shardNumber), policy, evict, extraArg);
+    }
+    if (concurrent) {
+        cache->locks = st_malloc(shardNumber * sizeof(pthread_mutex_t));
+        for (int64_t i = 0; i < shardNumber; i++) {
+            pthread_mutex_init(&cache->locks[i], NULL);
+        }
+    }
+    return cache;
+}
+
+stCache *stCache_construct(void) {
+    return stCache_construct2(INT64_MAX, stCacheEvictionLRU, NULL, NULL);
+}
+
+stCache *stCache_construct2(int64_t capacity, stCacheEvictionPolicy policy,
+        void (*evict)(int64_t key, int64_t start, int64_t size, const void *value, void *extraArg), void *extraArg) {
+    return constructCache(capacity, policy, evict, extraArg, 1, 0);
+}
+
+stCache *stCache_constructConcurrent(int64_t shardNumber, int64_t capacity, stCacheEvictionPolicy policy,
+        void (*evict)(int64_t key, int64_t start, int64_t size, const void *value, void *extraArg), void *extraArg) {
+    return constructCache(capacity, policy, evict, extraArg, shardNumber, 1);
+}
+
+void stCache_destruct(stCache *cache) {
+    for (int64_t i = 0; i < cache->shardNumber; i++) {
+        stHash_destruct(cache->shards[i].keys);
+        if (cache->locks != NULL) {
+            pthread_mutex_destroy(&cache->locks[i]);
+        }
+    }
+    free(cache->shards);
+    free(cache->locks);
+    free(cache);
+}
+
+static int64_t getShardIndex(stCache *cache, int64_t key) {
+    if (cache->shardNumber == 1) {
+        return 0;
+    }
+    uint64_t i = key; //mix the bits, so that runs of keys are spread over the shards
+    i ^= i >> 33;
+    i *= 0xff51afd7ed558ccdULL;
+    i ^= i >> 33;
+    return i % cache->shardNumber;
+}
+
+static CacheShard *lockShard(stCache *cache, int64_t index) {
+    if (cache->locks != NULL) {
+        pthread_mutex_lock(&cache->locks[index]);
+    }
+    return &cache->shards[index];
+}
+
+static void unlockShard(stCache *cache, int64_t index) {
+    if (cache->locks != NULL) {
+        pthread_mutex_unlock(&cache->locks[index]);
+    }
+}
+
+void stCache_setEvictDirty(stCache *cache,
+        void (*evictDirty)(int64_t key, int64_t start, int64_t size, const void *value, void *extraArg), void *extraArg) {
+    for (int64_t i = 0; i < cache->shardNumber; i++) {
+        CacheShard *shard = lockShard(cache, i);
+        shard->evictDirty = evictDirty;
+        shard->evictDirtyExtraArg = extraArg;
+        unlockShard(cache, i);
+    }
+}
+
+void stCache_clear(stCache *cache) {
+    for (int64_t i = 0; i < cache->shardNumber; i++) {
+        shard_clear(lockShard(cache, i));
+        unlockShard(cache, i);
+    }
+}
+
+void stCache_setRecord(stCache *cache, int64_t key,
+       int64_t start, int64_t size,  const void *value) {
+    stCache_setRecord2(cache, key, start, size, value, 0);
+}
+
+void stCache_setRecord2(stCache *cache, int64_t key,
+       int64_t start, int64_t size,  const void *value, bool dirty) {
+    int64_t i = getShardIndex(cache, key);
+    shard_setRecord(lockShard(cache, i), key, start, size, value, dirty);
+    unlockShard(cache, i);
+}
+
+stList *stCache_getDirtyRanges(stCache *cache, int64_t key) {
+    int64_t i = getShardIndex(cache, key);
+    stList *ranges = shard_getDirtyRanges(lockShard(cache, i), key);
+    unlockShard(cache, i);
+    return ranges;
+}
+
+void stCache_flush(stCache *cache,
+        void (*write)(int64_t key, int64_t start, int64_t size, const void *value, void *extraArg), void *extraArg) {
+    for (int64_t i = 0; i < cache->shardNumber; i++) {
+        shard_flush(lockShard(cache, i), write, extraArg);
+        unlockShard(cache, i);
+    }
+}
+
+bool stCache_containsRecord(stCache *cache, int64_t key,
+        int64_t start, int64_t size) {
+    int64_t i = getShardIndex(cache, key);
+    bool contained = shard_containsRecord(lockShard(cache, i), key, start, size);
+    unlockShard(cache, i);
+    return contained;
+}
+
+void *stCache_getRecord(stCache *cache, int64_t key,
+        int64_t start, int64_t size, int64_t *sizeRead) {
+    int64_t i = getShardIndex(cache, key);
+    const void *view = shard_getRecordView(lockShard(cache, i), key, start, size, sizeRead);
+    void *record = view != NULL ? memcpy(st_malloc(*sizeRead), view, *sizeRead) : NULL;
+    unlockShard(cache, i);
+    return record;
+}
+
+const void *stCache_getRecordView(stCache *cache, int64_t key,
+        int64_t start, int64_t size, int64_t *sizeRead) {
+    if (cache->locks != NULL) {
+        st_errAbort("Record views can not be taken from a concurrent cache");
+    }
+    return shard_getRecordView(&cache->shards[getShardIndex(cache, key)], key, start, size, sizeRead);
+}
+
+int64_t stCache_getSize(stCache *cache) {
+    int64_t size = 0;
+    for (int64_t i = 0; i < cache->shardNumber; i++) {
+        size += lockShard(cache, i)->size;
+        unlockShard(cache, i);
+    }
+    return size;
+}
+
+int64_t stCache_getSizeOfRange(stCache *cache, int64_t key, int64_t start, int64_t size) {
+    int64_t i = getShardIndex(cache, key);
+    int64_t sizeOfRange = shard_getSizeOfRange(lockShard(cache, i), key, start, size);
+    unlockShard(cache, i);
+    return sizeOfRange;
+}
+
+int64_t stCache_getSizeOfKey(stCache *cache, int64_t key) {
+    return stCache_getSizeOfRange(cache, key, 0, INT64_MAX);
+}
+
+void stCache_save(stCache *cache, const char *fileName) {
+    char *tempFileName = stString_print("%s.tmp", fileName); //written then renamed, so an interrupted save leaves any old snapshot intact
+    FILE *fileHandle = fopen(tempFileName, "wb");
+    if (fileHandle == NULL) {
+        free(tempFileName);
+        stThrowNew(ST_CACHE_EXCEPTION_ID, "Could not open the cache snapshot %s for writing", fileName);
+    }
+    for (int64_t i = 0; i < cache->shardNumber; i++) { //no shard may change between being counted and written
+        lockShard(cache, i);
+    }
+    int64_t fragmentNumber = 0;
+    for (int64_t i = 0; i < cache->shardNumber; i++) {
+        fragmentNumber += shard_getFragmentNumber(&cache->shards[i]);
+    }
+    bool written = fwrite(SNAPSHOT_MAGIC, 1, 8, fileHandle) == 8 && fwrite(&fragmentNumber, sizeof(int64_t), 1, fileHandle) == 1;
+    for (int64_t i = 0; i < cache->shardNumber; i++) {
+        written = written && shard_save(&cache->shards[i], fileHandle);
+    }
+    for (int64_t i = 0; i < cache->shardNumber; i++) {
+        unlockShard(cache, i);
+    }
+    written = fclose(fileHandle) == 0 && written;
+    if (!written || rename(tempFileName, fileName) != 0) {
+        remove(tempFileName);
+        free(tempFileName);
+        stThrowNew(ST_CACHE_EXCEPTION_ID, "Failed to write the cache snapshot %s", fileName);
+    }
+    free(tempFileName);
+}
+
+void stCache_load(stCache *cache, const char *fileName) {
+    int fileDescriptor = open(fileName, O_RDONLY);
+    if (fileDescriptor == -1) {
+        stThrowNew(ST_CACHE_EXCEPTION_ID, "Could not open the cache snapshot %s", fileName);
+    }
+    struct stat info;
+    if (fstat(fileDescriptor, &info) != 0 || info.st_size < 16) {
+        close(fileDescriptor);
+        stThrowNew(ST_CACHE_EXCEPTION_ID, "The file %s is not a cache snapshot", fileName);
+    }
+    int64_t fileSize = info.st_size;
+    const char *snapshot = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+    close(fileDescriptor);
+    if (snapshot == MAP_FAILED) {
+        stThrowNew(ST_CACHE_EXCEPTION_ID, "Could not map the cache snapshot %s", fileName);
+    }
+    const int64_t *header = (const int64_t *) snapshot;
+    bool valid = memcmp(snapshot, SNAPSHOT_MAGIC, 8) == 0 && header[1] >= 0;
+    int64_t offset = 16;
+    for (int64_t i = 0; valid && i < header[1]; i++) {
+        if (fileSize - offset < 4 * (int64_t) sizeof(int64_t)) {
+            valid = 0;
+            break;
+        }
+        const int64_t *fragment = (const int64_t *) (snapshot + offset);
+        int64_t key = fragment[0], start = fragment[1], size = fragment[2], flags = fragment[3];
+        offset += 4 * sizeof(int64_t);
+        if (start < 0 || size < 0 || size > INT64_MAX - 8 - start || pad(size) > fileSize - offset) {
+            valid = 0;
+            break;
+        }
+        const char *value = snapshot + offset;
+        offset += pad(size);
+        stCache_setRecord2(cache, key, start, size, value, 0);
+        if (flags & SNAPSHOT_DIRTY_FLAG) {
+            if (pad((size + 7) / 8) > fileSize - offset) {
+                valid = 0;
+                break;
+            }
+            const uint8_t *dirty = (const uint8_t *) (snapshot + offset);
+            offset += pad((size + 7) / 8);
+            for (int64_t j = 0; j < size;) { //rewrite each dirty run as dirty
+                if (!((dirty[j >> 3] >> (j & 7)) & 1)) {
+                    j++;
+                    continue;
+                }
+                int64_t k = j + 1;
+                while (k < size && ((dirty[k >> 3] >> (k & 7)) & 1)) {
+                    k++;
+                }
+                stCache_setRecord2(cache, key, start + j, k - j, value + j, 1);
+                j = k;
+            }
+        }
+    }
+    munmap((void *) snapshot, fileSize);
+    if (!valid) {
+        stThrowNew(ST_CACHE_EXCEPTION_ID, "The cache snapshot %s is corrupt", fileName);
+    }
+}
+
 bool stCache_recordsIdentical(const char *value, int64_t sizeOfRecord,
         const char *updatedValue, int64_t updatedSizeOfRecord) {
     if (sizeOfRecord != updatedSizeOfRecord) {
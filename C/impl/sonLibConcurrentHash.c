@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2006-2012 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+/*
+ * sonLibConcurrentHash.c
+ *
+ * Each stripe is an stHash without destructors, guarded by a mutex. The stripe of a key is chosen from the low bits
+ * of a different mix of its hash than the one stHash uses to place it, so the keys of a stripe still spread over
+ * the whole of its table. Freezing moves the entries of the stripes into one table with the hash values stored
+ * with them, so no key is hashed or compared again.
+ */
+#include "sonLibGlobalsInternal.h"
+#include <pthread.h>
+
+typedef struct _stripe {
+    stHash *hash;
+    pthread_mutex_t lock;
+} Stripe;
+
+struct _stConcurrentHash {
+    Stripe *stripes;
+    int64_t stripeNumber; //a power of two.
+    uint32_t (*hashKey)(const void *);
+    int (*hashEqualsKey)(const void *, const void *);
+    void (*destructKeys)(void *);
+    void (*destructValues)(void *);
+};
+
+static int stConcurrentHash_equalKey(const void *key1, const void *key2) {
+    return key1 == key2;
+}
+
+static Stripe *lockStripe(stConcurrentHash *hash, void *key) {
+    Stripe *stripe = &hash->stripes[stHash_mix64(hash->hashKey(key)) & (hash->stripeNumber - 1)];
+    pthread_mutex_lock(&stripe->lock);
+    return stripe;
+}
+
+stConcurrentHash *stConcurrentHash_construct(int64_t stripeNumber) {
+    return stConcurrentHash_construct2(stripeNumber, stHash_pointer, stConcurrentHash_equalKey, NULL, NULL);
+}
+
+stConcurrentHash *stConcurrentHash_construct2(int64_t stripeNumber, uint32_t (*hashKey)(const void *),
+        int (*hashEqualsKey)(const void *, const void *), void (*destructKeys)(void *), void (*destructValues)(void *)) {
+    if (stripeNumber <= 0) {
+        st_errAbort("The number of stripes of a concurrent hash must be positive, not: %" PRIi64 "\n", stripeNumber);
+    }
+    stConcurrentHash *hash = st_malloc(sizeof(stConcurrentHash));
+    hash->stripeNumber = 1;
+    while (hash->stripeNumber < stripeNumber) {
+        hash->stripeNumber *= 2;
+    }
+    hash->stripes = st_malloc(hash->stripeNumber * sizeof(Stripe));
+    for (int64_t i = 0; i < hash->stripeNumber; i++) {
+        hash->stripes[i].hash = stHash_construct3(hashKey, hashEqualsKey, NULL, NULL);
+        pthread_mutex_init(&hash->stripes[i].lock, NULL);
+    }
+    hash->hashKey = hashKey;
+    hash->hashEqualsKey = hashEqualsKey;
+    hash->destructKeys = destructKeys;
+    hash->destructValues = destructValues;
+    return hash;
+}
+
+static void destructStripes(stConcurrentHash *hash) {
+    for (int64_t i = 0; i < hash->stripeNumber; i++) {
+        stHash_destruct(hash->stripes[i].hash);
+        pthread_mutex_destroy(&hash->stripes[i].lock);
+    }
+    free(hash->stripes);
+    free(hash);
+}
+
+void stConcurrentHash_destruct(stConcurrentHash *hash) {
+    if (hash->destructKeys != NULL || hash->destructValues != NULL) {
+        for (int64_t i = 0; i < hash->stripeNumber; i++) {
+            stHashIterator *iterator = stHash_getIterator(hash->stripes[i].hash);
+            void *key;
+            while ((key = stHash_getNext(iterator)) != NULL) {
+                if (hash->destructValues != NULL) {
+                    hash->destructValues(stHash_search(hash->stripes[i].hash, key));
+                }
+                if (hash->destructKeys != NULL) {
+                    hash->destructKeys(key);
+                }
+            }
+            stHash_destructIterator(iterator);
+        }
+    }
+    destructStripes(hash);
+}
+
+void stConcurrentHash_insert(stConcurrentHash *hash, void *key, void *value) {
+    Stripe *stripe = lockStripe(hash, key);
+    stHash_insert(stripe->hash, key, value);
+    pthread_mutex_unlock(&stripe->lock);
+}
+
+void *stConcurrentHash_insertIfAbsent(stConcurrentHash *hash, void *key, void *value) {
+    Stripe *stripe = lockStripe(hash, key);
+    bool inserted;
+    void **slot = stHash_getOrInsert(stripe->hash, key, &inserted);
+    void *presentValue = NULL;
+    if (inserted) {
+        *slot = value;
+    } else {
+        presentValue = *slot;
+    }
+    pthread_mutex_unlock(&stripe->lock);
+    return presentValue;
+}
+
+void *stConcurrentHash_search(stConcurrentHash *hash, void *key) {
+    Stripe *stripe = lockStripe(hash, key);
+    void *value = stHash_search(stripe->hash, key);
+    pthread_mutex_unlock(&stripe->lock);
+    return value;
+}
+
+void *stConcurrentHash_remove(stConcurrentHash *hash, void *key) {
+    Stripe *stripe = lockStripe(hash, key);
+    void *value = stHash_remove(stripe->hash, key);
+    pthread_mutex_unlock(&stripe->lock);
+    return value;
+}
+
+int64_t stConcurrentHash_size(stConcurrentHash *hash) {
+    int64_t size = 0;
+    for (int64_t i = 0; i < hash->stripeNumber; i++) {
+        pthread_mutex_lock(&hash->stripes[i].lock);
+        size += stHash_size(hash->stripes[i].hash);
+        pthread_mutex_unlock(&hash->stripes[i].lock);
+    }
+    return size;
+}
+
+void stConcurrentHash_reserve(stConcurrentHash *hash, int64_t size) {
+    int64_t stripeSize = size / hash->stripeNumber + 1;
+    stripeSize += stripeSize / 8; //Some stripes get more than their share
+    for (int64_t i = 0; i < hash->stripeNumber; i++) {
+        pthread_mutex_lock(&hash->stripes[i].lock);
+        stHash_reserve(hash->stripes[i].hash, stripeSize);
+        pthread_mutex_unlock(&hash->stripes[i].lock);
+    }
+}
+
+stHash *stConcurrentHash_freeze(stConcurrentHash *hash) {
+    stHash *frozen = stHash_construct3(hash->hashKey, hash->hashEqualsKey, hash->destructKeys, hash->destructValues);
+    stHash_reserve(frozen, stConcurrentHash_size(hash));
+    for (int64_t i = 0; i < hash->stripeNumber; i++) { //The stripes hold distinct keys, so each entry is just moved
+        stHash_moveEntries(frozen, hash->stripes[i].hash);
+    }
+    destructStripes(hash);
+    return frozen;
+}
@@ -19,10 +19,9 @@ struct stExcept {
 };
 
 /*
- * Exception content Top Of Stack.
- * FIXME: should be in thread-local storage.
+ * Exception content Top Of Stack. Thread local, so each thread has its own try blocks.
  */
-struct _stExceptContext *_cexceptTOS = NULL;
+__thread struct _stExceptContext *_cexceptTOS = NULL;
 
 stExcept *stExcept_newv(const char *id, const char *msg, va_list args) {
     stExcept *except = stSafeCCalloc(sizeof(stExcept));
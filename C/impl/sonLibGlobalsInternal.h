@@ -32,6 +32,7 @@
 #include "CuTest.h"
 #include "sonLib.h"
 #include "sonLibListPrivate.h"
+#include "sonLibHashPrivate.h"
 
 
 
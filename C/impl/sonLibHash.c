@@ -11,26 +11,348 @@
  *      Author: benedictpaten
  */
 #include "sonLibGlobalsInternal.h"
-#include "hashTableC.h"
-#include "hashTableC_itr.h"
+
+/*
+ * The hash is an open addressing table using Robin Hood hashing: each entry is stored at or after
+ * its home slot, and on insertion an entry further from its home takes the slot of one nearer to
+ * its own, so the distances of entries from home stay short and even. Lookups stop as soon as
+ * they reach an entry nearer its home than the key would be. Removal shifts the following entries
+ * back a slot, so there are no tombstones.
+ *
+ * The table does not wrap around. It has maxDistance slots beyond its capacity, and grows if an
+ * entry would be further than that from home. So iterating backwards over the slots is unaffected
+ * by removing the entry just returned, as removal only moves entries that are later in the table.
+ * If the table is less than half full when an entry would be too far from home, the keys must share
+ * a few home slots, as with a poor hash function, and growing would not shorten their probes. So
+ * instead maxDistance is doubled and the slots beyond the capacity extended to match.
+ *
+ * With incremental resizing a grow allocates the new table but leaves the entries in the old one.
+ * Each insert or remove then moves the entries of a few old slots, working down from the top of the
+ * old table, and lookups check both tables until the old one is empty. Working down keeps the probe
+ * sequences of the entries left in the old table intact.
+ */
+typedef struct _hashEntry {
+    void *key;
+    void *value;
+    uint32_t hash;
+    int32_t distance; //one more than the distance from the home slot, or 0 if the slot is empty, so a zeroed table is empty.
+} HashEntry;
 
 struct _stHash {
-    struct hashtable *hash;
-    bool destructKeys, destructValues;
+    HashEntry *entries;
+    int64_t capacity; //a power of two, or zero before the first insert.
+    int64_t slotNumber; //capacity + maxDistance.
+    int32_t maxDistance; //the furthest any entry may be from its home slot, log2(capacity) unless extended.
+    int32_t shift; //32 - log2(capacity).
+    int64_t size;
+    HashEntry *oldEntries; //the table being migrated from by an incremental resize, else NULL.
+    int64_t oldSlotNumber;
+    int32_t oldMaxDistance;
+    int32_t oldShift;
+    int64_t oldSize;
+    int64_t migrationIndex; //the old slots at or above this have been migrated.
+    bool incrementalResize;
+    uint32_t (*hashKey)(const void *);
+    int (*hashEqualsKey)(const void *, const void *);
+    void (*destructKeys)(void *);
+    void (*destructValues)(void *);
+};
+
+struct _stHashIterator {
+    stHash *hash;
+    int64_t index;
 };
 
+#define MIN_CAPACITY 8
+#define MIGRATION_STEP 8 //old slots migrated per insert or remove, enough to finish well before the next grow
+
+static uint32_t mixHash(uint32_t i) {
+    /*
+     * Protects against poor hash functions, such as the low bits of pointers, which are mostly zero.
+     */
+    i ^= i >> 16;
+    i *= 0x85ebca6b;
+    i ^= i >> 13;
+    i *= 0xc2b2ae35;
+    i ^= i >> 16;
+    return i;
+}
+
+static int64_t getHomeSlot(int32_t shift, uint32_t hashValue) {
+    return (uint32_t) (hashValue * 2654435769U) >> shift; //Fibonacci hashing takes the well mixed top bits
+}
+
+static void allocateEntries(stHash *hash, int64_t capacity) {
+    hash->capacity = capacity;
+    int32_t log2Capacity = 0;
+    while (((int64_t) 1 << log2Capacity) < capacity) {
+        log2Capacity++;
+    }
+    hash->shift = 32 - log2Capacity;
+    hash->maxDistance = log2Capacity < 8 ? 8 : log2Capacity;
+    hash->slotNumber = capacity + hash->maxDistance;
+    hash->entries = st_calloc(hash->slotNumber, sizeof(HashEntry)); //Large allocations come zeroed from the system, so this does not stall
+}
+
+static void insertEntry(stHash *hash, HashEntry entry);
+
+static void freeOldEntries(stHash *hash) {
+    free(hash->oldEntries);
+    hash->oldEntries = NULL;
+    hash->oldSize = 0;
+}
+
+/*
+ * Moves the entries of up to the given number of old slots into the table.
+ */
+static void migrate(stHash *hash, int64_t slotNumber) {
+    while (hash->oldEntries != NULL && slotNumber-- > 0) {
+        HashEntry *slot = &hash->oldEntries[--hash->migrationIndex];
+        if (slot->distance > 0) {
+            HashEntry entry = *slot;
+            slot->distance = 0; //The slot above is already empty, so there is nothing to shift back
+            if (--hash->oldSize == 0) {
+                freeOldEntries(hash);
+            }
+            insertEntry(hash, entry);
+        }
+    }
+}
+
+static void finishMigration(stHash *hash) {
+    migrate(hash, INT64_MAX);
+}
+
+static void resize(stHash *hash, int64_t capacity, bool incremental) {
+    finishMigration(hash);
+    if (capacity <= hash->capacity) { //Finishing the migration grew the table
+        return;
+    }
+    HashEntry *entries = hash->entries;
+    int64_t slotNumber = hash->slotNumber;
+    int32_t maxDistance = hash->maxDistance, shift = hash->shift;
+    int64_t size = hash->size;
+    allocateEntries(hash, capacity);
+    hash->size = 0;
+    if (incremental && size > 0) {
+        hash->oldEntries = entries;
+        hash->oldSlotNumber = slotNumber;
+        hash->oldMaxDistance = maxDistance;
+        hash->oldShift = shift;
+        hash->oldSize = size;
+        hash->migrationIndex = slotNumber;
+        return;
+    }
+    for (int64_t i = 0; i < slotNumber; i++) {
+        if (entries[i].distance > 0) {
+            insertEntry(hash, entries[i]);
+        }
+    }
+    free(entries);
+}
+
+static void grow(stHash *hash) {
+    resize(hash, hash->capacity == 0 ? MIN_CAPACITY : hash->capacity * 2, hash->incrementalResize);
+}
+
+/*
+ * Called when an entry would be further than maxDistance from its home slot. Either doubles maxDistance,
+ * extending the table with empty slots, and returns non-zero, or, if the table is at least half full, grows
+ * it and returns zero.
+ */
+static bool extendOrGrow(stHash *hash) {
+    if (hash->size >= hash->capacity / 2 || hash->maxDistance > INT32_MAX / 2) {
+        grow(hash);
+        return 0;
+    }
+    int64_t slotNumber = hash->capacity + 2 * (int64_t) hash->maxDistance;
+    HashEntry *entries = realloc(hash->entries, slotNumber * sizeof(HashEntry));
+    if (entries == NULL) {
+        st_errAbort("Failed to allocate %lld slots for a hash", (long long) slotNumber);
+    }
+    memset(entries + hash->slotNumber, 0, (slotNumber - hash->slotNumber) * sizeof(HashEntry));
+    hash->entries = entries;
+    hash->slotNumber = slotNumber;
+    hash->maxDistance *= 2;
+    return 1;
+}
+
+static bool isFull(stHash *hash) {
+    return hash->size >= hash->capacity - hash->capacity / 8; //Keep the load below 7/8
+}
+
+/*
+ * Places an entry whose key is not in the hash at slot i, which must be empty or hold an entry nearer its home
+ * than entry.distance. Returns non-zero if the entry was placed there, or zero if the table had to grow,
+ * in which case the entry is somewhere else.
+ */
+static bool placeEntry(stHash *hash, int64_t i, HashEntry entry) {
+    assert(hash->entries[i].distance < entry.distance);
+    while (1) {
+        HashEntry *slot = &hash->entries[i];
+        if (slot->distance == 0) {
+            *slot = entry;
+            hash->size++;
+            return 1;
+        }
+        if (slot->distance < entry.distance) { //Take from the rich, and carry on inserting the displaced entry
+            HashEntry displaced = *slot;
+            *slot = entry;
+            entry = displaced;
+        }
+        i++;
+        if (++entry.distance > hash->maxDistance && !extendOrGrow(hash)) { //The entries in the table are all in place, so try again
+            insertEntry(hash, entry);
+            return 0;
+        }
+    }
+}
+
+/*
+ * Inserts an entry whose key is not in the hash.
+ */
+static void insertEntry(stHash *hash, HashEntry entry) {
+    if (isFull(hash)) {
+        grow(hash);
+    }
+    int64_t i = getHomeSlot(hash->shift, entry.hash);
+    entry.distance = 1;
+    while (hash->entries[i].distance >= entry.distance) { //Skip the entries at least as far from home
+        i++;
+        if (++entry.distance > hash->maxDistance && !extendOrGrow(hash)) {
+            insertEntry(hash, entry);
+            return;
+        }
+    }
+    placeEntry(hash, i, entry);
+}
+
+static int64_t findEntry(stHash *hash, void *key, uint32_t hashValue);
+
+static int64_t findOldEntry(stHash *hash, void *key, uint32_t hashValue);
+
+static void removeOldEntry(stHash *hash, int64_t i);
+
+/*
+ * Returns the slot of a key that is in the hash, first migrating it if it is in the old table.
+ */
+static int64_t findMigratedEntry(stHash *hash, void *key, uint32_t hashValue) {
+    int64_t i = findOldEntry(hash, key, hashValue);
+    if (i != -1) {
+        HashEntry entry = hash->oldEntries[i];
+        removeOldEntry(hash, i);
+        insertEntry(hash, entry);
+    }
+    return findEntry(hash, key, hashValue);
+}
+
+/*
+ * Returns the slot of the key, inserting it with a NULL value if it is not present, with one probe of the table
+ * unless the table must grow.
+ */
+static int64_t getOrInsertEntry(stHash *hash, void *key, uint32_t hashValue, bool *inserted) {
+    if (hash->oldEntries != NULL) {
+        migrate(hash, MIGRATION_STEP);
+        if (findOldEntry(hash, key, hashValue) != -1) { //Migrate the entry now, so the pointer to its value stays good
+            *inserted = 0;
+            return findMigratedEntry(hash, key, hashValue);
+        }
+    }
+    HashEntry entry;
+    entry.key = key;
+    entry.value = NULL;
+    entry.hash = hashValue;
+    if (hash->capacity > 0) {
+        int64_t i = getHomeSlot(hash->shift, hashValue);
+        int32_t distance = 1;
+        for (; distance <= hash->maxDistance && hash->entries[i].distance >= distance; distance++, i++) {
+            if (hash->entries[i].hash == hashValue && hash->hashEqualsKey(key, hash->entries[i].key)) {
+                *inserted = 0;
+                return i;
+            }
+        }
+        if (distance <= hash->maxDistance && !isFull(hash)) { //Not present, and i is where it goes
+            *inserted = 1;
+            entry.distance = distance;
+            return placeEntry(hash, i, entry) ? i : findMigratedEntry(hash, key, hashValue); //An incremental grow may leave it in the old table
+        }
+    }
+    *inserted = 1;
+    insertEntry(hash, entry);
+    return findMigratedEntry(hash, key, hashValue);
+}
+
+static int64_t findEntry(stHash *hash, void *key, uint32_t hashValue) {
+    if (hash->size == 0) {
+        return -1;
+    }
+    int64_t i = getHomeSlot(hash->shift, hashValue);
+    for (int32_t distance = 1; distance <= hash->maxDistance && hash->entries[i].distance >= distance; distance++, i++) {
+        /* Check hash value to short circuit heavier comparison */
+        if (hash->entries[i].hash == hashValue && hash->hashEqualsKey(key, hash->entries[i].key)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int64_t findOldEntry(stHash *hash, void *key, uint32_t hashValue) {
+    if (hash->oldEntries == NULL) {
+        return -1;
+    }
+    int64_t i = getHomeSlot(hash->oldShift, hashValue);
+    for (int32_t distance = 1; distance <= hash->oldMaxDistance && hash->oldEntries[i].distance >= distance; distance++, i++) {
+        if (hash->oldEntries[i].hash == hashValue && hash->hashEqualsKey(key, hash->oldEntries[i].key)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void shiftBack(HashEntry *entries, int64_t slotNumber, int64_t i) {
+    while (i + 1 < slotNumber && entries[i + 1].distance > 1) {
+        entries[i] = entries[i + 1];
+        entries[i].distance--;
+        i++;
+    }
+    entries[i].distance = 0;
+}
+
+static void removeEntry(stHash *hash, int64_t i) {
+    shiftBack(hash->entries, hash->slotNumber, i);
+    hash->size--;
+}
+
+static void removeOldEntry(stHash *hash, int64_t i) {
+    shiftBack(hash->oldEntries, hash->oldSlotNumber, i);
+    if (--hash->oldSize == 0) {
+        freeOldEntries(hash);
+    }
+}
+
+/*
+ * Removes the key from whichever table it is in, returning non-zero if it was present.
+ */
+static bool removeKey(stHash *hash, void *key, void **storedKey, void **value) {
+    uint32_t hashValue = mixHash(hash->hashKey(key));
+    int64_t i = findEntry(hash, key, hashValue);
+    if (i != -1) {
+        *storedKey = hash->entries[i].key;
+        *value = hash->entries[i].value;
+        removeEntry(hash, i);
+    } else if ((i = findOldEntry(hash, key, hashValue)) != -1) {
+        *storedKey = hash->oldEntries[i].key;
+        *value = hash->oldEntries[i].value;
+        removeOldEntry(hash, i);
+    } else {
+        return 0;
+    }
+    migrate(hash, MIGRATION_STEP);
+    return 1;
+}
+
 uint32_t stHash_pointer(const void *k) {
-    /*if (sizeof(const void *) > 4) {
-        int64_t key = (int64_t) (size_t) k;
-        key = (~key) + (key << 18); // key = (key << 18) - key - 1;
-        key = key ^ (key >> 31);
-        key = key * 21; // key = (key + (key << 2)) + (key << 4);
-        key = key ^ (key >> 11);
-        key = key + (key << 6);
-        key = key ^ (key >> 22);
-        return (uint32_t) key;
-    }*/
-    return (uint32_t) (size_t) k; //Just use the low order bits
+    return (uint32_t) stHash_mix64((uint64_t) (size_t) k); //Aligned pointers have their low bits zero, so mix them all in
 }
 
 static int stHash_equalKey(const void *key1, const void *key2) {
@@ -46,59 +368,148 @@ stHash *stHash_construct2(void(*destructKeys)(void *), void(*destructValues)(voi
 }
 
 stHash *stHash_construct3(uint32_t(*hashKey)(const void *), int(*hashEqualsKey)(const void *, const void *), void(*destructKeys)(void *), void(*destructValues)(void *)) {
-    stHash *hash = st_malloc(sizeof(stHash));
-    hash->hash = create_hashtable(0, hashKey, hashEqualsKey, destructKeys, destructValues);
-    hash->destructKeys = destructKeys != NULL;
-    hash->destructValues = destructValues != NULL;
+    stHash *hash = st_calloc(1, sizeof(stHash));
+    hash->hashKey = hashKey;
+    hash->hashEqualsKey = hashEqualsKey;
+    hash->destructKeys = destructKeys;
+    hash->destructValues = destructValues;
     return hash;
 }
 
 void stHash_destruct(stHash *hash) {
-    hashtable_destroy(hash->hash, hash->destructValues, hash->destructKeys);
+    if (hash->destructKeys != NULL || hash->destructValues != NULL) {
+        for (int64_t i = 0; i < hash->slotNumber; i++) {
+            if (hash->entries[i].distance > 0) {
+                if (hash->destructKeys != NULL) {
+                    hash->destructKeys(hash->entries[i].key);
+                }
+                if (hash->destructValues != NULL) {
+                    hash->destructValues(hash->entries[i].value);
+                }
+            }
+        }
+        for (int64_t i = 0; hash->oldEntries != NULL && i < hash->migrationIndex; i++) {
+            if (hash->oldEntries[i].distance > 0) {
+                if (hash->destructKeys != NULL) {
+                    hash->destructKeys(hash->oldEntries[i].key);
+                }
+                if (hash->destructValues != NULL) {
+                    hash->destructValues(hash->oldEntries[i].value);
+                }
+            }
+        }
+    }
+    free(hash->oldEntries);
+    free(hash->entries);
     free(hash);
 }
 
 void stHash_insert(stHash *hash, void *key, void *value) {
-    if (stHash_search(hash, key) != NULL) { //This will ensure we don't end up with duplicate keys..
-        stHash_remove(hash, key);
+    bool inserted;
+    int64_t i = getOrInsertEntry(hash, key, mixHash(hash->hashKey(key)), &inserted);
+    hash->entries[i].key = key; //This will ensure we don't end up with duplicate keys..
+    hash->entries[i].value = value;
+}
+
+void *stHash_upsert(stHash *hash, void *key, void *value) {
+    bool inserted;
+    int64_t i = getOrInsertEntry(hash, key, mixHash(hash->hashKey(key)), &inserted);
+    void *oldValue = hash->entries[i].value;
+    hash->entries[i].value = value;
+    return oldValue;
+}
+
+void **stHash_getOrInsert(stHash *hash, void *key, bool *inserted) {
+    bool i;
+    int64_t j = getOrInsertEntry(hash, key, mixHash(hash->hashKey(key)), &i);
+    if (inserted != NULL) {
+        *inserted = i;
+    }
+    return &hash->entries[j].value;
+}
+
+void stHash_reserve(stHash *hash, int64_t size) {
+    int64_t capacity = hash->capacity == 0 ? MIN_CAPACITY : hash->capacity;
+    while (size >= capacity - capacity / 8) {
+        capacity *= 2;
+    }
+    if (capacity > hash->capacity) {
+        resize(hash, capacity, 0);
+    }
+}
+
+void stHash_moveEntries(stHash *destination, stHash *source) {
+    assert(destination->hashKey == source->hashKey);
+    finishMigration(source);
+    stHash_reserve(destination, destination->size + source->size);
+    for (int64_t i = 0; i < source->slotNumber; i++) {
+        if (source->entries[i].distance > 0) {
+            insertEntry(destination, source->entries[i]);
+            source->entries[i].distance = 0;
+        }
+    }
+    source->size = 0;
+}
+
+void stHash_setIncrementalResize(stHash *hash, bool incrementalResize) {
+    hash->incrementalResize = incrementalResize;
+    if (!incrementalResize) {
+        finishMigration(hash);
     }
-    hashtable_insert(hash->hash, key, value);
 }
 
 void *stHash_search(stHash *hash, void *key) {
-    return hashtable_search(hash->hash, key);
+    if (hash->size == 0 && hash->oldEntries == NULL) {
+        return NULL;
+    }
+    uint32_t hashValue = mixHash(hash->hashKey(key));
+    int64_t i = findEntry(hash, key, hashValue);
+    if (i != -1) {
+        return hash->entries[i].value;
+    }
+    i = findOldEntry(hash, key, hashValue);
+    return i != -1 ? hash->oldEntries[i].value : NULL;
 }
 
 void *stHash_remove(stHash *hash, void *key) {
-    return hashtable_remove(hash->hash, key, 0);
+    void *storedKey, *value;
+    return removeKey(hash, key, &storedKey, &value) ? value : NULL;
 }
 
 void *stHash_removeAndFreeKey(stHash *hash, void *key) {
-    return hashtable_remove(hash->hash, key, 1);
+    void *storedKey, *value;
+    if (!removeKey(hash, key, &storedKey, &value)) {
+        return NULL;
+    }
+    hash->destructKeys(storedKey);
+    return value;
 }
 
 int32_t stHash_size(stHash *hash) {
-    return hashtable_count(hash->hash);
+    return hash->size + hash->oldSize;
 }
 
 stHashIterator *stHash_getIterator(stHash *hash) {
-    return hashtable_iterator(hash->hash);
+    finishMigration(hash); //So the iterator only has the one table to cover
+    stHashIterator *iterator = st_malloc(sizeof(stHashIterator));
+    iterator->hash = hash;
+    iterator->index = hash->slotNumber;
+    return iterator;
 }
 
 void *stHash_getNext(stHashIterator *iterator) {
-    if (iterator->e != NULL) {
-        void *o = hashtable_iterator_key(iterator);
-        hashtable_iterator_advance(iterator);
-        return o;
+    while (--iterator->index >= 0) {
+        if (iterator->hash->entries[iterator->index].distance > 0) {
+            return iterator->hash->entries[iterator->index].key;
+        }
     }
+    iterator->index = 0; //so that further calls keep returning NULL
     return NULL;
 }
 
 stHashIterator *stHash_copyIterator(stHashIterator *iterator) {
     stHashIterator *iterator2 = st_malloc(sizeof(stHashIterator));
-    iterator2->h = iterator->h;
-    iterator2->e = iterator->e;
-    iterator2->parent = iterator->parent;
+    iterator2->hash = iterator->hash;
     iterator2->index = iterator->index;
     return iterator2;
 }
@@ -133,20 +544,53 @@ stList *stHash_getValues(stHash *hash) {
  * Useful hash keys/equals functions
  */
 
-uint32_t stHash_stringKey(const void *k) {
-    // djb2
-    // This algorithm was first reported by Dan Bernstein
-    // many years ago in comp.lang.c
-    //
-    uint32_t hash = 0; //5381;
-    int c;
-    char *cA;
-    cA = (char *) k;
-    while ((c = *cA++) != '\0') {
-        hash = c + (hash << 6) + (hash << 16) - hash;
-        //hash = ((hash << 5) + hash) + c; // hash*33 + c
+/*
+ * The byte hash follows the structure of xxHash64: each 8 byte word is scrambled by a multiply and rotate
+ * and folded into the state, and the state is finished with a 64 bit mixer.
+ */
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+static uint64_t rotateLeft(uint64_t i, int32_t bits) {
+    return (i << bits) | (i >> (64 - bits));
+}
+
+static uint64_t addWord(uint64_t hash, uint64_t word) {
+    hash ^= rotateLeft(word * PRIME64_2, 31) * PRIME64_1;
+    return rotateLeft(hash, 27) * PRIME64_1 + PRIME64_4;
+}
+
+uint64_t stHash_mix64(uint64_t i) {
+    i ^= i >> 30;
+    i *= 0xbf58476d1ce4e5b9ULL;
+    i ^= i >> 27;
+    i *= 0x94d049bb133111ebULL;
+    i ^= i >> 31;
+    return i;
+}
+
+uint64_t stHash_bytes64(const void *bytes, int64_t length, uint64_t seed) {
+    const uint8_t *cA = bytes;
+    uint64_t hash = seed + PRIME64_5 + (uint64_t) length;
+    for (; length >= 8; cA += 8, length -= 8) {
+        uint64_t word;
+        memcpy(&word, cA, 8);
+        hash = addWord(hash, word);
     }
-    return hash;
+    if (length > 0) {
+        uint64_t word = 0;
+        for (int64_t i = 0; i < length; i++) {
+            word |= ((uint64_t) cA[i]) << (8 * i);
+        }
+        hash = addWord(hash, word);
+    }
+    return stHash_mix64(hash);
+}
+
+uint32_t stHash_stringKey(const void *k) {
+    return (uint32_t) stHash_bytes64(k, strlen(k), 0);
 }
 
 int stHash_stringEqualKey(const void *key1, const void *key2) {
@@ -173,14 +617,14 @@ stHash *stHash_invert(stHash *hash, uint32_t(*hashKey)(const void *), int(*equal
 }
 // interface to underlying functions
 uint32_t (*stHash_getHashFunction(stHash *hash))(const void *) {
-    return hash->hash->hashfn;
+    return hash->hashKey;
 }
 int (*stHash_getEqualityFunction(stHash *hash))(const void *, const void *) {
-    return hash->hash->eqfn;
+    return hash->hashEqualsKey;
 }
 void (*stHash_getKeyDestructorFunction(stHash *hash))(void *) {
-    return hash->hash->keyFree;
+    return hash->destructKeys;
 }
 void (*stHash_getValueDestructorFunction(stHash *hash))(void *) {
-    return hash->hash->valueFree;
+    return hash->destructValues;
 }
@@ -0,0 +1,17 @@
+/*
+ * sonLibHashPrivate.h
+ *
+ *  Functions on stHash for use by the other containers of the library.
+ */
+
+#ifndef SONLIBHASHPRIVATE_H_
+#define SONLIBHASHPRIVATE_H_
+
+/*
+ * Moves every key and value of the source into the destination, leaving the source empty. The two must have the
+ * same hash function and no keys in common. The hash values stored with the entries are reused, so no key is
+ * hashed or compared.
+ */
+void stHash_moveEntries(stHash *destination, stHash *source);
+
+#endif /* SONLIBHASHPRIVATE_H_ */
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2006-2012 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+/*
+ * sonLibHeap.c
+ *
+ * The array holds pointers to the handles, and each handle records its position in the array, updated as it
+ * moves, so an element is found from its handle in constant time. Handles come from a pool.
+ */
+#include "sonLibGlobalsInternal.h"
+
+#define MINIMUM_CAPACITY 16
+
+const char *ST_HEAP_EXCEPTION_ID = "ST_HEAP_EXCEPTION";
+
+struct _stHeapHandle {
+    void *element;
+    int64_t index; //the position of the handle in the array.
+};
+
+struct _stHeap {
+    stHeapHandle **handles; //handles[i] is not greater than handles[2i + 1] and handles[2i + 2].
+    int64_t size;
+    int64_t capacity;
+    int (*compareFn)(const void *, const void *);
+    void (*destructElementFn)(void *);
+    stPool *handlePool;
+};
+
+static void setCapacity(stHeap *heap, int64_t capacity) {
+    stHeapHandle **handles = st_malloc(capacity * sizeof(stHeapHandle *));
+    memcpy(handles, heap->handles, heap->size * sizeof(stHeapHandle *));
+    free(heap->handles);
+    heap->handles = handles;
+    heap->capacity = capacity;
+}
+
+static void place(stHeap *heap, stHeapHandle *handle, int64_t i) {
+    heap->handles[i] = handle;
+    handle->index = i;
+}
+
+/*
+ * Moves the handle at i up the heap until its parent is not greater than it.
+ */
+static void siftUp(stHeap *heap, int64_t i) {
+    stHeapHandle *handle = heap->handles[i];
+    while (i > 0) {
+        int64_t parent = (i - 1) / 2;
+        if (heap->compareFn(heap->handles[parent]->element, handle->element) <= 0) {
+            break;
+        }
+        place(heap, heap->handles[parent], i);
+        i = parent;
+    }
+    place(heap, handle, i);
+}
+
+/*
+ * Moves the handle at i down the heap until neither of its children is less than it.
+ */
+static void siftDown(stHeap *heap, int64_t i) {
+    stHeapHandle *handle = heap->handles[i];
+    int64_t child;
+    while ((child = 2 * i + 1) < heap->size) {
+        if (child + 1 < heap->size && heap->compareFn(heap->handles[child + 1]->element, heap->handles[child]->element) < 0) {
+            child++;
+        }
+        if (heap->compareFn(heap->handles[child]->element, handle->element) >= 0) {
+            break;
+        }
+        place(heap, heap->handles[child], i);
+        i = child;
+    }
+    place(heap, handle, i);
+}
+
+static stHeapHandle *constructHandle(stHeap *heap, void *element) {
+    stHeapHandle *handle = stPool_malloc(heap->handlePool);
+    handle->element = element;
+    return handle;
+}
+
+stHeap *stHeap_construct(int (*compareFn)(const void *, const void *), void (*destructElementFn)(void *)) {
+    stHeap *heap = st_malloc(sizeof(stHeap));
+    heap->handles = st_malloc(MINIMUM_CAPACITY * sizeof(stHeapHandle *));
+    heap->size = 0;
+    heap->capacity = MINIMUM_CAPACITY;
+    heap->compareFn = compareFn;
+    heap->destructElementFn = destructElementFn;
+    heap->handlePool = stPool_construct(sizeof(stHeapHandle));
+    return heap;
+}
+
+stHeap *stHeap_constructFromList(stList *list, int (*compareFn)(const void *, const void *),
+        void (*destructElementFn)(void *), stList *handles) {
+    stHeap *heap = stHeap_construct(compareFn, destructElementFn);
+    if (stList_length(list) > heap->capacity) {
+        setCapacity(heap, stList_length(list));
+    }
+    for (int64_t i = 0; i < stList_length(list); i++) {
+        stHeapHandle *handle = constructHandle(heap, stList_get(list, i));
+        place(heap, handle, heap->size++);
+        if (handles != NULL) {
+            stList_append(handles, handle);
+        }
+    }
+    for (int64_t i = heap->size / 2 - 1; i >= 0; i--) { //Floyd's heap construction
+        siftDown(heap, i);
+    }
+    return heap;
+}
+
+void stHeap_destruct(stHeap *heap) {
+    if (heap->destructElementFn != NULL) {
+        for (int64_t i = 0; i < heap->size; i++) {
+            heap->destructElementFn(heap->handles[i]->element);
+        }
+    }
+    stPool_destruct(heap->handlePool);
+    free(heap->handles);
+    free(heap);
+}
+
+stHeapHandle *stHeap_insert(stHeap *heap, void *element) {
+    if (heap->size == heap->capacity) {
+        setCapacity(heap, heap->capacity * 2);
+    }
+    stHeapHandle *handle = constructHandle(heap, element);
+    place(heap, handle, heap->size++);
+    siftUp(heap, handle->index);
+    return handle;
+}
+
+void *stHeap_peek(stHeap *heap) {
+    return heap->size > 0 ? heap->handles[0]->element : NULL;
+}
+
+void *stHeap_pop(stHeap *heap) {
+    return heap->size > 0 ? stHeap_remove(heap, heap->handles[0]) : NULL;
+}
+
+void stHeap_decreaseKey(stHeap *heap, stHeapHandle *handle, void *element) {
+    if (heap->compareFn(element, handle->element) > 0) {
+        stThrowNew(ST_HEAP_EXCEPTION_ID, "Tried to decrease the key of a heap element to a greater one");
+    }
+    handle->element = element;
+    siftUp(heap, handle->index);
+}
+
+void *stHeap_remove(stHeap *heap, stHeapHandle *handle) {
+    void *element = handle->element;
+    int64_t i = handle->index;
+    stHeapHandle *last = heap->handles[--heap->size];
+    stPool_free(heap->handlePool, handle);
+    if (last != handle) { //Fill the hole with the last handle, which may belong above or below it
+        place(heap, last, i);
+        siftUp(heap, i);
+        siftDown(heap, last->index);
+    }
+    return element;
+}
+
+void *stHeap_getElement(stHeapHandle *handle) {
+    return handle->element;
+}
+
+int64_t stHeap_size(stHeap *heap) {
+    return heap->size;
+}
@@ -0,0 +1,367 @@
+/*
+ * Copyright (C) 2006-2012 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+/*
+ * sonLibInt64Hash.c
+ *
+ * The same Robin Hood table as sonLibHash.c, but with the keys, values and distances from home in
+ * separate flat arrays, so a probe only touches the distances and keys. The values array is not
+ * allocated for a set. Pointer values are stored cast to int64_t.
+ */
+#include "sonLibGlobalsInternal.h"
+
+struct _stInt64Hash {
+    int64_t *keys;
+    int64_t *values; //NULL for a set.
+    int8_t *distances; //from the home slot, -1 if the slot is empty.
+    int64_t capacity; //a power of two, or zero before the first insert.
+    int64_t slotNumber; //capacity + maxDistance.
+    int32_t maxDistance; //probes stop short of this, so it is at most 127, the largest distance that fits.
+    int32_t shift; //64 - log2(capacity).
+    int64_t size;
+    bool isSet;
+    void (*destructValues)(void *);
+};
+
+struct _stInt64Set {
+    stInt64Hash hash;
+};
+
+struct _stInt64HashIterator {
+    stInt64Hash *hash;
+    int64_t index;
+};
+
+#define MIN_CAPACITY 8
+
+static int64_t getHomeSlot(stInt64Hash *hash, int64_t key) {
+    return stHash_mix64((uint64_t) key) >> hash->shift; //The top bits of the mixed key
+}
+
+static void allocateSlots(stInt64Hash *hash, int64_t capacity) {
+    hash->capacity = capacity;
+    int32_t log2Capacity = 0;
+    while (((int64_t) 1 << log2Capacity) < capacity) {
+        log2Capacity++;
+    }
+    hash->shift = 64 - log2Capacity;
+    hash->maxDistance = capacity < INT8_MAX ? capacity : INT8_MAX; //As far as a distance can be stored, so the load sets the size
+    hash->slotNumber = capacity + hash->maxDistance;
+    hash->keys = st_malloc(hash->slotNumber * sizeof(int64_t));
+    hash->values = hash->isSet ? NULL : st_malloc(hash->slotNumber * sizeof(int64_t));
+    hash->distances = st_malloc(hash->slotNumber * sizeof(int8_t));
+    memset(hash->distances, -1, hash->slotNumber * sizeof(int8_t));
+}
+
+static void insertSlot(stInt64Hash *hash, int64_t key, int64_t value);
+
+static void resize(stInt64Hash *hash, int64_t capacity) {
+    int64_t *keys = hash->keys, *values = hash->values;
+    int8_t *distances = hash->distances;
+    int64_t slotNumber = hash->slotNumber;
+    allocateSlots(hash, capacity);
+    hash->size = 0;
+    for (int64_t i = 0; i < slotNumber; i++) {
+        if (distances[i] >= 0) {
+            insertSlot(hash, keys[i], values != NULL ? values[i] : 0);
+        }
+    }
+    free(keys);
+    free(values);
+    free(distances);
+}
+
+static void grow(stInt64Hash *hash) {
+    resize(hash, hash->capacity == 0 ? MIN_CAPACITY : hash->capacity * 2);
+}
+
+static bool isFull(stInt64Hash *hash) {
+    return hash->size >= hash->capacity - hash->capacity / 8; //Keep the load below 7/8
+}
+
+/*
+ * Places a key that is not in the hash at slot i, which must be empty or hold a key nearer its home than distance.
+ * Returns non-zero if the key was placed there, or zero if the table had to grow, in which case the key is somewhere else.
+ */
+static bool placeSlot(stInt64Hash *hash, int64_t i, int64_t key, int64_t value, int32_t distance) {
+    assert(hash->distances[i] < distance);
+    while (1) {
+        if (hash->distances[i] < 0) {
+            hash->keys[i] = key;
+            if (hash->values != NULL) {
+                hash->values[i] = value;
+            }
+            hash->distances[i] = distance;
+            hash->size++;
+            return 1;
+        }
+        if (hash->distances[i] < distance) { //Take from the rich, and carry on inserting the displaced key
+            int64_t displacedKey = hash->keys[i];
+            int32_t displacedDistance = hash->distances[i];
+            hash->keys[i] = key;
+            hash->distances[i] = distance;
+            key = displacedKey;
+            distance = displacedDistance;
+            if (hash->values != NULL) {
+                int64_t displacedValue = hash->values[i];
+                hash->values[i] = value;
+                value = displacedValue;
+            }
+        }
+        i++;
+        if (++distance >= hash->maxDistance) { //The keys in the table are all in place, so grow and try again
+            grow(hash);
+            insertSlot(hash, key, value);
+            return 0;
+        }
+    }
+}
+
+/*
+ * Inserts a key that is not in the hash.
+ */
+static void insertSlot(stInt64Hash *hash, int64_t key, int64_t value) {
+    if (isFull(hash)) {
+        grow(hash);
+    }
+    int64_t i = getHomeSlot(hash, key);
+    int32_t distance = 0;
+    while (hash->distances[i] >= distance) { //Skip the keys at least as far from home
+        i++;
+        if (++distance >= hash->maxDistance) {
+            grow(hash);
+            insertSlot(hash, key, value);
+            return;
+        }
+    }
+    placeSlot(hash, i, key, value, distance);
+}
+
+static int64_t findSlot(stInt64Hash *hash, int64_t key) {
+    if (hash->size == 0) {
+        return -1;
+    }
+    int64_t i = getHomeSlot(hash, key);
+    for (int32_t distance = 0; distance < hash->maxDistance && hash->distances[i] >= distance; distance++, i++) {
+        if (hash->keys[i] == key) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Returns the slot of the key, inserting it with a zero value if it is not present, with one probe of the table
+ * unless the table must grow.
+ */
+static int64_t getOrInsertSlot(stInt64Hash *hash, int64_t key, bool *inserted) {
+    if (hash->capacity > 0) {
+        int64_t i = getHomeSlot(hash, key);
+        int32_t distance = 0;
+        for (; distance < hash->maxDistance && hash->distances[i] >= distance; distance++, i++) {
+            if (hash->keys[i] == key) {
+                *inserted = 0;
+                return i;
+            }
+        }
+        if (distance < hash->maxDistance && !isFull(hash)) { //Not present, and i is where it goes
+            *inserted = 1;
+            return placeSlot(hash, i, key, 0, distance) ? i : findSlot(hash, key);
+        }
+    }
+    *inserted = 1;
+    insertSlot(hash, key, 0);
+    return findSlot(hash, key);
+}
+
+static void removeSlot(stInt64Hash *hash, int64_t i) {
+    while (i + 1 < hash->slotNumber && hash->distances[i + 1] > 0) {
+        hash->keys[i] = hash->keys[i + 1];
+        if (hash->values != NULL) {
+            hash->values[i] = hash->values[i + 1];
+        }
+        hash->distances[i] = hash->distances[i + 1] - 1;
+        i++;
+    }
+    hash->distances[i] = -1;
+    hash->size--;
+}
+
+static void reserve(stInt64Hash *hash, int64_t size) {
+    int64_t capacity = hash->capacity == 0 ? MIN_CAPACITY : hash->capacity;
+    while (size >= capacity - capacity / 8) {
+        capacity *= 2;
+    }
+    if (capacity > hash->capacity) {
+        resize(hash, capacity);
+    }
+}
+
+static int64_t getCapacity(stInt64Hash *hash) {
+    return hash->capacity - hash->capacity / 8;
+}
+
+static stInt64HashIterator *getIterator(stInt64Hash *hash) {
+    stInt64HashIterator *iterator = st_malloc(sizeof(stInt64HashIterator));
+    iterator->hash = hash;
+    iterator->index = hash->slotNumber;
+    return iterator;
+}
+
+static void freeSlots(stInt64Hash *hash) {
+    free(hash->keys);
+    free(hash->values);
+    free(hash->distances);
+}
+
+stInt64Hash *stInt64Hash_construct(void) {
+    return stInt64Hash_construct2(NULL);
+}
+
+stInt64Hash *stInt64Hash_construct2(void (*destructValues)(void *)) {
+    stInt64Hash *hash = st_calloc(1, sizeof(stInt64Hash));
+    hash->destructValues = destructValues;
+    return hash;
+}
+
+void stInt64Hash_destruct(stInt64Hash *hash) {
+    if (hash->destructValues != NULL) {
+        for (int64_t i = 0; i < hash->slotNumber; i++) {
+            if (hash->distances[i] >= 0) {
+                hash->destructValues((void *) (intptr_t) hash->values[i]);
+            }
+        }
+    }
+    freeSlots(hash);
+    free(hash);
+}
+
+void stInt64Hash_insert(stInt64Hash *hash, int64_t key, void *value) {
+    stInt64Hash_insertInt64(hash, key, (intptr_t) value);
+}
+
+void *stInt64Hash_search(stInt64Hash *hash, int64_t key) {
+    int64_t i = findSlot(hash, key);
+    return i != -1 ? (void *) (intptr_t) hash->values[i] : NULL;
+}
+
+void *stInt64Hash_remove(stInt64Hash *hash, int64_t key) {
+    int64_t i = findSlot(hash, key);
+    if (i == -1) {
+        return NULL;
+    }
+    void *value = (void *) (intptr_t) hash->values[i];
+    removeSlot(hash, i);
+    return value;
+}
+
+void stInt64Hash_insertInt64(stInt64Hash *hash, int64_t key, int64_t value) {
+    *stInt64Hash_getOrInsert(hash, key, NULL) = value;
+}
+
+bool stInt64Hash_searchInt64(stInt64Hash *hash, int64_t key, int64_t *value) {
+    int64_t i = findSlot(hash, key);
+    if (i == -1) {
+        return 0;
+    }
+    if (value != NULL) {
+        *value = hash->values[i];
+    }
+    return 1;
+}
+
+int64_t *stInt64Hash_getOrInsert(stInt64Hash *hash, int64_t key, bool *inserted) {
+    bool i;
+    int64_t j = getOrInsertSlot(hash, key, &i);
+    if (inserted != NULL) {
+        *inserted = i;
+    }
+    return &hash->values[j];
+}
+
+bool stInt64Hash_contains(stInt64Hash *hash, int64_t key) {
+    return findSlot(hash, key) != -1;
+}
+
+int64_t stInt64Hash_size(stInt64Hash *hash) {
+    return hash->size;
+}
+
+void stInt64Hash_reserve(stInt64Hash *hash, int64_t size) {
+    reserve(hash, size);
+}
+
+int64_t stInt64Hash_getCapacity(stInt64Hash *hash) {
+    return getCapacity(hash);
+}
+
+stInt64HashIterator *stInt64Hash_getIterator(stInt64Hash *hash) {
+    return getIterator(hash);
+}
+
+bool stInt64Hash_getNext(stInt64HashIterator *iterator, int64_t *key) {
+    /*
+     * Goes backwards, so removing the key just returned, which only shifts later slots back, does not skip any keys.
+     */
+    stInt64Hash *hash = iterator->hash;
+    while (--iterator->index >= 0) {
+        if (hash->distances[iterator->index] >= 0) {
+            *key = hash->keys[iterator->index];
+            return 1;
+        }
+    }
+    iterator->index = 0;
+    return 0;
+}
+
+void stInt64Hash_destructIterator(stInt64HashIterator *iterator) {
+    free(iterator);
+}
+
+stInt64Set *stInt64Set_construct(void) {
+    stInt64Set *set = st_calloc(1, sizeof(stInt64Set));
+    set->hash.isSet = 1;
+    return set;
+}
+
+void stInt64Set_destruct(stInt64Set *set) {
+    freeSlots(&set->hash);
+    free(set);
+}
+
+void stInt64Set_insert(stInt64Set *set, int64_t key) {
+    bool inserted;
+    getOrInsertSlot(&set->hash, key, &inserted);
+}
+
+bool stInt64Set_contains(stInt64Set *set, int64_t key) {
+    return findSlot(&set->hash, key) != -1;
+}
+
+bool stInt64Set_remove(stInt64Set *set, int64_t key) {
+    int64_t i = findSlot(&set->hash, key);
+    if (i == -1) {
+        return 0;
+    }
+    removeSlot(&set->hash, i);
+    return 1;
+}
+
+int64_t stInt64Set_size(stInt64Set *set) {
+    return set->hash.size;
+}
+
+void stInt64Set_reserve(stInt64Set *set, int64_t size) {
+    reserve(&set->hash, size);
+}
+
+int64_t stInt64Set_getCapacity(stInt64Set *set) {
+    return getCapacity(&set->hash);
+}
+
+stInt64HashIterator *stInt64Set_getIterator(stInt64Set *set) {
+    return getIterator(&set->hash);
+}
@@ -0,0 +1,317 @@
+/*
+ * Copyright (C) 2006-2012 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+/*
+ * sonLibIntervalTree.c
+ *
+ * An AVL tree of intervals ordered by key, start, end and then value. Each node records the greatest (key, end)
+ * pair in its subtree, compared key first, so a subtree that holds no interval on the queried key ending after
+ * the queried start is skipped even when it holds long intervals on other keys.
+ */
+#include "sonLibGlobalsInternal.h"
+
+const char *ST_INTERVAL_TREE_EXCEPTION_ID = "ST_INTERVAL_TREE_EXCEPTION";
+
+typedef struct _intervalNode {
+    int64_t key, start, end;
+    void *value;
+    int64_t maxKey, maxEnd; //the greatest (key, end) pair in the subtree.
+    struct _intervalNode *left, *right;
+    int32_t height;
+} IntervalNode;
+
+struct _stIntervalTree {
+    IntervalNode *root;
+    int64_t size;
+    void (*destructValueFn)(void *);
+    stPool *nodePool;
+};
+
+/*
+ * Compares the pairs (key1, x1) and (key2, x2), key first.
+ */
+static int comparePairs(int64_t key1, int64_t x1, int64_t key2, int64_t x2) {
+    if (key1 != key2) {
+        return key1 < key2 ? -1 : 1;
+    }
+    return x1 < x2 ? -1 : x1 > x2 ? 1 : 0;
+}
+
+static int compareIntervals(IntervalNode *node, int64_t key, int64_t start, int64_t end, void *value) {
+    int i = comparePairs(node->key, node->start, key, start);
+    if (i == 0) {
+        i = comparePairs(node->end, (intptr_t) node->value, end, (intptr_t) value);
+    }
+    return i;
+}
+
+static int32_t getHeight(IntervalNode *node) {
+    return node != NULL ? node->height : 0;
+}
+
+/*
+ * Recomputes the height and greatest (key, end) pair of the node from its children.
+ */
+static void update(IntervalNode *node) {
+    int32_t leftHeight = getHeight(node->left), rightHeight = getHeight(node->right);
+    node->height = (leftHeight > rightHeight ? leftHeight : rightHeight) + 1;
+    node->maxKey = node->key;
+    node->maxEnd = node->end;
+    IntervalNode *children[2] = { node->left, node->right };
+    for (int32_t i = 0; i < 2; i++) {
+        if (children[i] != NULL && comparePairs(children[i]->maxKey, children[i]->maxEnd, node->maxKey, node->maxEnd) > 0) {
+            node->maxKey = children[i]->maxKey;
+            node->maxEnd = children[i]->maxEnd;
+        }
+    }
+}
+
+static IntervalNode *rotateRight(IntervalNode *node) {
+    IntervalNode *left = node->left;
+    node->left = left->right;
+    left->right = node;
+    update(node);
+    update(left);
+    return left;
+}
+
+static IntervalNode *rotateLeft(IntervalNode *node) {
+    IntervalNode *right = node->right;
+    node->right = right->left;
+    right->left = node;
+    update(node);
+    update(right);
+    return right;
+}
+
+/*
+ * Restores the balance of a node whose subtrees differ in height by at most two, returning the new root of the
+ * subtree.
+ */
+static IntervalNode *rebalance(IntervalNode *node) {
+    int32_t balance = getHeight(node->left) - getHeight(node->right);
+    if (balance > 1) {
+        if (getHeight(node->left->left) < getHeight(node->left->right)) {
+            node->left = rotateLeft(node->left);
+        }
+        return rotateRight(node);
+    }
+    if (balance < -1) {
+        if (getHeight(node->right->right) < getHeight(node->right->left)) {
+            node->right = rotateRight(node->right);
+        }
+        return rotateLeft(node);
+    }
+    update(node);
+    return node;
+}
+
+static IntervalNode *insertUnder(IntervalNode *node, IntervalNode *newNode) {
+    if (node == NULL) {
+        return newNode;
+    }
+    if (compareIntervals(node, newNode->key, newNode->start, newNode->end, newNode->value) > 0) {
+        node->left = insertUnder(node->left, newNode);
+    } else {
+        node->right = insertUnder(node->right, newNode);
+    }
+    return rebalance(node);
+}
+
+/*
+ * Unlinks the least node of the subtree, returning it in *least and the new root of the subtree.
+ */
+static IntervalNode *removeLeast(IntervalNode *node, IntervalNode **least) {
+    if (node->left == NULL) {
+        *least = node;
+        return node->right;
+    }
+    node->left = removeLeast(node->left, least);
+    return rebalance(node);
+}
+
+static IntervalNode *removeUnder(stIntervalTree *intervalTree, IntervalNode *node, int64_t key, int64_t start,
+        int64_t end, void *value, bool *removed) {
+    if (node == NULL) {
+        return NULL;
+    }
+    int i = compareIntervals(node, key, start, end, value);
+    if (i > 0) {
+        node->left = removeUnder(intervalTree, node->left, key, start, end, value, removed);
+    } else if (i < 0) {
+        node->right = removeUnder(intervalTree, node->right, key, start, end, value, removed);
+    } else {
+        *removed = 1;
+        IntervalNode *replacement = NULL;
+        if (node->right == NULL) {
+            replacement = node->left;
+        } else {
+            node->right = removeLeast(node->right, &replacement);
+            replacement->left = node->left;
+            replacement->right = node->right;
+        }
+        stPool_free(intervalTree->nodePool, node);
+        return replacement != NULL ? rebalance(replacement) : NULL;
+    }
+    return rebalance(node);
+}
+
+stIntervalTree *stIntervalTree_construct(void (*destructValueFn)(void *)) {
+    stIntervalTree *intervalTree = st_malloc(sizeof(stIntervalTree));
+    intervalTree->root = NULL;
+    intervalTree->size = 0;
+    intervalTree->destructValueFn = destructValueFn;
+    intervalTree->nodePool = stPool_construct(sizeof(IntervalNode));
+    return intervalTree;
+}
+
+static void destructValues(IntervalNode *node, void (*destructValueFn)(void *)) {
+    if (node != NULL) {
+        destructValues(node->left, destructValueFn);
+        destructValues(node->right, destructValueFn);
+        destructValueFn(node->value);
+    }
+}
+
+void stIntervalTree_destruct(stIntervalTree *intervalTree) {
+    if (intervalTree->destructValueFn != NULL) {
+        destructValues(intervalTree->root, intervalTree->destructValueFn);
+    }
+    stPool_destruct(intervalTree->nodePool); //Frees the nodes, without walking the tree
+    free(intervalTree);
+}
+
+void stIntervalTree_insert(stIntervalTree *intervalTree, int64_t key, int64_t start, int64_t end, void *value) {
+    if (end < start) {
+        stThrowNew(ST_INTERVAL_TREE_EXCEPTION_ID, "Tried to insert an interval ending at %" PRIi64
+                " before its start at %" PRIi64, end, start);
+    }
+    IntervalNode *node = stPool_malloc(intervalTree->nodePool);
+    node->key = key;
+    node->start = start;
+    node->end = end;
+    node->value = value;
+    node->left = NULL;
+    node->right = NULL;
+    update(node);
+    intervalTree->root = insertUnder(intervalTree->root, node);
+    intervalTree->size++;
+}
+
+bool stIntervalTree_remove(stIntervalTree *intervalTree, int64_t key, int64_t start, int64_t end, void *value) {
+    bool removed = 0;
+    intervalTree->root = removeUnder(intervalTree, intervalTree->root, key, start, end, value, &removed);
+    if (removed) {
+        intervalTree->size--;
+    }
+    return removed;
+}
+
+int64_t stIntervalTree_size(stIntervalTree *intervalTree) {
+    return intervalTree->size;
+}
+
+/*
+ * Adds, in order, the values of the intervals under the node on the key that end after minEnd and start before
+ * maxStart, or at it if maxStartInclusive is set, skipping empty intervals if nonEmpty is set.
+ */
+static void getIntervals(IntervalNode *node, int64_t key, int64_t minEnd, int64_t maxStart, bool maxStartInclusive,
+        bool nonEmpty, stList *values) {
+    while (node != NULL && comparePairs(node->maxKey, node->maxEnd, key, minEnd) > 0) {
+        getIntervals(node->left, key, minEnd, maxStart, maxStartInclusive, nonEmpty, values);
+        int i = comparePairs(node->key, node->start, key, maxStart);
+        if (i > 0 || (i == 0 && !maxStartInclusive)) { //This node and everything to its right start too late
+            return;
+        }
+        if (node->key == key && node->end > minEnd && (!nonEmpty || node->start < node->end)) {
+            stList_append(values, node->value);
+        }
+        node = node->right;
+    }
+}
+
+stList *stIntervalTree_getOverlapping(stIntervalTree *intervalTree, int64_t key, int64_t start, int64_t end) {
+    stList *values = stList_construct();
+    if (start < end) {
+        getIntervals(intervalTree->root, key, start, end, 0, 1, values);
+    }
+    return values;
+}
+
+stList *stIntervalTree_getContaining(stIntervalTree *intervalTree, int64_t key, int64_t start, int64_t end) {
+    stList *values = stList_construct();
+    if (start <= end) {
+        getIntervals(intervalTree->root, key, end - 1, start, 1, 0, values);
+    }
+    return values;
+}
+
+/*
+ * Returns the interval on the key with the greatest end of those starting at or before the position, or NULL
+ * if there is none.
+ */
+static IntervalNode *getGreatestEndBefore(IntervalNode *node, int64_t key, int64_t position) {
+    /*
+     * Descend to the position, gathering the best node and the best subtree wholly before the position, then
+     * find the node that gives the subtree its greatest end.
+     */
+    IntervalNode *best = NULL, *bestSubtree = NULL;
+    int64_t bestEnd = INT64_MIN;
+    while (node != NULL) {
+        if (comparePairs(node->key, node->start, key, position) <= 0) {
+            if (node->key == key && node->end > bestEnd) {
+                best = node;
+                bestSubtree = NULL;
+                bestEnd = node->end;
+            }
+            if (node->left != NULL && node->left->maxKey == key && node->left->maxEnd > bestEnd) {
+                best = NULL;
+                bestSubtree = node->left;
+                bestEnd = node->left->maxEnd;
+            }
+            node = node->right;
+        } else {
+            node = node->left;
+        }
+    }
+    node = bestSubtree;
+    while (best == NULL && node != NULL) {
+        if (node->key == key && node->end == bestEnd) {
+            best = node;
+        } else if (node->left != NULL && node->left->maxKey == key && node->left->maxEnd == bestEnd) {
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+    return best;
+}
+
+/*
+ * Returns the interval on the key starting first after the position, or NULL if there is none.
+ */
+static IntervalNode *getFirstStartAfter(IntervalNode *node, int64_t key, int64_t position) {
+    IntervalNode *best = NULL;
+    while (node != NULL) {
+        if (comparePairs(node->key, node->start, key, position) > 0) {
+            best = node;
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+    return best != NULL && best->key == key ? best : NULL;
+}
+
+void *stIntervalTree_getNearest(stIntervalTree *intervalTree, int64_t key, int64_t position) {
+    IntervalNode *left = getGreatestEndBefore(intervalTree->root, key, position);
+    IntervalNode *right = getFirstStartAfter(intervalTree->root, key, position);
+    if (left == NULL || right == NULL) {
+        return left != NULL ? left->value : right != NULL ? right->value : NULL;
+    }
+    int64_t leftGap = left->end > position ? 0 : position - left->end + 1;
+    return leftGap <= right->start - position ? left->value : right->value;
+}
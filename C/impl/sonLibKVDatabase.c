@@ -63,8 +63,15 @@ stKVDatabase *stKVDatabase_construct(stKVDatabaseConf *conf, bool create) {
 }
 
 void stKVDatabase_destruct(stKVDatabase *database) {
+    if (database->prefetcher != NULL) {
+        stKVDatabasePrefetcher_destruct(database->prefetcher);
+    }
     if (!database->deleted) {
         stTry {
+                if (database->transactionDepth > 0) {
+                    database->transactionDepth = 0;
+                    database->abortTransaction(database);
+                }
                 database->destruct(database);
             }stCatch(ex)
                 {
@@ -81,6 +88,10 @@ void stKVDatabase_deleteFromDisk(stKVDatabase *database) {
         stThrowNew(ST_KV_DATABASE_EXCEPTION_ID,
                 "Trying to delete a database that has already been deleted");
     }
+    if (database->prefetcher != NULL) {
+        stKVDatabasePrefetcher_destruct(database->prefetcher);
+        database->prefetcher = NULL;
+    }
     stTry {
             database->deleteDatabase(database);
         }stCatch(ex)
@@ -91,6 +102,23 @@ void stKVDatabase_deleteFromDisk(stKVDatabase *database) {
     database->deleted = true;
 }
 
+static void noteWrite(stKVDatabase *database, int64_t key) {
+    if (database->prefetcher != NULL) {
+        stKVDatabasePrefetcher_noteWrite(database->prefetcher, key, database->transactionDepth > 0);
+    }
+}
+
+static void noteTransactionEnd(stKVDatabase *database) {
+    if (database->prefetcher != NULL) {
+        stKVDatabasePrefetcher_endTransaction(database->prefetcher);
+    }
+}
+
+static bool takePrefetchedRecord(stKVDatabase *database, int64_t key, void **value, int64_t *recordSize) {
+    return database->prefetcher != NULL && stKVDatabasePrefetcher_takeRecord(database->prefetcher, key, value,
+            recordSize);
+}
+
 bool stKVDatabase_containsRecord(stKVDatabase *database, int64_t key) {
     if (database->deleted) {
         stThrowNew(ST_KV_DATABASE_EXCEPTION_ID,
@@ -122,6 +150,7 @@ void stKVDatabase_insertRecord(stKVDatabase *database, int64_t key,
         stThrowNew(ST_KV_DATABASE_EXCEPTION_ID,
                         "Trying to insert a null record into a database");
     }
+    noteWrite(database, key);
     stTry {
             database->insertRecord(database, key, value, sizeOfRecord);
         }stCatch(ex)
@@ -143,6 +172,7 @@ void stKVDatabase_insertInt64(stKVDatabase *database, int64_t key, int64_t value
         stThrowNew(ST_KV_DATABASE_EXCEPTION_ID,
                 "Trying to insert a int64 record into a database that has been deleted");
     }
+    noteWrite(database, key);
     stTry {
             database->insertInt64(database, key, value);
         }stCatch(ex)
@@ -164,6 +194,7 @@ void stKVDatabase_updateInt64(stKVDatabase *database, int64_t key, int64_t value
         stThrowNew(ST_KV_DATABASE_EXCEPTION_ID,
                 "Trying to update a int64 record into a database that has been deleted");
     }
+    noteWrite(database, key);
     stTry {
             database->updateInt64(database, key, value);
         }stCatch(ex)
@@ -190,6 +221,7 @@ void stKVDatabase_updateRecord(stKVDatabase *database, int64_t key,
         stThrowNew(ST_KV_DATABASE_EXCEPTION_ID,
                         "Trying to insert a null record into a database");
     }
+    noteWrite(database, key);
     stTry {
             database->updateRecord(database, key, value, sizeOfRecord);
         }stCatch(ex)
@@ -216,6 +248,7 @@ void stKVDatabase_setRecord(stKVDatabase *database, int64_t key,
         stThrowNew(ST_KV_DATABASE_EXCEPTION_ID,
                         "Trying to insert a null record into a database");
     }
+    noteWrite(database, key);
     stTry {
             database->setRecord(database, key, value, sizeOfRecord);
         }stCatch(ex)
@@ -236,6 +269,7 @@ int64_t stKVDatabase_incrementInt64(stKVDatabase *database, int64_t key,
         stThrowNew(ST_KV_DATABASE_EXCEPTION_ID,
                 "Trying to increment a numerical record from a database that has been deleted");
     }
+    noteWrite(database, key);
     stTry {
             return database->incrementInt64(database, key, incrementAmount);
         }stCatch(ex)
@@ -295,6 +329,9 @@ void stKVDatabase_bulkSetRecords(stKVDatabase *database, stList *records) {
         stThrowNew(ST_KV_DATABASE_EXCEPTION_ID,
                 "Trying to bulk set records from a database that has been deleted");
     }
+    for (int32_t i = 0; i < stList_length(records); i++) {
+        noteWrite(database, ((stKVDatabaseBulkRequest *) stList_get(records, i))->key);
+    }
     stTry {
             database->bulkSetRecords(database, records);
         }stCatch(ex)
@@ -322,6 +359,7 @@ void stKVDatabase_bulkRemoveRecords(stKVDatabase *database, stList *records) {
             stThrowNew(ST_KV_DATABASE_EXCEPTION_ID,
                     "The key is not in the database which we aim to remove: %lli", key);
         }
+        noteWrite(database, key);
     }
     stTry {
             database->bulkRemoveRecords(database, records);
@@ -365,6 +403,10 @@ void *stKVDatabase_getRecord(stKVDatabase *database, int64_t key) {
                 "Trying to get a record from a database that has already been deleted");
     }
     void *data = NULL;
+    int64_t recordSize;
+    if (takePrefetchedRecord(database, key, &data, &recordSize)) {
+        return data;
+    }
     stTry {
             data = database->getRecord(database, key);
         }stCatch(ex)
@@ -386,6 +428,16 @@ int64_t stKVDatabase_getInt64(stKVDatabase *database, int64_t key) {
                 "Trying to get a record from a database that has already been deleted");
     }
     int64_t value = -1;
+    void *data = NULL;
+    int64_t recordSize;
+    if (takePrefetchedRecord(database, key, &data, &recordSize)) {
+        if (data != NULL && recordSize == sizeof(int64_t)) {
+            value = *(int64_t *) data;
+            free(data);
+            return value;
+        }
+        free(data); //let the database report the error
+    }
     stTry {
             value = database->getInt64(database, key);
         }stCatch(ex)
@@ -408,6 +460,9 @@ void *stKVDatabase_getRecord2(stKVDatabase *database, int64_t key,
                 "Trying to get a record from a database that has already been deleted");
     }
     void *data = NULL;
+    if (takePrefetchedRecord(database, key, &data, recordSize)) {
+        return data;
+    }
     stTry {
             data = database->getRecord2(database, key, recordSize);
         }stCatch(ex)
@@ -478,6 +533,167 @@ void stKVDatabaseBulkResult_destruct(stKVDatabaseBulkResult* bulkResult)
 	free(bulkResult);
 }
 
+static void checkTransactionsSupported(stKVDatabase *database) {
+    if (database->deleted) {
+        stThrowNew(ST_KV_DATABASE_EXCEPTION_ID,
+                "Trying to use a transaction on a database that has been deleted");
+    }
+    if (database->startTransaction == NULL) {
+        stThrowNew(ST_KV_DATABASE_EXCEPTION_ID,
+                "Transactions are not supported by this type of database");
+    }
+}
+
+void stKVDatabase_startTransaction(stKVDatabase *database) {
+    checkTransactionsSupported(database);
+    if (database->transactionDepth == 0) {
+        stTry {
+                database->startTransaction(database);
+            }stCatch(ex)
+                {
+                    if (isRetryExcept(ex)) {
+                        stThrow(ex);
+                    } else {
+                        stThrowNewCause(ex, ST_KV_DATABASE_EXCEPTION_ID,
+                                "stKVDatabase_startTransaction failed");
+                    }
+                }stTryEnd;
+    }
+    database->transactionDepth++;
+}
+
+void stKVDatabase_commitTransaction(stKVDatabase *database) {
+    checkTransactionsSupported(database);
+    if (database->transactionDepth == 0) {
+        stThrowNew(ST_KV_DATABASE_EXCEPTION_ID,
+                "Trying to commit a transaction when none has been started");
+    }
+    if (--database->transactionDepth == 0) {
+        stTry {
+                database->commitTransaction(database);
+            }stCatch(ex)
+                {
+                    if (isRetryExcept(ex)) {
+                        stThrow(ex);
+                    } else {
+                        stThrowNewCause(ex, ST_KV_DATABASE_EXCEPTION_ID,
+                                "stKVDatabase_commitTransaction failed");
+                    }
+                }stTryEnd;
+        noteTransactionEnd(database);
+    }
+}
+
+void stKVDatabase_abortTransaction(stKVDatabase *database) {
+    checkTransactionsSupported(database);
+    if (database->transactionDepth == 0) {
+        stThrowNew(ST_KV_DATABASE_EXCEPTION_ID,
+                "Trying to abort a transaction when none has been started");
+    }
+    database->transactionDepth = 0;
+    stTry {
+            database->abortTransaction(database);
+        }stCatch(ex)
+            {
+                stThrowNewCause(ex, ST_KV_DATABASE_EXCEPTION_ID,
+                        "stKVDatabase_abortTransaction failed");
+            }stTryEnd;
+    noteTransactionEnd(database);
+}
+
+/*
+ * Bulk gets are handed to the database with their keys sorted and without duplicates, so that
+ * disk based databases can read them in a single forward pass, then the results are put back
+ * into the order the caller asked for.
+ */
+typedef struct _bulkKey {
+    int64_t key;
+    int32_t index;
+} BulkKey;
+
+static int bulkKey_cmp(const void *a, const void *b) {
+    const BulkKey *bA = a;
+    const BulkKey *bB = b;
+    if (bA->key != bB->key) {
+        return bA->key < bB->key ? -1 : 1;
+    }
+    return bA->index < bB->index ? -1 : (bA->index > bB->index ? 1 : 0);
+}
+
+/*
+ * Returns NULL if the keys are already strictly increasing. Otherwise returns the sorted, distinct
+ * keys and sets uniqueIndices to an array giving, for each key in the original list, the index of
+ * its key in the returned list.
+ */
+static stList *sortAndDeduplicateKeys(stList *keys, int32_t **uniqueIndices) {
+    int32_t n = stList_length(keys);
+    int32_t i;
+    for (i = 1; i < n; i++) {
+        if (*(int64_t *) stList_get(keys, i - 1) >= *(int64_t *) stList_get(keys, i)) {
+            break;
+        }
+    }
+    if (i >= n) {
+        *uniqueIndices = NULL;
+        return NULL;
+    }
+    BulkKey *bulkKeys = st_malloc(sizeof(BulkKey) * n);
+    for (i = 0; i < n; i++) {
+        bulkKeys[i].key = *(int64_t *) stList_get(keys, i);
+        bulkKeys[i].index = i;
+    }
+    qsort(bulkKeys, n, sizeof(BulkKey), bulkKey_cmp);
+    stList *uniqueKeys = stList_construct3(0, NULL);
+    *uniqueIndices = st_malloc(sizeof(int32_t) * n);
+    for (i = 0; i < n; i++) {
+        if (i == 0 || bulkKeys[i].key != bulkKeys[i - 1].key) {
+            stList_append(uniqueKeys, stList_get(keys, bulkKeys[i].index));
+        }
+        (*uniqueIndices)[bulkKeys[i].index] = stList_length(uniqueKeys) - 1;
+    }
+    free(bulkKeys);
+    return uniqueKeys;
+}
+
+static stList *scatterBulkResults(stList *uniqueResults, int32_t *uniqueIndices, int32_t n) {
+    stList *results = stList_construct3(n, (void(*)(void *)) stKVDatabaseBulkResult_destruct);
+    bool *used = st_calloc(stList_length(uniqueResults), sizeof(bool));
+    for (int32_t i = 0; i < n; i++) {
+        int32_t j = uniqueIndices[i];
+        stKVDatabaseBulkResult *result = stList_get(uniqueResults, j);
+        if (used[j] && result != NULL) { // a repeated key, so it needs its own copy
+            void *value = result->value == NULL ? NULL : memcpy(st_malloc(result->size), result->value,
+                    result->size);
+            result = stKVDatabaseBulkResult_construct(value, result->size);
+        }
+        used[j] = true;
+        stList_set(results, i, result);
+    }
+    free(used);
+    stList_setDestructor(uniqueResults, NULL);
+    stList_destruct(uniqueResults);
+    return results;
+}
+
+/*
+ * Repeated keys just share the same stretch of the data buffer.
+ */
+static stKVDatabaseBulkResultBuffer *scatterBulkResultBuffer(stKVDatabaseBulkResultBuffer *uniqueResults,
+        int32_t *uniqueIndices, int32_t n) {
+    stKVDatabaseBulkResultBuffer *results = stKVDatabaseBulkResultBuffer_construct(n);
+    for (int32_t i = 0; i < n; i++) {
+        results->offsets[i] = uniqueResults->offsets[uniqueIndices[i]];
+        results->sizes[i] = uniqueResults->sizes[uniqueIndices[i]];
+    }
+    free(results->data);
+    results->data = uniqueResults->data;
+    results->dataSize = uniqueResults->dataSize;
+    results->maxDataSize = uniqueResults->maxDataSize;
+    free(uniqueResults->offsets);
+    free(uniqueResults);
+    return results;
+}
+
 stList *stKVDatabase_bulkGetRecords(stKVDatabase *database, stList* keys) {
     if (database->deleted) {
         stThrowNew(ST_KV_DATABASE_EXCEPTION_ID,
@@ -487,11 +703,15 @@ stList *stKVDatabase_bulkGetRecords(stKVDatabase *database, stList* keys) {
     if(stList_length(keys) == 0) {
         return stList_construct();
     }
+    int32_t *uniqueIndices = NULL;
+    stList *uniqueKeys = sortAndDeduplicateKeys(keys, &uniqueIndices);
     stList *resultsList = NULL;
     stTry {
-    	resultsList = database->bulkGetRecords(database, keys);
+    	resultsList = database->bulkGetRecords(database, uniqueKeys != NULL ? uniqueKeys : keys);
         }stCatch(ex)
             {
+                free(uniqueIndices);
+                stList_destruct(uniqueKeys);
                 if (isRetryExcept(ex)) {
                     stThrow(ex);
                 } else {
@@ -500,6 +720,11 @@ stList *stKVDatabase_bulkGetRecords(stKVDatabase *database, stList* keys) {
                             stList_length(keys));
                 }
             }stTryEnd;
+    if (uniqueKeys != NULL) {
+        resultsList = scatterBulkResults(resultsList, uniqueIndices, stList_length(keys));
+        free(uniqueIndices);
+        stList_destruct(uniqueKeys);
+    }
     return resultsList;
 }
 
@@ -525,6 +750,167 @@ stList *stKVDatabase_bulkGetRecordsRange(stKVDatabase *database, int64_t firstKe
     return resultsList;
 }
 
+stKVDatabaseBulkResultBuffer *stKVDatabaseBulkResultBuffer_construct(int64_t length) {
+    assert(length >= 0);
+    stKVDatabaseBulkResultBuffer *results = st_malloc(sizeof(stKVDatabaseBulkResultBuffer));
+    results->length = length;
+    results->offsets = st_malloc(2 * (length > 0 ? length : 1) * sizeof(int64_t));
+    results->sizes = results->offsets + length;
+    for (int64_t i = 0; i < length; i++) {
+        results->offsets[i] = -1;
+        results->sizes[i] = 0;
+    }
+    results->data = NULL;
+    results->dataSize = 0;
+    results->maxDataSize = 0;
+    return results;
+}
+
+void stKVDatabaseBulkResultBuffer_setRecord(stKVDatabaseBulkResultBuffer *results, int64_t index,
+        const void *value, int64_t sizeOfRecord) {
+    assert(index >= 0 && index < results->length);
+    assert(results->offsets[index] == -1);
+    if (value == NULL) {
+        return;
+    }
+    assert(sizeOfRecord >= 0);
+    //Grow geometrically, so n records cost O(log n) reallocs. The first record present always allocates, so that
+    //data is not NULL and a present record of no bytes is not taken for an absent one.
+    if (results->data == NULL || results->dataSize + sizeOfRecord > results->maxDataSize) {
+        int64_t maxDataSize = results->maxDataSize * 2 + 1024;
+        if (maxDataSize < results->dataSize + sizeOfRecord) {
+            maxDataSize = results->dataSize + sizeOfRecord;
+        }
+        char *data = realloc(results->data, maxDataSize);
+        if (data == NULL) {
+            st_errAbort("Failed to allocate %lld bytes for a bulk result buffer", (long long) maxDataSize);
+        }
+        results->data = data;
+        results->maxDataSize = maxDataSize;
+    }
+    memcpy(results->data + results->dataSize, value, sizeOfRecord);
+    results->offsets[index] = results->dataSize;
+    results->sizes[index] = sizeOfRecord;
+    results->dataSize += sizeOfRecord;
+}
+
+int64_t stKVDatabaseBulkResultBuffer_length(stKVDatabaseBulkResultBuffer *results) {
+    return results->length;
+}
+
+const void *stKVDatabaseBulkResultBuffer_getRecord(stKVDatabaseBulkResultBuffer *results, int64_t index,
+        int64_t *sizeOfRecord) {
+    assert(index >= 0 && index < results->length);
+    *sizeOfRecord = results->sizes[index];
+    if (results->offsets[index] == -1) {
+        return NULL;
+    }
+    return results->data + results->offsets[index];
+}
+
+void stKVDatabaseBulkResultBuffer_destruct(stKVDatabaseBulkResultBuffer *results) {
+    free(results->offsets);
+    free(results->data);
+    free(results);
+}
+
+/*
+ * Packs a list of bulk results into a buffer, for databases that do not fill buffers directly.
+ */
+static stKVDatabaseBulkResultBuffer *convertToBulkResultBuffer(stList *resultsList) {
+    stKVDatabaseBulkResultBuffer *results = stKVDatabaseBulkResultBuffer_construct(stList_length(resultsList));
+    for (int32_t i = 0; i < stList_length(resultsList); i++) {
+        stKVDatabaseBulkResult *result = stList_get(resultsList, i);
+        if (result != NULL) {
+            stKVDatabaseBulkResultBuffer_setRecord(results, i, result->value, result->size);
+        }
+    }
+    stList_destruct(resultsList);
+    return results;
+}
+
+stKVDatabaseBulkResultBuffer *stKVDatabase_bulkGetRecordsBuffer(stKVDatabase *database, stList* keys) {
+    if (database->deleted) {
+        stThrowNew(ST_KV_DATABASE_EXCEPTION_ID,
+                "Trying to get records from a database that has already been deleted");
+    }
+    assert(keys != NULL);
+    if(stList_length(keys) == 0) {
+        return stKVDatabaseBulkResultBuffer_construct(0);
+    }
+    int32_t *uniqueIndices = NULL;
+    stList *uniqueKeys = sortAndDeduplicateKeys(keys, &uniqueIndices);
+    stList *backendKeys = uniqueKeys != NULL ? uniqueKeys : keys;
+    stKVDatabaseBulkResultBuffer *results = NULL;
+    stTry {
+            if (database->bulkGetRecordsBuffer != NULL) {
+                results = database->bulkGetRecordsBuffer(database, backendKeys);
+            } else {
+                results = convertToBulkResultBuffer(database->bulkGetRecords(database, backendKeys));
+            }
+        }stCatch(ex)
+            {
+                free(uniqueIndices);
+                stList_destruct(uniqueKeys);
+                if (isRetryExcept(ex)) {
+                    stThrow(ex);
+                } else {
+                    stThrowNewCause(ex, ST_KV_DATABASE_EXCEPTION_ID,
+                            "stKVDatabase_bulkGetRecordsBuffer with %d records failed",
+                            stList_length(keys));
+                }
+            }stTryEnd;
+    if (uniqueKeys != NULL) {
+        results = scatterBulkResultBuffer(results, uniqueIndices, stList_length(keys));
+        free(uniqueIndices);
+        stList_destruct(uniqueKeys);
+    }
+    return results;
+}
+
+stKVDatabaseBulkResultBuffer *stKVDatabase_bulkGetRecordsRangeBuffer(stKVDatabase *database, int64_t firstKey, int64_t numRecords) {
+    if (database->deleted) {
+        stThrowNew(ST_KV_DATABASE_EXCEPTION_ID,
+                "Trying to get records from a database that has already been deleted");
+    }
+    assert(numRecords > 0);
+    stKVDatabaseBulkResultBuffer *results = NULL;
+    stTry {
+            if (database->bulkGetRecordsRangeBuffer != NULL) {
+                results = database->bulkGetRecordsRangeBuffer(database, firstKey, numRecords);
+            } else {
+                results = convertToBulkResultBuffer(database->bulkGetRecordsRange(database, firstKey, numRecords));
+            }
+        }stCatch(ex)
+            {
+                if (isRetryExcept(ex)) {
+                    stThrow(ex);
+                } else {
+                    stThrowNewCause(ex, ST_KV_DATABASE_EXCEPTION_ID,
+                            "stKVDatabase_bulkGetRecordsRangeBuffer with %lld records failed",
+                            (long long int)numRecords);
+                }
+            }stTryEnd;
+    return results;
+}
+
+void stKVDatabase_prefetch(stKVDatabase *database, stList *keys) {
+    if (database->deleted) {
+        stThrowNew(ST_KV_DATABASE_EXCEPTION_ID,
+                "Trying to prefetch records from a database that has already been deleted");
+    }
+    if (database->prefetcher == NULL) {
+        stTry {
+                database->prefetcher = stKVDatabasePrefetcher_construct(database);
+            }stCatch(ex)
+                {
+                    stThrowNewCause(ex, ST_KV_DATABASE_EXCEPTION_ID,
+                            "stKVDatabase_prefetch could not open a connection for prefetching");
+                }stTryEnd;
+    }
+    stKVDatabasePrefetcher_prefetch(database->prefetcher, database, keys);
+}
+
 void stKVDatabase_removeRecord(stKVDatabase *database, int64_t key) {
     if (database->deleted) {
         stThrowNew(ST_KV_DATABASE_EXCEPTION_ID,
@@ -534,6 +920,7 @@ void stKVDatabase_removeRecord(stKVDatabase *database, int64_t key) {
         stThrowNew(ST_KV_DATABASE_EXCEPTION_ID,
                 "The key is not in the database: %lli", key);
     }
+    noteWrite(database, key);
     stTry {
             database->removeRecord(database, key);
         }stCatch(ex)
@@ -29,6 +29,7 @@ struct stKVDatabaseConf {
     int64_t maxKTRecordSize;
     int64_t maxKTBulkSetSize;
     int64_t maxKTBulkSetNumRecords;
+    int64_t maxKTBulkSetConnections;
     char *user;
     char *password;
     char *databaseName;
@@ -55,6 +56,7 @@ stKVDatabaseConf *stKVDatabaseConf_constructKyotoTycoon(const char *host, unsign
     conf->maxKTRecordSize = maxRecordSize;
     conf->maxKTBulkSetSize = maxBulkSetSize;
     conf->maxKTBulkSetNumRecords = maxBulkSetNumRecords;
+    conf->maxKTBulkSetConnections = 4;
     conf->databaseName = stString_copy(databaseName);
     return conf;
 }
@@ -206,6 +208,18 @@ static int64_t getXMLMaxKTBulkSetNumRecords(stHash *hash) {
     }
 }
 
+/* Default to 4 connections, enough to keep a few of the server's worker
+ * threads busy
+ */
+static int64_t getXMLMaxKTBulkSetConnections(stHash *hash) {
+    const char *value = stHash_search(hash, "max_bulkset_connections");
+    if (value == NULL) {
+        return (int64_t) 4;
+    } else {
+        return stSafeStrToInt64(value);
+    }
+}
+
 static stKVDatabaseConf *constructFromString(const char *xmlString) {
     stHash *hash = hackParseXmlString(xmlString);
     stKVDatabaseConf *databaseConf = NULL;
@@ -225,6 +239,7 @@ static stKVDatabaseConf *constructFromString(const char *xmlString) {
                                                         getXMLMaxKTBulkSetNumRecords(hash),
                                                         getXmlValueRequired(hash, "database_dir"),
                                                         stHash_search(hash, "database_name"));
+        databaseConf->maxKTBulkSetConnections = getXMLMaxKTBulkSetConnections(hash);
     } else if (stString_eq(type, "mysql")) {
         databaseConf = stKVDatabaseConf_constructMySql(getXmlValueRequired(hash, "host"), getXmlPort(hash),
                                                        getXmlValueRequired(hash, "user"), getXmlValueRequired(hash, "password"),
@@ -257,6 +272,7 @@ stKVDatabaseConf *stKVDatabaseConf_constructClone(stKVDatabaseConf *srcConf) {
     conf->maxKTRecordSize = srcConf->maxKTRecordSize;
     conf->maxKTBulkSetSize = srcConf->maxKTBulkSetSize;
     conf->maxKTBulkSetNumRecords = srcConf->maxKTBulkSetNumRecords;
+    conf->maxKTBulkSetConnections = srcConf->maxKTBulkSetConnections;
     conf->user = stString_copy(srcConf->user);
     conf->password = stString_copy(srcConf->password);
     conf->databaseName = stString_copy(srcConf->databaseName);
@@ -308,6 +324,10 @@ int64_t stKVDatabaseConf_getMaxKTBulkSetNumRecords(stKVDatabaseConf *conf) {
     return conf->maxKTBulkSetNumRecords;
 }
 
+int64_t stKVDatabaseConf_getMaxKTBulkSetConnections(stKVDatabaseConf *conf) {
+    return conf->maxKTBulkSetConnections;
+}
+
 const char *stKVDatabaseConf_getUser(stKVDatabaseConf *conf) {
     return conf->user;
 }
@@ -0,0 +1,282 @@
+/*
+ * Copyright (C) 2006-2012 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+/*
+ * sonLibKVDatabasePrefetch.c
+ *
+ * Fetches records ahead of time into a local cache, from which the get functions
+ * of stKVDatabase take them.
+ *
+ * For databases on the network (MySQL, and Kyoto Tycoon without a big record store)
+ * the records are fetched by a background thread using its own connection, so that
+ * the round trips overlap with whatever the caller does next. Other databases can't
+ * be opened a second time, so the records are fetched straight away, as one sorted
+ * bulk get.
+ *
+ * The background connection can't see writes made through the caller's connection
+ * that are not yet committed, so keys written inside a transaction are not prefetched
+ * again until it is committed or aborted. Writes outside a transaction are visible
+ * to it as soon as they complete.
+ *
+ * The cache is bounded: records are kept in two generations, and when the newer one
+ * holds half of MAX_PREFETCHED_BYTES the older one, records prefetched but never got,
+ * is dropped.
+ */
+
+#include <pthread.h>
+#include "sonLibGlobalsInternal.h"
+#include "sonLibKVDatabasePrivate.h"
+
+#define MAX_PREFETCHED_BYTES 67108864
+#define RECORD_OVERHEAD 64 //a rough allowance for the hash entry and key of each record.
+
+typedef struct _prefetchedRecord {
+    void *value;
+    int64_t size;
+} PrefetchedRecord;
+
+struct _stKVDatabasePrefetcher {
+    stKVDatabase *database; //the connection of the background thread, NULL if fetching is synchronous.
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    stList *queue; //batches of keys waiting to be fetched, each a list of int64_t pointers.
+    stSet *pending; //keys queued or being fetched.
+    stHash *records; //fetched keys to PrefetchedRecord, the newer generation.
+    stHash *oldRecords; //the older generation, dropped when the newer one fills.
+    int64_t recordsBytes; //the size of the newer generation.
+    stSet *writtenKeys; //keys written in the current transaction.
+    bool stop;
+};
+
+static void prefetchedRecord_destruct(PrefetchedRecord *record) {
+    free(record->value);
+    free(record);
+}
+
+static stHash *constructRecords(void) {
+    return stHash_construct3((uint32_t (*)(const void *)) stInt64Tuple_hashKey,
+            (int (*)(const void *, const void *)) stInt64Tuple_equalsFn, (void (*)(void *)) stInt64Tuple_destruct,
+            (void (*)(void *)) prefetchedRecord_destruct);
+}
+
+static stSet *constructKeys(void) {
+    return stSet_construct3((uint32_t (*)(const void *)) stInt64Tuple_hashKey,
+            (int (*)(const void *, const void *)) stInt64Tuple_equalsFn, (void (*)(void *)) stInt64Tuple_destruct);
+}
+
+/*
+ * Removes the record from either generation, returning it, or NULL if it is not there.
+ */
+static PrefetchedRecord *removeRecord(stKVDatabasePrefetcher *prefetcher, stInt64Tuple *key) {
+    PrefetchedRecord *record = stHash_removeAndFreeKey(prefetcher->records, key);
+    return record != NULL ? record : stHash_removeAndFreeKey(prefetcher->oldRecords, key);
+}
+
+static bool containsRecord(stKVDatabasePrefetcher *prefetcher, stInt64Tuple *key) {
+    return stHash_search(prefetcher->records, key) != NULL || stHash_search(prefetcher->oldRecords, key) != NULL;
+}
+
+static void addRecords(stKVDatabasePrefetcher *prefetcher, stList *keys, stList *results) {
+    for (int32_t i = 0; i < stList_length(keys); i++) {
+        stInt64Tuple *key = stInt64Tuple_construct(1, *(int64_t *) stList_get(keys, i));
+        stKVDatabaseBulkResult *result = stList_get(results, i);
+        PrefetchedRecord *record = st_malloc(sizeof(PrefetchedRecord));
+        record->value = NULL;
+        record->size = 0;
+        if (result != NULL) { //take the value rather than copying it
+            record->value = stKVDatabaseBulkResult_getRecord(result, &record->size);
+            result->value = NULL;
+        }
+        PrefetchedRecord *oldRecord = removeRecord(prefetcher, key);
+        if (oldRecord != NULL) {
+            prefetchedRecord_destruct(oldRecord);
+        }
+        if (prefetcher->recordsBytes >= MAX_PREFETCHED_BYTES / 2) { //Start a new generation
+            stHash_destruct(prefetcher->oldRecords);
+            prefetcher->oldRecords = prefetcher->records;
+            prefetcher->records = constructRecords();
+            prefetcher->recordsBytes = 0;
+        }
+        stHash_insert(prefetcher->records, key, record);
+        prefetcher->recordsBytes += record->size + RECORD_OVERHEAD;
+    }
+}
+
+static void *fetchInBackground(void *arg) {
+    stKVDatabasePrefetcher *prefetcher = arg;
+    pthread_mutex_lock(&prefetcher->mutex);
+    while (1) {
+        while (stList_length(prefetcher->queue) == 0 && !prefetcher->stop) {
+            pthread_cond_wait(&prefetcher->cond, &prefetcher->mutex);
+        }
+        if (prefetcher->stop) {
+            break;
+        }
+        stList *keys = stList_remove(prefetcher->queue, 0);
+        pthread_mutex_unlock(&prefetcher->mutex);
+        stList *results = NULL;
+        stTry {
+                results = stKVDatabase_bulkGetRecords(prefetcher->database, keys);
+            }stCatch(ex)
+                { //the gets will just fetch the records themselves
+                    stExcept_free(ex);
+                }stTryEnd;
+        pthread_mutex_lock(&prefetcher->mutex);
+        if (results != NULL) {
+            addRecords(prefetcher, keys, results);
+            stList_destruct(results);
+        }
+        for (int32_t i = 0; i < stList_length(keys); i++) {
+            stInt64Tuple *key = stInt64Tuple_construct(1, *(int64_t *) stList_get(keys, i));
+            stSet_removeAndFreeKey(prefetcher->pending, key);
+            stInt64Tuple_destruct(key);
+        }
+        stList_destruct(keys);
+        pthread_cond_broadcast(&prefetcher->cond);
+    }
+    pthread_mutex_unlock(&prefetcher->mutex);
+    return NULL;
+}
+
+stKVDatabasePrefetcher *stKVDatabasePrefetcher_construct(stKVDatabase *database) {
+    stKVDatabasePrefetcher *prefetcher = st_calloc(1, sizeof(stKVDatabasePrefetcher));
+    prefetcher->queue = stList_construct3(0, (void (*)(void *)) stList_destruct);
+    prefetcher->pending = constructKeys();
+    prefetcher->records = constructRecords();
+    prefetcher->oldRecords = constructRecords();
+    prefetcher->writtenKeys = constructKeys();
+    stKVDatabaseConf *conf = stKVDatabase_getConf(database);
+    if (stKVDatabaseConf_getType(conf) != stKVDatabaseTypeTokyoCabinet && database->secondaryDB == NULL) {
+        prefetcher->database = stKVDatabase_construct(conf, false);
+        pthread_mutex_init(&prefetcher->mutex, NULL);
+        pthread_cond_init(&prefetcher->cond, NULL);
+        if (pthread_create(&prefetcher->thread, NULL, fetchInBackground, prefetcher) != 0) {
+            st_errAbort("Could not start the prefetching thread");
+        }
+    }
+    return prefetcher;
+}
+
+void stKVDatabasePrefetcher_destruct(stKVDatabasePrefetcher *prefetcher) {
+    if (prefetcher->database != NULL) {
+        pthread_mutex_lock(&prefetcher->mutex);
+        prefetcher->stop = true;
+        pthread_cond_broadcast(&prefetcher->cond);
+        pthread_mutex_unlock(&prefetcher->mutex);
+        pthread_join(prefetcher->thread, NULL);
+        pthread_mutex_destroy(&prefetcher->mutex);
+        pthread_cond_destroy(&prefetcher->cond);
+        stKVDatabase_destruct(prefetcher->database);
+    }
+    stList_destruct(prefetcher->queue);
+    stSet_destruct(prefetcher->pending);
+    stHash_destruct(prefetcher->records);
+    stHash_destruct(prefetcher->oldRecords);
+    stSet_destruct(prefetcher->writtenKeys);
+    free(prefetcher);
+}
+
+static void lock(stKVDatabasePrefetcher *prefetcher) {
+    if (prefetcher->database != NULL) {
+        pthread_mutex_lock(&prefetcher->mutex);
+    }
+}
+
+static void unlock(stKVDatabasePrefetcher *prefetcher) {
+    if (prefetcher->database != NULL) {
+        pthread_mutex_unlock(&prefetcher->mutex);
+    }
+}
+
+/*
+ * Waits until the key is not being fetched.
+ */
+static void waitForKey(stKVDatabasePrefetcher *prefetcher, stInt64Tuple *key) {
+    while (stSet_search(prefetcher->pending, key) != NULL) {
+        pthread_cond_wait(&prefetcher->cond, &prefetcher->mutex);
+    }
+}
+
+void stKVDatabasePrefetcher_prefetch(stKVDatabasePrefetcher *prefetcher, stKVDatabase *database, stList *keys) {
+    stList *keysToFetch = stList_construct3(0, free);
+    lock(prefetcher);
+    for (int32_t i = 0; i < stList_length(keys); i++) {
+        stInt64Tuple *key = stInt64Tuple_construct(1, *(int64_t *) stList_get(keys, i));
+        if (!containsRecord(prefetcher, key) && stSet_search(prefetcher->pending, key) == NULL
+                && stSet_search(prefetcher->writtenKeys, key) == NULL) {
+            int64_t *keyToFetch = st_malloc(sizeof(int64_t));
+            *keyToFetch = stInt64Tuple_getPosition(key, 0);
+            stList_append(keysToFetch, keyToFetch);
+            if (prefetcher->database != NULL) {
+                stSet_insert(prefetcher->pending, key);
+                continue;
+            }
+        }
+        stInt64Tuple_destruct(key);
+    }
+    if (stList_length(keysToFetch) == 0) {
+        stList_destruct(keysToFetch);
+    } else if (prefetcher->database != NULL) {
+        stList_append(prefetcher->queue, keysToFetch);
+        pthread_cond_broadcast(&prefetcher->cond);
+    } else {
+        stTry {
+                stList *results = stKVDatabase_bulkGetRecords(database, keysToFetch);
+                addRecords(prefetcher, keysToFetch, results);
+                stList_destruct(results);
+            }stCatch(ex)
+                { //it's only a hint, the gets will fetch the records themselves
+                    stExcept_free(ex);
+                }stTryEnd;
+        stList_destruct(keysToFetch);
+    }
+    unlock(prefetcher);
+}
+
+bool stKVDatabasePrefetcher_takeRecord(stKVDatabasePrefetcher *prefetcher, int64_t key, void **value,
+        int64_t *recordSize) {
+    stInt64Tuple *keyTuple = stInt64Tuple_construct(1, key);
+    lock(prefetcher);
+    if (prefetcher->database != NULL) {
+        waitForKey(prefetcher, keyTuple);
+    }
+    PrefetchedRecord *record = removeRecord(prefetcher, keyTuple);
+    bool found = record != NULL;
+    if (found) {
+        *value = record->value;
+        *recordSize = record->size;
+        free(record);
+    }
+    unlock(prefetcher);
+    stInt64Tuple_destruct(keyTuple);
+    return found;
+}
+
+void stKVDatabasePrefetcher_noteWrite(stKVDatabasePrefetcher *prefetcher, int64_t key, bool inTransaction) {
+    stInt64Tuple *keyTuple = stInt64Tuple_construct(1, key);
+    lock(prefetcher);
+    if (prefetcher->database != NULL) {
+        waitForKey(prefetcher, keyTuple);
+    }
+    PrefetchedRecord *record = removeRecord(prefetcher, keyTuple);
+    if (record != NULL) {
+        prefetchedRecord_destruct(record);
+    }
+    if (prefetcher->database != NULL && inTransaction && stSet_search(prefetcher->writtenKeys, keyTuple) == NULL) {
+        stSet_insert(prefetcher->writtenKeys, keyTuple);
+    } else {
+        stInt64Tuple_destruct(keyTuple);
+    }
+    unlock(prefetcher);
+}
+
+void stKVDatabasePrefetcher_endTransaction(stKVDatabasePrefetcher *prefetcher) {
+    lock(prefetcher);
+    stSet_destruct(prefetcher->writtenKeys);
+    prefetcher->writtenKeys = constructKeys();
+    unlock(prefetcher);
+}
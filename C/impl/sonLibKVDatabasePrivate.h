@@ -14,10 +14,13 @@
 #ifndef SONLIBKVDATABASEPRIVATE_H_
 #define SONLIBKVDATABASEPRIVATE_H_
 
+typedef struct _stKVDatabasePrefetcher stKVDatabasePrefetcher;
+
 struct stKVDatabase {
     stKVDatabaseConf *conf;
     void *dbImpl;
     struct stKVDatabase* secondaryDB;
+    void *connectionPool; //Kyoto Tycoon's connections for bulk sets, NULL until first needed.
     bool deleted;
     void (*destruct)(stKVDatabase *);
     void (*deleteDatabase)(stKVDatabase *);
@@ -37,7 +40,19 @@ struct stKVDatabase {
     void *(*getPartialRecord)(stKVDatabase *database, int64_t key, int64_t zeroBasedByteOffset, int64_t sizeInBytes, int64_t recordSize);
     stList *(*bulkGetRecords)(stKVDatabase *database, stList* keys);
     stList *(*bulkGetRecordsRange)(stKVDatabase *database, int64_t firstKey, int64_t numRecords);
+    stKVDatabaseBulkResultBuffer *(*bulkGetRecordsBuffer)(stKVDatabase *database, stList* keys);
+    stKVDatabaseBulkResultBuffer *(*bulkGetRecordsRangeBuffer)(stKVDatabase *database, int64_t firstKey, int64_t numRecords);
     void (*removeRecord)(stKVDatabase *, int64_t key);
+    void (*startTransaction)(stKVDatabase *);
+    void (*commitTransaction)(stKVDatabase *);
+    void (*abortTransaction)(stKVDatabase *);
+    /*
+     * Number of open public transactions. It is zero while the database's own start, commit and
+     * abort functions are called, so they must do nothing when it is greater than zero, letting
+     * bulk calls join the open transaction.
+     */
+    int64_t transactionDepth;
+    stKVDatabasePrefetcher *prefetcher; //NULL until stKVDatabase_prefetch is first called
 };
 
 enum stKVDatabaseBulkRequestType {
@@ -56,6 +71,18 @@ struct stKVDatabaseBulkResult {
 	int64_t size;
 };
 
+/*
+ * Records packed end to end in one growable block of memory. A record that is absent has an offset of -1.
+ */
+struct stKVDatabaseBulkResultBuffer {
+    int64_t length;
+    int64_t *offsets;
+    int64_t *sizes;
+    char *data;
+    int64_t dataSize;
+    int64_t maxDataSize;
+};
+
 /*
  * Function initialises the pointers of the stKVDatabase object with functions for tokyoCabinet.
  */
@@ -69,6 +96,47 @@ void stKVDatabase_initialise_MySql(stKVDatabase *database, stKVDatabaseConf *con
 #ifdef __cplusplus
 extern "C" {
 #endif
+/*
+ * Constructs a bulk result buffer for the given number of records, all initially absent.
+ */
+stKVDatabaseBulkResultBuffer *stKVDatabaseBulkResultBuffer_construct(int64_t length);
+
+/*
+ * Copies the value into the buffer as the record with the given index. If value is NULL the record is marked absent.
+ * Records may be set in any order.
+ */
+void stKVDatabaseBulkResultBuffer_setRecord(stKVDatabaseBulkResultBuffer *results, int64_t index, const void *value, int64_t sizeOfRecord);
+
+/*
+ * Constructs the cache of prefetched records for the database, see sonLibKVDatabasePrefetch.c.
+ */
+stKVDatabasePrefetcher *stKVDatabasePrefetcher_construct(stKVDatabase *database);
+
+void stKVDatabasePrefetcher_destruct(stKVDatabasePrefetcher *prefetcher);
+
+/*
+ * Starts fetching the records with the given keys (a list of int64_t pointers).
+ */
+void stKVDatabasePrefetcher_prefetch(stKVDatabasePrefetcher *prefetcher, stKVDatabase *database, stList *keys);
+
+/*
+ * If the record has been prefetched, waiting for it if it is being fetched, removes it from the cache,
+ * sets value (NULL if the record does not exist) and recordSize, and returns true. Otherwise returns false.
+ */
+bool stKVDatabasePrefetcher_takeRecord(stKVDatabasePrefetcher *prefetcher, int64_t key, void **value, int64_t *recordSize);
+
+/*
+ * Must be called before a record is written or removed, so that no stale copy of it is kept. If the write
+ * is inside a transaction the key is not prefetched again until the transaction ends.
+ */
+void stKVDatabasePrefetcher_noteWrite(stKVDatabasePrefetcher *prefetcher, int64_t key, bool inTransaction);
+
+/*
+ * Must be called when the outermost transaction is committed or aborted, after which the writes made in it
+ * are visible to the prefetching connection.
+ */
+void stKVDatabasePrefetcher_endTransaction(stKVDatabasePrefetcher *prefetcher);
+
 void stKVDatabase_initialise_kyotoTycoon(stKVDatabase *database, stKVDatabaseConf *conf, bool create);
 /*
  * Function initialises the pointers of the stKVDatabase object with functions for Big Record File.
@@ -31,6 +31,8 @@
 //Database functions
 #ifdef HAVE_KYOTO_TYCOON
 #include <unistd.h>
+#include <pthread.h>
+#include <deque>
 #include <ktremotedb.h>
 #include <kclangc.h>
 #include "sonLibGlobalsInternal.h"
@@ -82,7 +84,10 @@ static stKVDatabase* constructBigRecordDB(stKVDatabaseConf *conf, bool create) {
 
 /* closes the remote DB connection and deletes the rdb object, but does not destroy the 
 remote database */
+static void destructBulkSetPool(stKVDatabase *database);
+
 static void destructDB(stKVDatabase *database) {
+    destructBulkSetPool(database);
     RemoteDB *rdb = (RemoteDB*)database->dbImpl;
     if (rdb != NULL) {
 
@@ -138,6 +143,14 @@ static bool recordOnDisk(stKVDatabase *database, int64_t key)
 	return false;
 }
 
+/* check if any records at all are in the secondary database, so that bulk
+ * operations can skip checking each key when none are.
+ */
+static bool anyRecordsOnDisk(stKVDatabase *database)
+{
+	return database->secondaryDB != NULL && database->secondaryDB->numberOfRecords(database->secondaryDB) > 0;
+}
+
 /* remove a record from the disk cache if it exists.  must be called before
  * adding a record with this key to the tycoon.
  */
@@ -271,63 +284,291 @@ static int64_t incrementInt64(stKVDatabase *database, int64_t key, int64_t incre
     return returnValue;
 }
 
-// sets a bulk list of records atomically 
+/* a group of records sent to the tycoon by one set_bulk_binary call */
+struct BulkSetBatch {
+	vector<RemoteDB::BulkRecord> recs;
+	int64_t index; // position of the batch within its bulk set, for error messages
+	bool failed;
+	string error;
+};
+
+class BulkSetWorker;
+
+/* a pool of connections, each with its own thread, kept for the life of the database, that
+ * take the batches of bulk sets from a bounded queue, so that several go to the server at once
+ * without opening connections per bulk set or waiting for the slowest batch of a wave. the
+ * thread making the bulk set fills the queue, then helps empty it over the database's own
+ * connection.
+ */
+class BulkSetPool {
+public:
+	BulkSetPool(stKVDatabaseConf *conf, size_t numConnections);
+	~BulkSetPool();
+	/* queues the batch, which the pool then owns, waiting while the queue is full */
+	void submit(BulkSetBatch *batch);
+	/* sends queued batches over the given connection until the queue is empty, waits for the
+	 * batches the workers are sending, then returns the batches that failed, which the caller owns */
+	vector<BulkSetBatch *> finish(RemoteDB *rdb);
+	/* takes the next batch, waiting for one unless wait is false, returning NULL if there is
+	 * none or the pool is stopping */
+	BulkSetBatch *take(bool wait);
+	/* records that the batch has been sent */
+	void done(BulkSetBatch *batch);
+	stKVDatabaseConf *conf;
+private:
+	pthread_mutex_t mutex_;
+	pthread_cond_t changed_;
+	deque<BulkSetBatch *> queue_;
+	size_t maxQueued_;
+	int64_t outstanding_; // batches queued or being sent
+	vector<BulkSetBatch *> failed_;
+	vector<BulkSetWorker *> workers_;
+	bool stop_;
+};
+
+/* sends batches from the pool over its own connection, which it opens when first needed and
+ * reopens after it fails to. errors are recorded in the batches, rather than thrown, as this
+ * runs in its own thread.
+ */
+class BulkSetWorker : public kc::Thread {
+public:
+	BulkSetWorker(BulkSetPool *pool) : pool_(pool), rdb_(NULL) {
+	}
+	void run() {
+		BulkSetBatch *batch;
+		while ((batch = pool_->take(true)) != NULL) {
+			if (rdb_ == NULL) {
+				rdb_ = new RemoteDB();
+				if (!rdb_->open(stKVDatabaseConf_getHost(pool_->conf), stKVDatabaseConf_getPort(pool_->conf), stKVDatabaseConf_getTimeout(pool_->conf))) {
+					batch->failed = true;
+					batch->error = string("opening connection failed: ") + rdb_->error().name();
+					delete rdb_;
+					rdb_ = NULL;
+					pool_->done(batch);
+					continue;
+				}
+			}
+			sendBatch(rdb_, batch);
+			pool_->done(batch);
+		}
+		if (rdb_ != NULL) {
+			rdb_->close(true);
+			delete rdb_;
+		}
+	}
+	static void sendBatch(RemoteDB *rdb, BulkSetBatch *batch) {
+		if (rdb->set_bulk_binary(batch->recs) < 1) {
+			batch->failed = true;
+			batch->error = rdb->error().name();
+		}
+	}
+private:
+	BulkSetPool *pool_;
+	RemoteDB *rdb_;
+};
+
+BulkSetPool::BulkSetPool(stKVDatabaseConf *conf, size_t numConnections) :
+		conf(conf), maxQueued_(2 * numConnections), outstanding_(0), stop_(false) {
+	pthread_mutex_init(&mutex_, NULL);
+	pthread_cond_init(&changed_, NULL);
+	for (size_t i = 0; i < numConnections; ++i) {
+		workers_.push_back(new BulkSetWorker(this));
+		workers_.back()->start();
+	}
+}
+
+BulkSetPool::~BulkSetPool() {
+	pthread_mutex_lock(&mutex_);
+	stop_ = true;
+	pthread_cond_broadcast(&changed_);
+	pthread_mutex_unlock(&mutex_);
+	for (size_t i = 0; i < workers_.size(); ++i) {
+		workers_[i]->join();
+		delete workers_[i];
+	}
+	pthread_cond_destroy(&changed_);
+	pthread_mutex_destroy(&mutex_);
+}
+
+void BulkSetPool::submit(BulkSetBatch *batch) {
+	pthread_mutex_lock(&mutex_);
+	while (queue_.size() >= maxQueued_) {
+		pthread_cond_wait(&changed_, &mutex_);
+	}
+	queue_.push_back(batch);
+	++outstanding_;
+	pthread_cond_broadcast(&changed_);
+	pthread_mutex_unlock(&mutex_);
+}
+
+BulkSetBatch *BulkSetPool::take(bool wait) {
+	pthread_mutex_lock(&mutex_);
+	while (wait && queue_.empty() && !stop_) {
+		pthread_cond_wait(&changed_, &mutex_);
+	}
+	BulkSetBatch *batch = NULL;
+	if (!queue_.empty() && !stop_) {
+		batch = queue_.front();
+		queue_.pop_front();
+		pthread_cond_broadcast(&changed_);
+	}
+	pthread_mutex_unlock(&mutex_);
+	return batch;
+}
+
+void BulkSetPool::done(BulkSetBatch *batch) {
+	pthread_mutex_lock(&mutex_);
+	if (batch->failed) {
+		failed_.push_back(batch);
+	}
+	else {
+		delete batch;
+	}
+	--outstanding_;
+	pthread_cond_broadcast(&changed_);
+	pthread_mutex_unlock(&mutex_);
+}
+
+vector<BulkSetBatch *> BulkSetPool::finish(RemoteDB *rdb) {
+	BulkSetBatch *batch;
+	while ((batch = take(false)) != NULL) {
+		BulkSetWorker::sendBatch(rdb, batch);
+		done(batch);
+	}
+	pthread_mutex_lock(&mutex_);
+	while (outstanding_ > 0) {
+		pthread_cond_wait(&changed_, &mutex_);
+	}
+	vector<BulkSetBatch *> failed;
+	failed.swap(failed_);
+	pthread_mutex_unlock(&mutex_);
+	return failed;
+}
+
+/* the pool for the database, started on its first bulk set, NULL if it is only to use its own connection */
+static BulkSetPool *getBulkSetPool(stKVDatabase *database) {
+	stKVDatabaseConf* conf = stKVDatabase_getConf(database);
+	if (database->connectionPool == NULL && stKVDatabaseConf_getMaxKTBulkSetConnections(conf) > 1) {
+		database->connectionPool = new BulkSetPool(conf, stKVDatabaseConf_getMaxKTBulkSetConnections(conf) - 1);
+	}
+	return (BulkSetPool *)database->connectionPool;
+}
+
+static void destructBulkSetPool(stKVDatabase *database) {
+	delete (BulkSetPool *)database->connectionPool;
+	database->connectionPool = NULL;
+}
+
+/* send the batch, through the pool if there is one, else straight away over the database's connection,
+ * keeping it if it failed */
+static void sendBulkSetBatch(stKVDatabase *database, BulkSetBatch *batch, vector<BulkSetBatch *>& failed) {
+	BulkSetPool *pool = getBulkSetPool(database);
+	if (pool != NULL) {
+		pool->submit(batch);
+		return;
+	}
+	BulkSetWorker::sendBatch((RemoteDB *)database->dbImpl, batch);
+	if (batch->failed) {
+		failed.push_back(batch);
+	}
+	else {
+		delete batch;
+	}
+}
+
+/* wait for the batches of a bulk set of the given number of batches to be sent, then throw an exception
+ * describing every batch that failed.
+ */
+static void finishBulkSetBatches(stKVDatabase *database, vector<BulkSetBatch *>& failed, int64_t numBatches) {
+	BulkSetPool *pool = getBulkSetPool(database);
+	if (pool != NULL) {
+		failed = pool->finish((RemoteDB *)database->dbImpl);
+	}
+	if (failed.empty()) {
+		return;
+	}
+	string errors;
+	for (size_t i = 0; i < failed.size(); ++i) {
+		int64_t firstKey;
+		memcpy(&firstKey, failed[i]->recs[0].key.data(), sizeof(int64_t));
+		char *cA = stString_print("; batch %lld of %lld records starting with key %lld: %s", (long long)failed[i]->index,
+				(long long)failed[i]->recs.size(), (long long)firstKey, failed[i]->error.c_str());
+		errors += cA;
+		free(cA);
+		delete failed[i];
+	}
+	size_t numFailed = failed.size();
+	failed.clear();
+	fprintf(stderr, "Throwing an exception with the string %s\n", errors.c_str());
+	stThrowNew(ST_KV_DATABASE_EXCEPTION_ID, "kyoto tycoon set bulk record failed for %lld of %lld batches%s",
+			(long long)numFailed, (long long)numBatches, errors.c_str());
+}
+
 static void bulkSetRecords(stKVDatabase *database, stList *records) {
 	stKVDatabaseConf* conf = stKVDatabase_getConf(database);
 	int64_t maxRecordSize = stKVDatabaseConf_getMaxKTRecordSize(conf);
 	int64_t maxBulkSetSize = stKVDatabaseConf_getMaxKTBulkSetSize(conf);
 	int64_t maxBulkSetNumRecords = stKVDatabaseConf_getMaxKTBulkSetNumRecords(conf);
-    RemoteDB *rdb = (RemoteDB *)database->dbImpl;
-    vector<RemoteDB::BulkRecord> recs;
-    recs.reserve(stList_length(records));
     RemoteDB::BulkRecord templateRec;
     templateRec.dbidx = 0;
     templateRec.xt = XT;
-    int64_t runningSize = 0;
 
-    // copy the records from our C data structure to the CPP map needed for the Tycoon API
+    // only the last request for a key is sent, so that batches sent at once can't
+    // race to set it.
+    map<int64_t, int32_t> lastRequests;
     for(int32_t i=0; i<stList_length(records); i++) {
-        stKVDatabaseBulkRequest *request = (stKVDatabaseBulkRequest *)stList_get(records, i);
+    	lastRequests[((stKVDatabaseBulkRequest *)stList_get(records, i))->key] = i;
+    }
 
-        // current batch can't get any bigger so we write and clear it
-        if ((runningSize + request->size > maxBulkSetSize ||
-        	 (int64_t)recs.size() >= maxBulkSetNumRecords) && recs.empty() == false) {
-        	int64_t retVal = rdb->set_bulk_binary(recs);
-			if (retVal < 1) {
-				assert(rdb->error().name() != NULL);
-				fprintf(stderr, "Throwing an exception with the string %s\n", rdb->error().name());
-				stThrowNew(ST_KV_DATABASE_EXCEPTION_ID, "kyoto tycoon set bulk record failed: %s", rdb->error().name());
-			}
-			recs.clear();
-			runningSize = 0;
+    // put records too big for kt in the secondary, and make sure the others aren't left there. this
+    // is done before any batch is sent, so that nothing in the loop sending them can throw.
+    for(int32_t i=0; i<stList_length(records); i++) {
+        stKVDatabaseBulkRequest *request = (stKVDatabaseBulkRequest *)stList_get(records, i);
+        if (lastRequests[request->key] != i) {
+        	continue;
         }
-        // record too big for kt, we put in the secondary
         if (request->size > maxRecordSize) {
         	assert(database->secondaryDB != NULL);
         	removeRecordFromTycoonIfPresent(database, request->key);
         	database->secondaryDB->setRecord(database->secondaryDB, request->key, request->value, request->size);
         }
-        else
-        {
+        else {
         	removeRecordFromDiskIfPresent(database, request->key);
-        	templateRec.key = string((const char *)&(request->key), sizeof(int64_t));
-        	templateRec.value = string((const char *)request->value, request->size);
-        	recs.push_back(templateRec);
-			runningSize += request->size;
         }
     }
 
-    // test for empty list   
-    if (recs.empty() == false) {
-		// set values, atomic = true
-		int64_t retVal = rdb->set_bulk_binary(recs);
-		if (retVal < 1) {
-			assert(rdb->error().name() != NULL);
-			fprintf(stderr, "Throwing an exception with the string %s\n", rdb->error().name());
-			stThrowNew(ST_KV_DATABASE_EXCEPTION_ID, "kyoto tycoon set bulk record failed: %s", rdb->error().name());
-		}
+    // copy the records from our C data structure to the CPP vectors needed for the Tycoon API,
+    // sending each batch as soon as it is full
+    vector<BulkSetBatch *> failed;
+    BulkSetBatch *batch = NULL;
+    int64_t numBatches = 0, runningSize = 0;
+    for(int32_t i=0; i<stList_length(records); i++) {
+        stKVDatabaseBulkRequest *request = (stKVDatabaseBulkRequest *)stList_get(records, i);
+        if (lastRequests[request->key] != i || request->size > maxRecordSize) {
+        	continue;
+        }
+        if (batch != NULL && (runningSize + request->size > maxBulkSetSize ||
+        		(int64_t)batch->recs.size() >= maxBulkSetNumRecords)) {
+        	sendBulkSetBatch(database, batch, failed);
+        	batch = NULL;
+        }
+        if (batch == NULL) {
+        	batch = new BulkSetBatch();
+        	batch->index = numBatches++;
+        	batch->failed = false;
+        	runningSize = 0;
+        }
+    	templateRec.key = string((const char *)&(request->key), sizeof(int64_t));
+    	templateRec.value = string((const char *)request->value, request->size);
+    	batch->recs.push_back(templateRec);
+		runningSize += request->size;
+    }
+    if (batch != NULL) {
+    	sendBulkSetBatch(database, batch, failed);
+    }
+    if (numBatches > 0) {
+    	finishBulkSetBatches(database, failed, numBatches);
     }
-    //printf("size of insert: %d\n", retVal);
 }
 
 // remove a bulk list atomically 
@@ -437,6 +678,7 @@ static void *getPartialRecord(stKVDatabase *database, int64_t key, int64_t zeroB
 
 /* do a bulk get based on a list of keys.  */
 static stList *bulkGetRecords(stKVDatabase *database, stList* keys) {
+	bool checkDisk = anyRecordsOnDisk(database);
 	int32_t n = stList_length(keys);
 	RemoteDB::BulkRecord templateRec;
 	templateRec.dbidx = 0;
@@ -446,7 +688,7 @@ static stList *bulkGetRecords(stKVDatabase *database, stList* keys) {
 	stList* results = stList_construct3(n, (void(*)(void *))stKVDatabaseBulkResult_destruct);
 	for (int32_t i = 0; i < n; ++i) {
 		int64_t key = *(int64_t*)stList_get(keys, i);
-		if (recordOnDisk(database, key) == true)
+		if (checkDisk == true && recordOnDisk(database, key) == true)
 		{
 			int64_t recordSize;
 			void *record = database->secondaryDB->getRecord2(database->secondaryDB, key, &recordSize);
@@ -487,12 +729,13 @@ static stList *bulkGetRecords(stKVDatabase *database, stList* keys) {
 }
 
 static stList *bulkGetRecordsRange(stKVDatabase *database, int64_t firstKey, int64_t numRecords) {
+	bool checkDisk = anyRecordsOnDisk(database);
 	vector<string> keysVec;
 	keysVec.reserve(numRecords);
 	stList* results = stList_construct3(numRecords, (void(*)(void *))stKVDatabaseBulkResult_destruct);
 	for (int64_t i = 0; i < numRecords; ++i) {
 		int64_t key = firstKey + i;
-		if (recordOnDisk(database, key) == true)
+		if (checkDisk == true && recordOnDisk(database, key) == true)
 		{
 			int64_t recordSize;
 			void *record = database->secondaryDB->getRecord2(database->secondaryDB, key, &recordSize);
@@ -538,6 +781,102 @@ static stList *bulkGetRecordsRange(stKVDatabase *database, int64_t firstKey, int
 	return results;
 }
 
+/* copy a record from the secondary database into a bulk result buffer */
+static void getRecordOnDiskIntoBuffer(stKVDatabase *database, int64_t key, stKVDatabaseBulkResultBuffer *results, int64_t index) {
+	int64_t recordSize;
+	void *record = database->secondaryDB->getRecord2(database->secondaryDB, key, &recordSize);
+	stKVDatabaseBulkResultBuffer_setRecord(results, index, record, recordSize);
+	free(record);
+}
+
+/* do a bulk get based on a list of keys, copying the values straight out of the
+ * returned strings into one buffer.  */
+static stKVDatabaseBulkResultBuffer *bulkGetRecordsBuffer(stKVDatabase *database, stList* keys) {
+	bool checkDisk = anyRecordsOnDisk(database);
+	int32_t n = stList_length(keys);
+	RemoteDB::BulkRecord templateRec;
+	templateRec.dbidx = 0;
+	templateRec.xt = XT;
+	vector<RemoteDB::BulkRecord> recs;
+	vector<int32_t> recIndices;
+	recs.reserve(n);
+	recIndices.reserve(n);
+	stKVDatabaseBulkResultBuffer *results = stKVDatabaseBulkResultBuffer_construct(n);
+	for (int32_t i = 0; i < n; ++i) {
+		int64_t key = *(int64_t*)stList_get(keys, i);
+		if (checkDisk == true && recordOnDisk(database, key) == true)
+		{
+			getRecordOnDiskIntoBuffer(database, key, results, i);
+		}
+		else
+		{
+			templateRec.key = string((char*)&key, (size_t)sizeof(int64_t));
+			recs.push_back(templateRec);
+			recIndices.push_back(i);
+		}
+	}
+	if (recs.empty() == false)
+	{
+		RemoteDB *rdb = (RemoteDB *)database->dbImpl;
+		int64_t retVal = rdb->get_bulk_binary(&recs);
+		if (retVal < 0)
+		{
+			stKVDatabaseBulkResultBuffer_destruct(results);
+			assert(rdb->error().name() != NULL);
+			fprintf(stderr, "Throwing a KT exception with the string %s\n", rdb->error().name());
+			stThrowNew(ST_KV_DATABASE_EXCEPTION_ID, "kyoto tycoon get bulk record failed: %s", rdb->error().name());
+		}
+		for (size_t j = 0; j < recs.size(); ++j)
+		{
+			const string& value = recs[j].value;
+			stKVDatabaseBulkResultBuffer_setRecord(results, recIndices[j], value.data(), value.length() * sizeof(char));
+		}
+	}
+	return results;
+}
+
+static stKVDatabaseBulkResultBuffer *bulkGetRecordsRangeBuffer(stKVDatabase *database, int64_t firstKey, int64_t numRecords) {
+	bool checkDisk = anyRecordsOnDisk(database);
+	vector<string> keysVec;
+	keysVec.reserve(numRecords);
+	stKVDatabaseBulkResultBuffer *results = stKVDatabaseBulkResultBuffer_construct(numRecords);
+	for (int64_t i = 0; i < numRecords; ++i) {
+		int64_t key = firstKey + i;
+		if (checkDisk == true && recordOnDisk(database, key) == true)
+		{
+			getRecordOnDiskIntoBuffer(database, key, results, i);
+		}
+		else
+		{
+			keysVec.push_back(string((char*)&key, (size_t)sizeof(int64_t)));
+		}
+	}
+	if (keysVec.empty() == false)
+	{
+		RemoteDB *rdb = (RemoteDB *)database->dbImpl;
+		map<string, string> recs;
+		int64_t retVal = rdb->get_bulk(keysVec, &recs);
+		if (retVal < 0)
+		{
+			stKVDatabaseBulkResultBuffer_destruct(results);
+			assert(rdb->error().name() != NULL);
+			fprintf(stderr, "Throwing a KT exception with the string %s\n", rdb->error().name());
+			stThrowNew(ST_KV_DATABASE_EXCEPTION_ID, "kyoto tycoon get bulk record failed: %s", rdb->error().name());
+		}
+		// the map is ordered by the raw key bytes, not by key, so look each one up
+		for (int64_t i = 0; i < numRecords; ++i)
+		{
+			int64_t key = firstKey + i;
+			map<string,string>::iterator mapIt = recs.find(string((char*)&key, (size_t)sizeof(int64_t)));
+			if (mapIt != recs.end())
+			{
+				stKVDatabaseBulkResultBuffer_setRecord(results, i, mapIt->second.data(), mapIt->second.length() * sizeof(char));
+			}
+		}
+	}
+	return results;
+}
+
 static void removeRecord(stKVDatabase *database, int64_t key) {
 	if (recordOnDisk(database, key) == true) {
 		database->secondaryDB->removeRecord(database->secondaryDB, key);
@@ -573,6 +912,8 @@ void stKVDatabase_initialise_kyotoTycoon(stKVDatabase *database, stKVDatabaseCon
     database->getPartialRecord = getPartialRecord;
     database->bulkGetRecords = bulkGetRecords;
     database->bulkGetRecordsRange = bulkGetRecordsRange;
+    database->bulkGetRecordsBuffer = bulkGetRecordsBuffer;
+    database->bulkGetRecordsRangeBuffer = bulkGetRecordsRangeBuffer;
     database->removeRecord = removeRecord;
 }
 
@@ -308,6 +308,17 @@ static void *getRecord2(stKVDatabase *database, int64_t key, int64_t *sizeOfReco
     return data;
 }
 
+/* read a record straight from the result row into a bulk result buffer */
+static void getRecordIntoBuffer(stKVDatabase *database, int64_t key, stKVDatabaseBulkResultBuffer *results, int64_t index) {
+    MySqlDb *dbImpl = database->dbImpl;
+    MYSQL_RES *rs = queryStart(dbImpl, "select data from %s where id=%lld", dbImpl->table,  (long long)key);
+    char **row = queryNext(dbImpl, rs);
+    if (row != NULL) {
+        stKVDatabaseBulkResultBuffer_setRecord(results, index, row[0], queryLength(dbImpl, rs));
+    }
+    queryEnd(dbImpl, rs);
+}
+
 static int64_t getInt64(stKVDatabase *database, int64_t key) {
     void *record = getRecord2(database, key, NULL);
     return *((int64_t*)record);
@@ -343,17 +354,30 @@ static void *getPartialRecord(stKVDatabase *database, int64_t key, int64_t zeroB
     return data;
 }
 
+/*
+ * The transaction functions do nothing inside a transaction started with stKVDatabase_startTransaction,
+ * so that the bulk functions join it.
+ */
 static void startTransaction(stKVDatabase *database) {
+    if (database->transactionDepth > 0) {
+        return;
+    }
     MySqlDb *dbImpl = database->dbImpl;
     sqlExec(dbImpl, "start transaction with consistent snapshot;");
 }
 
 static void commitTransaction(stKVDatabase *database) {
+    if (database->transactionDepth > 0) {
+        return;
+    }
     MySqlDb *dbImpl = database->dbImpl;
     sqlExec(dbImpl, "commit;");
 }
 
 static void abortTransaction(stKVDatabase *database) {
+    if (database->transactionDepth > 0) {
+        return;
+    }
     MySqlDb *dbImpl = database->dbImpl;
     sqlExec(dbImpl, "rollback;");
 }
@@ -460,6 +484,39 @@ static stList *bulkGetRecordsRange(stKVDatabase *database, int64_t firstKey, int
 }
 
 
+static stKVDatabaseBulkResultBuffer *bulkGetRecordsBuffer(stKVDatabase *database, stList* keys) {
+    int32_t n = stList_length(keys);
+    stKVDatabaseBulkResultBuffer *results = stKVDatabaseBulkResultBuffer_construct(n);
+    startTransaction(database);
+    stTry {
+        for (int32_t i = 0; i < n; ++i) {
+            getRecordIntoBuffer(database, *(int64_t*)stList_get(keys, i), results, i);
+        }
+        commitTransaction(database);
+    }stCatch(ex) {
+        abortTransaction(database);
+        stKVDatabaseBulkResultBuffer_destruct(results);
+        stThrowNewCause(ex, ST_KV_DATABASE_EXCEPTION_ID, "MySQL bulk get records failed");
+    }stTryEnd;
+    return results;
+}
+
+static stKVDatabaseBulkResultBuffer *bulkGetRecordsRangeBuffer(stKVDatabase *database, int64_t firstKey, int64_t numRecords) {
+    stKVDatabaseBulkResultBuffer *results = stKVDatabaseBulkResultBuffer_construct(numRecords);
+    startTransaction(database);
+    stTry {
+        for (int64_t i = 0; i < numRecords; ++i) {
+            getRecordIntoBuffer(database, firstKey + i, results, i);
+        }
+        commitTransaction(database);
+    }stCatch(ex) {
+        abortTransaction(database);
+        stKVDatabaseBulkResultBuffer_destruct(results);
+        stThrowNewCause(ex, ST_KV_DATABASE_EXCEPTION_ID, "MySQL bulk get records failed");
+    }stTryEnd;
+    return results;
+}
+
 // TODO: see if we can make this one command
 static void bulkSetRecords(stKVDatabase *database, stList *records) {
     startTransaction(database);
@@ -509,7 +566,12 @@ void stKVDatabase_initialise_MySql(stKVDatabase *database, stKVDatabaseConf *con
     database->getPartialRecord = getPartialRecord;
     database->bulkGetRecords = bulkGetRecords;
     database->bulkGetRecordsRange = bulkGetRecordsRange;
+    database->bulkGetRecordsBuffer = bulkGetRecordsBuffer;
+    database->bulkGetRecordsRangeBuffer = bulkGetRecordsRangeBuffer;
     database->removeRecord = removeRecord;
+    database->startTransaction = startTransaction;
+    database->commitTransaction = commitTransaction;
+    database->abortTransaction = abortTransaction;
     if (create) {
         createKVTable(database->dbImpl);
     }
@@ -122,7 +122,14 @@ static void setRecord(stKVDatabase *database, int64_t key,
     }
 }
 
+/*
+ * The transaction functions do nothing inside a transaction started with stKVDatabase_startTransaction,
+ * so that the bulk functions join it.
+ */
 static void startTransaction(stKVDatabase *database) {
+    if (database->transactionDepth > 0) {
+        return;
+    }
     TCBDB *dbImpl = database->dbImpl;
     if (!tcbdbtranbegin(dbImpl)) {
         stThrowNew(ST_KV_DATABASE_EXCEPTION_ID, "Tried to start a transaction but got error: %s", tcbdberrmsg(tcbdbecode(dbImpl)));
@@ -130,6 +137,9 @@ static void startTransaction(stKVDatabase *database) {
 }
 
 static void commitTransaction(stKVDatabase *database) {
+    if (database->transactionDepth > 0) {
+        return;
+    }
     TCBDB *dbImpl = database->dbImpl;
     //Commit the transaction..
     if (!tcbdbtrancommit(dbImpl)) {
@@ -138,6 +148,9 @@ static void commitTransaction(stKVDatabase *database) {
 }
 
 static void abortTransaction(stKVDatabase *database) {
+    if (database->transactionDepth > 0) {
+        return;
+    }
     TCBDB *dbImpl = database->dbImpl;
     if (!tcbdbtranabort(dbImpl)) {
         stThrowNew(ST_KV_DATABASE_EXCEPTION_ID, "Tried to abort a transaction but got error: %s", tcbdberrmsg(tcbdbecode(dbImpl)));
@@ -242,47 +255,116 @@ static void *getPartialRecord(stKVDatabase *database, int64_t key, int64_t zeroB
     return partialRecord;
 }
 
+/*
+ * Bulk gets walk the B+ tree with a cursor rather than looking up each key from the root. Keys
+ * are handed down sorted and distinct (see stKVDatabase_bulkGetRecords), so each lookup starts
+ * where the last one finished: a key that follows the previous hit is a single cursor step, and
+ * the pages are visited in order. Values are read in place with tcbdbcurval3 and copied once.
+ */
+typedef struct _sortedReader {
+    BDBCUR *cursor;
+    bool started; // the cursor has been jumped at least once
+    bool valid; // the cursor is on a record
+    bool atLastHit; // the cursor is on the record last returned
+    int64_t lastKey;
+} SortedReader;
+
+static SortedReader sortedReader_construct(TCBDB *dbImpl) {
+    SortedReader reader;
+    reader.cursor = tcbdbcurnew(dbImpl);
+    reader.started = false;
+    reader.valid = false;
+    reader.atLastHit = false;
+    reader.lastKey = INT64_MIN;
+    return reader;
+}
+
+static int64_t sortedReader_currentKey(SortedReader *reader) {
+    int32_t keySize;
+    const void *key = tcbdbcurkey3(reader->cursor, &keySize);
+    assert(key != NULL && keySize == sizeof(int64_t));
+    return *(const int64_t *) key;
+}
+
+/*
+ * Returns the record for key, or NULL if absent. The record is only valid until the next call.
+ */
+static const void *sortedReader_get(SortedReader *reader, int64_t key, int32_t *recordSize) {
+    if (!reader->started || key <= reader->lastKey) { // out of order keys are still handled, just slowly
+        reader->valid = tcbdbcurjump(reader->cursor, &key, sizeof(int64_t));
+        reader->started = true;
+    } else {
+        if (reader->valid && reader->atLastHit) {
+            reader->valid = tcbdbcurnext(reader->cursor);
+        }
+        if (reader->valid && sortedReader_currentKey(reader) < key) {
+            reader->valid = tcbdbcurjump(reader->cursor, &key, sizeof(int64_t));
+        }
+    }
+    reader->lastKey = key;
+    reader->atLastHit = reader->valid && sortedReader_currentKey(reader) == key;
+    return reader->atLastHit ? tcbdbcurval3(reader->cursor, recordSize) : NULL;
+}
+
+static void sortedReader_destruct(SortedReader *reader) {
+    tcbdbcurdel(reader->cursor);
+}
+
+static stKVDatabaseBulkResult *constructBulkResult(const void *record, int32_t recordSize) {
+    if (record == NULL) {
+        return stKVDatabaseBulkResult_construct(NULL, 0);
+    }
+    return stKVDatabaseBulkResult_construct(memcpy(st_malloc(recordSize), record, recordSize), recordSize);
+}
+
 static stList *bulkGetRecords(stKVDatabase *database, stList* keys) {
-	int32_t n = stList_length(keys);
-	stList* results = stList_construct3(n, (void(*)(void *))stKVDatabaseBulkResult_destruct);
-	//startTransaction(database);
-	stTry {
-		for (int32_t i = 0; i < n; ++i)
-		{
-			int64_t key = *((int64_t*)stList_get(keys, i));
-			int64_t recordSize;
-			void* record = getRecord2(database, key, &recordSize);
-			stKVDatabaseBulkResult* result = stKVDatabaseBulkResult_construct(record, recordSize);
-			stList_set(results, i, result);
-		}
-		//commitTransaction(database);
-	}stCatch(ex) {
-		//abortTransaction(database);
-		stThrowNewCause(ex, ST_KV_DATABASE_EXCEPTION_ID, "tokyo cabinet bulk get records failed");
-	}stTryEnd;
-
-	return results;
+    int32_t n = stList_length(keys);
+    stList* results = stList_construct3(n, (void(*)(void *))stKVDatabaseBulkResult_destruct);
+    SortedReader reader = sortedReader_construct(database->dbImpl);
+    for (int32_t i = 0; i < n; ++i) {
+        int32_t recordSize = 0;
+        const void *record = sortedReader_get(&reader, *((int64_t*)stList_get(keys, i)), &recordSize);
+        stList_set(results, i, constructBulkResult(record, recordSize));
+    }
+    sortedReader_destruct(&reader);
+    return results;
 }
 
 static stList *bulkGetRecordsRange(stKVDatabase *database, int64_t firstKey, int64_t numRecords) {
-	stList* results = stList_construct3(numRecords, (void(*)(void *))stKVDatabaseBulkResult_destruct);
-	//startTransaction(database);
-	stTry {
-		for (int32_t i = 0; i < numRecords; ++i)
-		{
-			int64_t key = firstKey + i;
-			int64_t recordSize;
-			void* record = getRecord2(database, key, &recordSize);
-			stKVDatabaseBulkResult* result = stKVDatabaseBulkResult_construct(record, recordSize);
-			stList_set(results, i, result);
-		}
-		//commitTransaction(database);
-	}stCatch(ex) {
-		//abortTransaction(database);
-		stThrowNewCause(ex, ST_KV_DATABASE_EXCEPTION_ID, "tokyo cabinet bulk get records failed");
-	}stTryEnd;
-
-	return results;
+    stList* results = stList_construct3(numRecords, (void(*)(void *))stKVDatabaseBulkResult_destruct);
+    SortedReader reader = sortedReader_construct(database->dbImpl);
+    for (int64_t i = 0; i < numRecords; ++i) {
+        int32_t recordSize = 0;
+        const void *record = sortedReader_get(&reader, firstKey + i, &recordSize);
+        stList_set(results, (int32_t)i, constructBulkResult(record, recordSize));
+    }
+    sortedReader_destruct(&reader);
+    return results;
+}
+
+static stKVDatabaseBulkResultBuffer *bulkGetRecordsBuffer(stKVDatabase *database, stList* keys) {
+    int32_t n = stList_length(keys);
+    stKVDatabaseBulkResultBuffer *results = stKVDatabaseBulkResultBuffer_construct(n);
+    SortedReader reader = sortedReader_construct(database->dbImpl);
+    for (int32_t i = 0; i < n; ++i) {
+        int32_t recordSize = 0;
+        const void *record = sortedReader_get(&reader, *((int64_t*)stList_get(keys, i)), &recordSize);
+        stKVDatabaseBulkResultBuffer_setRecord(results, i, record, recordSize);
+    }
+    sortedReader_destruct(&reader);
+    return results;
+}
+
+static stKVDatabaseBulkResultBuffer *bulkGetRecordsRangeBuffer(stKVDatabase *database, int64_t firstKey, int64_t numRecords) {
+    stKVDatabaseBulkResultBuffer *results = stKVDatabaseBulkResultBuffer_construct(numRecords);
+    SortedReader reader = sortedReader_construct(database->dbImpl);
+    for (int64_t i = 0; i < numRecords; ++i) {
+        int32_t recordSize = 0;
+        const void *record = sortedReader_get(&reader, firstKey + i, &recordSize);
+        stKVDatabaseBulkResultBuffer_setRecord(results, i, record, recordSize);
+    }
+    sortedReader_destruct(&reader);
+    return results;
 }
 
 static void removeRecord(stKVDatabase *database, int64_t key) {
@@ -331,7 +413,12 @@ void stKVDatabase_initialise_tokyoCabinet(stKVDatabase *database, stKVDatabaseCo
     database->getPartialRecord = getPartialRecord;
     database->bulkGetRecords = bulkGetRecords;
     database->bulkGetRecordsRange = bulkGetRecordsRange;
+    database->bulkGetRecordsBuffer = bulkGetRecordsBuffer;
+    database->bulkGetRecordsRangeBuffer = bulkGetRecordsRangeBuffer;
     database->removeRecord = removeRecord;
+    database->startTransaction = startTransaction;
+    database->commitTransaction = commitTransaction;
+    database->abortTransaction = abortTransaction;
 }
 
 #endif
@@ -222,12 +222,7 @@ void stList_shuffle(stList *list) {
 }
 
 stSortedSet *stList_getSortedSet(stList *list, int (*cmpFn)(const void *a, const void *b)) {
-    stSortedSet *sortedSet = stSortedSet_construct3(cmpFn, NULL);
-    int32_t i;
-    for(i=0; i<stList_length(list); i++) {
-        stSortedSet_insert(sortedSet, stList_get(list, i));
-    }
-    return sortedSet;
+    return stSortedSet_constructFromList(list, cmpFn, NULL);
 }
 
 void stList_setDestructor(stList *list, void (*destructElement)(void *)) {
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2006-2012 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+/*
+ * sonLibPool.c
+ *
+ * Each slab starts with a pointer to the previous slab, followed by its objects. Freed objects are kept on a
+ * list threaded through their first word, and reused before any more of the current slab is handed out.
+ */
+#include "sonLibGlobalsInternal.h"
+
+#define FIRST_SLAB_OBJECTS 8
+#define MAX_SLAB_OBJECTS 4096
+#define SLAB_HEADER_SIZE 16 //Room for the pointer to the previous slab, keeping the objects as aligned as malloc's
+
+struct _stPool {
+    int64_t objectSize; //rounded up to keep objects aligned.
+    int64_t slabObjects; //the number of objects in the next slab.
+    void *slabs; //the most recent slab, NULL if none.
+    char *next; //the next unused object of the most recent slab.
+    char *end;
+    void *freeObjects; //list of freed objects.
+};
+
+stPool *stPool_construct(int64_t objectSize) {
+    return stPool_construct2(objectSize, FIRST_SLAB_OBJECTS);
+}
+
+stPool *stPool_construct2(int64_t objectSize, int64_t firstSlabObjects) {
+    if (objectSize <= 0) {
+        st_errAbort("The size of the objects of a pool must be positive, not: %" PRIi64 "\n", objectSize);
+    }
+    if (firstSlabObjects <= 0) {
+        st_errAbort("The number of objects in the first slab of a pool must be positive, not: %" PRIi64 "\n", firstSlabObjects);
+    }
+    stPool *pool = st_calloc(1, sizeof(stPool));
+    int64_t alignment = sizeof(void *) > sizeof(int64_t) ? sizeof(void *) : sizeof(int64_t);
+    pool->objectSize = (objectSize + alignment - 1) / alignment * alignment;
+    pool->slabObjects = firstSlabObjects;
+    return pool;
+}
+
+void stPool_destruct(stPool *pool) {
+    void *slab = pool->slabs;
+    while (slab != NULL) {
+        void *previousSlab = *(void **) slab;
+        free(slab);
+        slab = previousSlab;
+    }
+    free(pool);
+}
+
+static void addSlab(stPool *pool) {
+    int64_t header = SLAB_HEADER_SIZE;
+    char *slab = st_malloc(header + pool->slabObjects * pool->objectSize);
+    *(void **) slab = pool->slabs;
+    pool->slabs = slab;
+    pool->next = slab + header;
+    pool->end = pool->next + pool->slabObjects * pool->objectSize;
+    if (pool->slabObjects < MAX_SLAB_OBJECTS) { //Small containers stay small, big ones need few slabs
+        pool->slabObjects *= 2;
+    }
+}
+
+void *stPool_malloc(stPool *pool) {
+    if (pool->freeObjects != NULL) {
+        void *object = pool->freeObjects;
+        pool->freeObjects = *(void **) object;
+        return object;
+    }
+    if (pool->next == pool->end) {
+        addSlab(pool);
+    }
+    void *object = pool->next;
+    pool->next += pool->objectSize;
+    return object;
+}
+
+void stPool_free(stPool *pool, void *object) {
+    *(void **) object = pool->freeObjects;
+    pool->freeObjects = object;
+}
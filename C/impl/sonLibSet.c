@@ -24,7 +24,7 @@ struct _stSetIterator {
 };
 
 uint32_t stSet_pointer(const void *k) {
-    return (uint32_t) (size_t) k; // Use the low order bits
+    return (uint32_t) stHash_mix64((uint64_t) (size_t) k); // Aligned pointers have their low bits zero, so mix them all in
 }
 static int stSet_equalKey(const void *key1, const void *key2) {
     return key1 == key2;
@@ -45,10 +45,7 @@ void stSet_destruct(stSet *set) {
     free(set);
 }
 void stSet_insert(stSet *set, void *key) {
-    if (stSet_search(set, key) != NULL) { // This will ensure we don't end up with duplicate keys..
-        stSet_remove(set, key);
-    }
-    stHash_insert(set->hash, key, key); 
+    stHash_insert(set->hash, key, key); // Replaces any equal key, so we don't end up with duplicate keys..
 }
 void *stSet_search(stSet *set, void *key) {
     return stHash_search(set->hash, key);
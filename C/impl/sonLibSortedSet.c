@@ -5,27 +5,59 @@
  */
 
 #include "sonLibGlobalsInternal.h"
-#include "avl.h"
 
 const char *SORTED_SET_EXCEPTION_ID = "SORTED_SET_EXCEPTION";
 
-////////////////////////////////////////////////
-////////////////////////////////////////////////
-////////////////////////////////////////////////
-//Functions on a sorted set and its iterator
-////////////////////////////////////////////////
-////////////////////////////////////////////////
-////////////////////////////////////////////////
+/*
+ * The sorted set is a B+ tree. The elements are kept in order in the leaves, which are linked into a list for
+ * iteration, and each internal node holds, for each of its children after the first, the least element under
+ * that child, to guide searches. A node holds up to NODE_SIZE elements or children, so a search makes a few
+ * binary searches of contiguous arrays rather than following a pointer per comparison.
+ *
+ * Every key in an internal node is an element of the set: when the least element of a subtree is removed or
+ * replaced, the key naming it is updated, so comparisons never see an element the set no longer holds.
+ *
+ * Internal nodes also count the elements under each child, so ranks and the kth element are found in one descent.
+ */
+
+#define NODE_SIZE 32 //the most elements of a leaf or children of an internal node
+#define MIN_NODE_SIZE (NODE_SIZE / 2) //the fewest, except at the root
+
+typedef struct _node { //the start of both leaves and internal nodes
+    int32_t size; //elements in a leaf, children in an internal node.
+    bool isLeaf;
+} Node;
+
+typedef struct _leaf {
+    int32_t size;
+    bool isLeaf;
+    struct _leaf *previous, *next;
+    void *elements[NODE_SIZE + 1]; //one spare, so a node can overflow before it is split.
+} Leaf;
+
+typedef struct _internal {
+    int32_t size;
+    bool isLeaf;
+    void *keys[NODE_SIZE]; //keys[i] is the least element under children[i + 1].
+    Node *children[NODE_SIZE + 1];
+    int64_t counts[NODE_SIZE + 1]; //counts[i] is the number of elements under children[i].
+} Internal;
 
 struct _stSortedSet {
-    struct avl_table *sortedSet;
+    Node *root;
+    int64_t size;
+    int (*compareFn)(const void *, const void *);
     void (*destructElementFn)(void *);
     int numberOfLiveIterators;  // number of currently allocated iterators
+    stPool *leafPool;
+    stPool *internalPool;
 };
 
 struct _stSortedSetIterator {
     stSortedSet *sortedSet;
-    struct avl_traverser traverser;
+    Leaf *leaf; //NULL when before the first or after the last element.
+    int32_t index;
+    bool inGap; //The element last returned was removed, so the iterator sits just before the element at leaf and index.
 };
 
 static int st_sortedSet_cmpFn( const void *key1, const void *key2 ) {
@@ -40,6 +72,339 @@ static void checkModifiable(stSortedSet *sortedSet) {
     }
 }
 
+/* check if the sorted set can be modified through the iterator, which must be the only one live */
+static void checkModifiableByIterator(stSortedSetIterator *iterator) {
+    if (iterator->sortedSet->numberOfLiveIterators > 1) {
+        stThrowNew(SORTED_SET_EXCEPTION_ID, "attempt to modify an stSortedSet through an iterator while other iterators are active");
+    }
+}
+
+/*
+ * The root of a set to which nothing has been inserted, shared by all such sets and never modified, so that an
+ * empty set allocates no nodes.
+ */
+static Leaf emptyRoot = { .size = 0, .isLeaf = 1 };
+
+static Leaf *constructLeaf(stSortedSet *sortedSet) {
+    Leaf *leaf = stPool_malloc(sortedSet->leafPool);
+    leaf->size = 0;
+    leaf->isLeaf = 1;
+    leaf->previous = NULL;
+    leaf->next = NULL;
+    return leaf;
+}
+
+static Internal *constructInternal(stSortedSet *sortedSet) {
+    Internal *internal = stPool_malloc(sortedSet->internalPool);
+    internal->size = 0;
+    internal->isLeaf = 0;
+    return internal;
+}
+
+static void destructNode(stSortedSet *sortedSet, Node *node) {
+    if (node != (Node *) &emptyRoot) {
+        stPool_free(node->isLeaf ? sortedSet->leafPool : sortedSet->internalPool, node);
+    }
+}
+
+/*
+ * Gives the set an empty tree, with new pools whose first slabs hold a single node, as many sets stay small.
+ */
+static void constructTree(stSortedSet *sortedSet) {
+    sortedSet->leafPool = stPool_construct2(sizeof(Leaf), 1);
+    sortedSet->internalPool = stPool_construct2(sizeof(Internal), 1);
+    sortedSet->root = (Node *) &emptyRoot;
+    sortedSet->size = 0;
+}
+
+/*
+ * Returns the number of the elements less than the object (lessThanOrEqual == 0) or less than or equal to it.
+ */
+static int32_t findIndex(stSortedSet *sortedSet, void **elements, int32_t length, const void *object, bool lessThanOrEqual) {
+    int32_t min = 0, max = length;
+    while (min < max) {
+        int32_t mid = (min + max) / 2;
+        int i = sortedSet->compareFn(elements[mid], object);
+        if (i < 0 || (i == 0 && lessThanOrEqual)) {
+            min = mid + 1;
+        } else {
+            max = mid;
+        }
+    }
+    return min;
+}
+
+/*
+ * The child of an internal node whose subtree would hold the object.
+ */
+static int32_t findChild(stSortedSet *sortedSet, Internal *internal, const void *object) {
+    return findIndex(sortedSet, internal->keys, internal->size - 1, object, 1);
+}
+
+static Leaf *findLeaf(stSortedSet *sortedSet, const void *object) {
+    Node *node = sortedSet->root;
+    while (!node->isLeaf) {
+        Internal *internal = (Internal *) node;
+        node = internal->children[findChild(sortedSet, internal, object)];
+    }
+    return (Leaf *) node;
+}
+
+static Leaf *getFirstLeaf(Node *node) {
+    while (!node->isLeaf) {
+        node = ((Internal *) node)->children[0];
+    }
+    return (Leaf *) node;
+}
+
+static Leaf *getLastLeaf(Node *node) {
+    while (!node->isLeaf) {
+        node = ((Internal *) node)->children[node->size - 1];
+    }
+    return (Leaf *) node;
+}
+
+static void insertAt(void **array, int32_t length, int32_t i, void *item) {
+    memmove(array + i + 1, array + i, (length - i) * sizeof(void *));
+    array[i] = item;
+}
+
+static void removeAt(void **array, int32_t length, int32_t i) {
+    memmove(array + i, array + i + 1, (length - i - 1) * sizeof(void *));
+}
+
+static void insertCountAt(int64_t *counts, int32_t length, int32_t i, int64_t count) {
+    memmove(counts + i + 1, counts + i, (length - i) * sizeof(int64_t));
+    counts[i] = count;
+}
+
+static void removeCountAt(int64_t *counts, int32_t length, int32_t i) {
+    memmove(counts + i, counts + i + 1, (length - i - 1) * sizeof(int64_t));
+}
+
+/*
+ * The number of elements under the node.
+ */
+static int64_t getCount(Node *node) {
+    if (node->isLeaf) {
+        return node->size;
+    }
+    int64_t count = 0;
+    for (int32_t i = 0; i < node->size; i++) {
+        count += ((Internal *) node)->counts[i];
+    }
+    return count;
+}
+
+////////////////////////////////////////////////
+//Insertion
+////////////////////////////////////////////////
+
+/*
+ * Splits a leaf or internal node that has overflowed, returning the new right half and setting key to the least
+ * element under it.
+ */
+static Node *splitNode(stSortedSet *sortedSet, Node *node, void **key) {
+    int32_t leftSize = node->size / 2, rightSize = node->size - leftSize;
+    if (node->isLeaf) {
+        Leaf *leaf = (Leaf *) node, *right = constructLeaf(sortedSet);
+        memcpy(right->elements, leaf->elements + leftSize, rightSize * sizeof(void *));
+        right->size = rightSize;
+        leaf->size = leftSize;
+        right->next = leaf->next;
+        if (right->next != NULL) {
+            right->next->previous = right;
+        }
+        right->previous = leaf;
+        leaf->next = right;
+        *key = right->elements[0];
+        return (Node *) right;
+    }
+    Internal *internal = (Internal *) node, *right = constructInternal(sortedSet);
+    memcpy(right->children, internal->children + leftSize, rightSize * sizeof(Node *));
+    memcpy(right->counts, internal->counts + leftSize, rightSize * sizeof(int64_t));
+    memcpy(right->keys, internal->keys + leftSize, (rightSize - 1) * sizeof(void *));
+    *key = internal->keys[leftSize - 1];
+    right->size = rightSize;
+    internal->size = leftSize;
+    return (Node *) right;
+}
+
+/*
+ * Inserts the object under the node. If an equal element was present it is replaced, and returned in replaced.
+ * If the node overflows it is split, and the new right half is returned, with key set to the least element under it.
+ */
+static Node *insertUnder(stSortedSet *sortedSet, Node *node, void *object, void **replaced, void **key) {
+    if (node->isLeaf) {
+        Leaf *leaf = (Leaf *) node;
+        int32_t i = findIndex(sortedSet, leaf->elements, leaf->size, object, 0);
+        if (i < leaf->size && sortedSet->compareFn(leaf->elements[i], object) == 0) {
+            *replaced = leaf->elements[i];
+            leaf->elements[i] = object;
+            return NULL;
+        }
+        insertAt(leaf->elements, leaf->size++, i, object);
+        sortedSet->size++;
+    } else {
+        Internal *internal = (Internal *) node;
+        int32_t i = findChild(sortedSet, internal, object);
+        void *childKey;
+        Node *right = insertUnder(sortedSet, internal->children[i], object, replaced, &childKey);
+        if (*replaced != NULL) {
+            if (i > 0 && internal->keys[i - 1] == *replaced) {
+                internal->keys[i - 1] = object;
+            }
+        } else {
+            internal->counts[i]++;
+        }
+        if (right == NULL) {
+            return NULL;
+        }
+        insertAt(internal->keys, internal->size - 1, i, childKey);
+        internal->counts[i] = getCount(internal->children[i]);
+        insertCountAt(internal->counts, internal->size, i + 1, getCount(right));
+        insertAt((void **) internal->children, internal->size++, i + 1, right);
+    }
+    return node->size > NODE_SIZE ? splitNode(sortedSet, node, key) : NULL;
+}
+
+////////////////////////////////////////////////
+//Removal
+////////////////////////////////////////////////
+
+/*
+ * Moves an element or child from the child i - 1 of the internal node to the front of child i.
+ */
+static void shiftRight(Internal *internal, int32_t i) {
+    Node *left = internal->children[i - 1], *right = internal->children[i];
+    if (right->isLeaf) {
+        Leaf *leftLeaf = (Leaf *) left, *rightLeaf = (Leaf *) right;
+        insertAt(rightLeaf->elements, rightLeaf->size++, 0, leftLeaf->elements[--leftLeaf->size]);
+        internal->keys[i - 1] = rightLeaf->elements[0];
+        internal->counts[i - 1]--;
+        internal->counts[i]++;
+    } else {
+        Internal *leftInternal = (Internal *) left, *rightInternal = (Internal *) right;
+        int64_t count = leftInternal->counts[leftInternal->size - 1];
+        insertAt(rightInternal->keys, rightInternal->size - 1, 0, internal->keys[i - 1]);
+        insertCountAt(rightInternal->counts, rightInternal->size, 0, count);
+        insertAt((void **) rightInternal->children, rightInternal->size++, 0, leftInternal->children[--leftInternal->size]);
+        internal->keys[i - 1] = leftInternal->keys[leftInternal->size - 1];
+        internal->counts[i - 1] -= count;
+        internal->counts[i] += count;
+    }
+}
+
+/*
+ * Moves an element or child from the front of child i of the internal node to the back of child i - 1.
+ */
+static void shiftLeft(Internal *internal, int32_t i) {
+    Node *left = internal->children[i - 1], *right = internal->children[i];
+    if (right->isLeaf) {
+        Leaf *leftLeaf = (Leaf *) left, *rightLeaf = (Leaf *) right;
+        leftLeaf->elements[leftLeaf->size++] = rightLeaf->elements[0];
+        removeAt(rightLeaf->elements, rightLeaf->size--, 0);
+        internal->keys[i - 1] = rightLeaf->elements[0];
+        internal->counts[i - 1]++;
+        internal->counts[i]--;
+    } else {
+        Internal *leftInternal = (Internal *) left, *rightInternal = (Internal *) right;
+        int64_t count = rightInternal->counts[0];
+        leftInternal->keys[leftInternal->size - 1] = internal->keys[i - 1];
+        leftInternal->counts[leftInternal->size] = count;
+        leftInternal->children[leftInternal->size++] = rightInternal->children[0];
+        internal->keys[i - 1] = rightInternal->keys[0];
+        removeAt(rightInternal->keys, rightInternal->size - 1, 0);
+        removeCountAt(rightInternal->counts, rightInternal->size, 0);
+        removeAt((void **) rightInternal->children, rightInternal->size--, 0);
+        internal->counts[i - 1] += count;
+        internal->counts[i] -= count;
+    }
+}
+
+/*
+ * Merges child i of the internal node into child i - 1.
+ */
+static void mergeChildren(stSortedSet *sortedSet, Internal *internal, int32_t i) {
+    Node *left = internal->children[i - 1], *right = internal->children[i];
+    if (right->isLeaf) {
+        Leaf *leftLeaf = (Leaf *) left, *rightLeaf = (Leaf *) right;
+        memcpy(leftLeaf->elements + leftLeaf->size, rightLeaf->elements, rightLeaf->size * sizeof(void *));
+        leftLeaf->size += rightLeaf->size;
+        leftLeaf->next = rightLeaf->next;
+        if (leftLeaf->next != NULL) {
+            leftLeaf->next->previous = leftLeaf;
+        }
+    } else {
+        Internal *leftInternal = (Internal *) left, *rightInternal = (Internal *) right;
+        leftInternal->keys[leftInternal->size - 1] = internal->keys[i - 1];
+        memcpy(leftInternal->keys + leftInternal->size, rightInternal->keys, (rightInternal->size - 1) * sizeof(void *));
+        memcpy(leftInternal->children + leftInternal->size, rightInternal->children, rightInternal->size * sizeof(Node *));
+        memcpy(leftInternal->counts + leftInternal->size, rightInternal->counts, rightInternal->size * sizeof(int64_t));
+        leftInternal->size += rightInternal->size;
+    }
+    internal->counts[i - 1] += internal->counts[i];
+    removeCountAt(internal->counts, internal->size, i);
+    removeAt(internal->keys, internal->size - 1, i - 1);
+    removeAt((void **) internal->children, internal->size--, i);
+    destructNode(sortedSet, right);
+}
+
+/*
+ * Brings child i of the internal node, which has too few elements or children, back up to size.
+ */
+static void rebalanceChild(stSortedSet *sortedSet, Internal *internal, int32_t i) {
+    if (i > 0 && internal->children[i - 1]->size > MIN_NODE_SIZE) {
+        shiftRight(internal, i);
+    } else if (i + 1 < internal->size && internal->children[i + 1]->size > MIN_NODE_SIZE) {
+        shiftLeft(internal, i + 1);
+    } else if (i > 0) {
+        mergeChildren(sortedSet, internal, i);
+    } else {
+        mergeChildren(sortedSet, internal, i + 1);
+    }
+}
+
+/*
+ * Removes the element equal to the object from under the node, returning it, or NULL if there is none.
+ */
+static void *removeUnder(stSortedSet *sortedSet, Node *node, const void *object) {
+    if (node->isLeaf) {
+        Leaf *leaf = (Leaf *) node;
+        int32_t i = findIndex(sortedSet, leaf->elements, leaf->size, object, 0);
+        if (i == leaf->size || sortedSet->compareFn(leaf->elements[i], object) != 0) {
+            return NULL;
+        }
+        void *removed = leaf->elements[i];
+        removeAt(leaf->elements, leaf->size--, i);
+        sortedSet->size--;
+        return removed;
+    }
+    Internal *internal = (Internal *) node;
+    int32_t i = findChild(sortedSet, internal, object);
+    Node *child = internal->children[i];
+    void *removed = removeUnder(sortedSet, child, object);
+    if (removed == NULL) {
+        return NULL;
+    }
+    internal->counts[i]--;
+    if (i > 0 && internal->keys[i - 1] == removed) { //The key named the removed element
+        internal->keys[i - 1] = getFirstLeaf(child)->elements[0];
+    }
+    if (child->size < MIN_NODE_SIZE) {
+        rebalanceChild(sortedSet, internal, i);
+    }
+    return removed;
+}
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Functions on a sorted set and its iterator
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
 stSortedSet *stSortedSet_construct(void) {
     return stSortedSet_construct3(st_sortedSet_cmpFn, NULL);
 }
@@ -48,35 +413,144 @@ stSortedSet *stSortedSet_construct2(void (*destructElementFn)(void *)) {
     return stSortedSet_construct3(st_sortedSet_cmpFn, destructElementFn);
 }
 
-struct _stSortedSet_construct3Fn {
-    int (*compareFn)(const void *, const void *);
-};
-
-static int st_sortedSet_construct3P(const void *a, const void *b, struct _stSortedSet_construct3Fn *c) { //int (*cmpFn)(const void *, const void *)) {
-    return c->compareFn(a, b);
-}
-
 stSortedSet *stSortedSet_construct3(int (*compareFn)(const void *, const void *),
                                       void (*destructElementFn)(void *)) {
     stSortedSet *sortedSet = st_malloc(sizeof(stSortedSet));
-    struct _stSortedSet_construct3Fn *i = st_malloc(sizeof(struct _stSortedSet_construct3Fn));
-    i->compareFn = compareFn == NULL ? st_sortedSet_cmpFn : compareFn; //this is a total hack to make the function pass ISO C compatible.
-    sortedSet->sortedSet = avl_create((int (*)(const void *, const void *, void *))st_sortedSet_construct3P, i, NULL);
+    sortedSet->compareFn = compareFn == NULL ? st_sortedSet_cmpFn : compareFn;
     sortedSet->destructElementFn = destructElementFn;
     sortedSet->numberOfLiveIterators = 0;
+    constructTree(sortedSet);
     return sortedSet;
 }
 
-void stSortedSet_setDestructor(stSortedSet *set, void (*destructElement)(void *)) {
-    set->destructElementFn = destructElement;
+/*
+ * Builds the tree of an empty set from elements in strictly increasing order, a level at a time from the leaves up.
+ * The nodes of each level share out the nodes below evenly, so all are at least half full.
+ */
+static void buildTree(stSortedSet *sortedSet, void **elements, int64_t length) {
+    if (length == 0) {
+        return;
+    }
+    destructNode(sortedSet, sortedSet->root);
+    int64_t nodeNumber = (length + NODE_SIZE - 1) / NODE_SIZE;
+    Node **nodes = st_malloc(nodeNumber * sizeof(Node *));
+    void **mins = st_malloc(nodeNumber * sizeof(void *)); //the least element under each node
+    int64_t *counts = st_malloc(nodeNumber * sizeof(int64_t)); //the number of elements under each node
+    Leaf *previous = NULL;
+    for (int64_t i = 0; i < nodeNumber; i++) {
+        int64_t start = length * i / nodeNumber, end = length * (i + 1) / nodeNumber;
+        Leaf *leaf = constructLeaf(sortedSet);
+        memcpy(leaf->elements, elements + start, (end - start) * sizeof(void *));
+        leaf->size = end - start;
+        leaf->previous = previous;
+        if (previous != NULL) {
+            previous->next = leaf;
+        }
+        previous = leaf;
+        nodes[i] = (Node *) leaf;
+        mins[i] = elements[start];
+        counts[i] = end - start;
+    }
+    while (nodeNumber > 1) {
+        int64_t parentNumber = (nodeNumber + NODE_SIZE - 1) / NODE_SIZE;
+        for (int64_t i = 0; i < parentNumber; i++) { //Parent i only uses nodes at or after i, so can replace node i
+            int64_t start = nodeNumber * i / parentNumber, end = nodeNumber * (i + 1) / parentNumber;
+            Internal *internal = constructInternal(sortedSet);
+            memcpy(internal->children, nodes + start, (end - start) * sizeof(Node *));
+            memcpy(internal->keys, mins + start + 1, (end - start - 1) * sizeof(void *));
+            memcpy(internal->counts, counts + start, (end - start) * sizeof(int64_t));
+            internal->size = end - start;
+            nodes[i] = (Node *) internal;
+            mins[i] = mins[start];
+            counts[i] = getCount((Node *) internal);
+        }
+        nodeNumber = parentNumber;
+    }
+    sortedSet->root = nodes[0];
+    sortedSet->size = length;
+    free(nodes);
+    free(mins);
+    free(counts);
+}
+
+static bool isStrictlyIncreasing(stSortedSet *sortedSet, void **elements, int64_t length) {
+    for (int64_t i = 1; i < length; i++) {
+        if (sortedSet->compareFn(elements[i - 1], elements[i]) >= 0) {
+            return 0;
+        }
+    }
+    return 1;
 }
 
-static struct _stSortedSet_construct3Fn *stSortedSet_getComparator(stSortedSet *sortedSet) {
-    return (struct _stSortedSet_construct3Fn *)sortedSet->sortedSet->avl_param;
+/*
+ * A stable merge sort, so that of equal elements the last in the input stays last.
+ */
+static void mergeSort(stSortedSet *sortedSet, void **elements, void **buffer, int64_t length) {
+    if (length < 2) {
+        return;
+    }
+    int64_t mid = length / 2;
+    mergeSort(sortedSet, elements, buffer, mid);
+    mergeSort(sortedSet, elements + mid, buffer, length - mid);
+    memcpy(buffer, elements, mid * sizeof(void *));
+    int64_t i = 0, j = mid, k = 0;
+    while (i < mid && j < length) {
+        elements[k++] = sortedSet->compareFn(elements[j], buffer[i]) < 0 ? elements[j++] : buffer[i++];
+    }
+    memcpy(elements + k, buffer + i, (mid - i) * sizeof(void *));
+}
+
+static void **getElements(stList *list) {
+    void **elements = st_malloc((stList_length(list) + 1) * sizeof(void *));
+    for (int64_t i = 0; i < stList_length(list); i++) {
+        elements[i] = stList_get(list, i);
+    }
+    return elements;
+}
+
+stSortedSet *stSortedSet_constructFromSortedList(stList *list, int (*compareFn)(const void *, const void *),
+                                                 void (*destructElementFn)(void *)) {
+    stSortedSet *sortedSet = stSortedSet_construct3(compareFn, destructElementFn);
+    void **elements = getElements(list);
+    if (!isStrictlyIncreasing(sortedSet, elements, stList_length(list))) {
+        free(elements);
+        stSortedSet_setDestructor(sortedSet, NULL);
+        stSortedSet_destruct(sortedSet);
+        stThrowNew(SORTED_SET_EXCEPTION_ID, "Tried to build a sorted set from a list that is not sorted or has duplicates");
+    }
+    buildTree(sortedSet, elements, stList_length(list));
+    free(elements);
+    return sortedSet;
+}
+
+stSortedSet *stSortedSet_constructFromList(stList *list, int (*compareFn)(const void *, const void *),
+                                           void (*destructElementFn)(void *)) {
+    stSortedSet *sortedSet = stSortedSet_construct3(compareFn, destructElementFn);
+    int64_t length = stList_length(list);
+    void **elements = getElements(list);
+    if (!isStrictlyIncreasing(sortedSet, elements, length)) {
+        void **buffer = st_malloc((length / 2 + 1) * sizeof(void *));
+        mergeSort(sortedSet, elements, buffer, length);
+        free(buffer);
+        int64_t j = 0;
+        for (int64_t i = 0; i < length; i++) { //Keep the last of each run of equal elements
+            if (i + 1 == length || sortedSet->compareFn(elements[i], elements[i + 1]) != 0) {
+                elements[j++] = elements[i];
+            }
+        }
+        length = j;
+    }
+    buildTree(sortedSet, elements, length);
+    free(elements);
+    return sortedSet;
+}
+
+void stSortedSet_setDestructor(stSortedSet *set, void (*destructElement)(void *)) {
+    set->destructElementFn = destructElement;
 }
 
 stSortedSet *stSortedSet_copyConstruct(stSortedSet *sortedSet, void (*destructElementFn)(void *)) {
-    stSortedSet *sortedSet2 = stSortedSet_construct3(stSortedSet_getComparator(sortedSet)->compareFn, destructElementFn);
+    stSortedSet *sortedSet2 = stSortedSet_construct3(sortedSet->compareFn, destructElementFn);
     stSortedSetIterator *it = stSortedSet_getIterator(sortedSet);
     void *o;
     while((o = stSortedSet_getNext(it)) != NULL) {
@@ -86,12 +560,6 @@ stSortedSet *stSortedSet_copyConstruct(stSortedSet *sortedSet, void (*destructEl
     return sortedSet2;
 }
 
-static void (*st_sortedSet_destruct_destructElementFn)(void *);
-static void st_sortedSet_destructP(void *a, void *b) {
-    assert(b != NULL);
-    st_sortedSet_destruct_destructElementFn(a);
-}
-
 void stSortedSet_destruct(stSortedSet *sortedSet) {
 #if 0 // FIXME
     // this breaks the tests, which leak iterators.  Need to revisit with
@@ -99,84 +567,173 @@ void stSortedSet_destruct(stSortedSet *sortedSet) {
     // this is for an urgent bug.
     checkModifiable(sortedSet);
 #endif
-    void *a = sortedSet->sortedSet->avl_param;
     if(sortedSet->destructElementFn != NULL) {
-        st_sortedSet_destruct_destructElementFn = sortedSet->destructElementFn;
-        avl_destroy(sortedSet->sortedSet, (void (*)(void *, void *))st_sortedSet_destructP);
-    }
-    else {
-        avl_destroy(sortedSet->sortedSet, NULL);
+        for (Leaf *leaf = getFirstLeaf(sortedSet->root); leaf != NULL; leaf = leaf->next) {
+            for (int32_t i = 0; i < leaf->size; i++) {
+                sortedSet->destructElementFn(leaf->elements[i]);
+            }
+        }
     }
-    free(a);
+    stPool_destruct(sortedSet->leafPool); //Frees the nodes, without walking the tree
+    stPool_destruct(sortedSet->internalPool);
     free(sortedSet);
 }
 
-void stSortedSet_insert(stSortedSet *sortedSet, void *object) {
-    checkModifiable(sortedSet);
-    // FIXME: two passes, modify avl code.
-    if(stSortedSet_search(sortedSet, object) != NULL) {
-        avl_replace(sortedSet->sortedSet, object);
+static void insertElement(stSortedSet *sortedSet, void *object) {
+    if (sortedSet->root == (Node *) &emptyRoot) { //The first insert, so allocate the root
+        sortedSet->root = (Node *) constructLeaf(sortedSet);
     }
-    else {
-        avl_insert(sortedSet->sortedSet, object);
+    void *replaced = NULL, *key;
+    Node *right = insertUnder(sortedSet, sortedSet->root, object, &replaced, &key);
+    if (right != NULL) { //The root split, so the tree grows a level
+        Internal *root = constructInternal(sortedSet);
+        root->children[0] = sortedSet->root;
+        root->children[1] = right;
+        root->keys[0] = key;
+        root->counts[0] = getCount(root->children[0]);
+        root->counts[1] = getCount(right);
+        root->size = 2;
+        sortedSet->root = (Node *) root;
     }
 }
 
+void stSortedSet_insert(stSortedSet *sortedSet, void *object) {
+    checkModifiable(sortedSet);
+    insertElement(sortedSet, object);
+}
+
 void *stSortedSet_search(stSortedSet *sortedSet, void *object) {
-    return avl_find(sortedSet->sortedSet, object);
+    Leaf *leaf = findLeaf(sortedSet, object);
+    int32_t i = findIndex(sortedSet, leaf->elements, leaf->size, object, 0);
+    return i < leaf->size && sortedSet->compareFn(leaf->elements[i], object) == 0 ? leaf->elements[i] : NULL;
+}
+
+/*
+ * Returns the greatest element less than (or equal to) the object.
+ */
+static void *searchBefore(stSortedSet *sortedSet, void *object, bool orEqual) {
+    Leaf *leaf = findLeaf(sortedSet, object);
+    int32_t i = findIndex(sortedSet, leaf->elements, leaf->size, object, orEqual);
+    if (i > 0) {
+        return leaf->elements[i - 1];
+    }
+    return leaf->previous != NULL ? leaf->previous->elements[leaf->previous->size - 1] : NULL;
+}
+
+/*
+ * Returns the least element greater than (or equal to) the object.
+ */
+static void *searchAfter(stSortedSet *sortedSet, void *object, bool orEqual) {
+    Leaf *leaf = findLeaf(sortedSet, object);
+    int32_t i = findIndex(sortedSet, leaf->elements, leaf->size, object, !orEqual);
+    if (i < leaf->size) {
+        return leaf->elements[i];
+    }
+    return leaf->next != NULL ? leaf->next->elements[0] : NULL;
 }
 
 void *stSortedSet_searchLessThanOrEqual(stSortedSet *sortedSet, void *object) {
-    return avl_find_lessThanOrEqual(sortedSet->sortedSet, object);
+    return searchBefore(sortedSet, object, 1);
 }
 
 void *stSortedSet_searchLessThan(stSortedSet *sortedSet, void *object) {
-    return avl_find_lessThan(sortedSet->sortedSet, object);
+    return searchBefore(sortedSet, object, 0);
 }
 
 void *stSortedSet_searchGreaterThanOrEqual(stSortedSet *sortedSet, void *object) {
-    return avl_find_greaterThanOrEqual(sortedSet->sortedSet, object);
+    return searchAfter(sortedSet, object, 1);
 }
 
 void *stSortedSet_searchGreaterThan(stSortedSet *sortedSet, void *object) {
-    return avl_find_greaterThan(sortedSet->sortedSet, object);
+    return searchAfter(sortedSet, object, 0);
+}
+
+static void removeElement(stSortedSet *sortedSet, void *object) {
+    removeUnder(sortedSet, sortedSet->root, object);
+    if (!sortedSet->root->isLeaf && sortedSet->root->size == 1) { //The tree shrinks a level
+        Node *root = sortedSet->root;
+        sortedSet->root = ((Internal *) root)->children[0];
+        destructNode(sortedSet, root);
+    }
 }
 
 void stSortedSet_remove(stSortedSet *sortedSet, void *object) {
     checkModifiable(sortedSet);
-    avl_delete(sortedSet->sortedSet, object);
+    removeElement(sortedSet, object);
 }
 
 int32_t stSortedSet_size(stSortedSet *sortedSet) {
-    return avl_count(sortedSet->sortedSet);
+    return sortedSet->size;
+}
+
+int64_t stSortedSet_getRank(stSortedSet *sortedSet, void *object) {
+    int64_t rank = 0;
+    Node *node = sortedSet->root;
+    while (!node->isLeaf) {
+        Internal *internal = (Internal *) node;
+        int32_t i = findChild(sortedSet, internal, object);
+        for (int32_t j = 0; j < i; j++) {
+            rank += internal->counts[j];
+        }
+        node = internal->children[i];
+    }
+    Leaf *leaf = (Leaf *) node;
+    return rank + findIndex(sortedSet, leaf->elements, leaf->size, object, 0);
+}
+
+void *stSortedSet_getKth(stSortedSet *sortedSet, int64_t k) {
+    if (k < 0 || k >= sortedSet->size) {
+        return NULL;
+    }
+    Node *node = sortedSet->root;
+    while (!node->isLeaf) {
+        Internal *internal = (Internal *) node;
+        int32_t i = 0;
+        while (k >= internal->counts[i]) {
+            k -= internal->counts[i++];
+        }
+        node = internal->children[i];
+    }
+    return ((Leaf *) node)->elements[k];
+}
+
+int64_t stSortedSet_getCountInRange(stSortedSet *sortedSet, void *lowerBound, void *upperBound) {
+    if (sortedSet->compareFn(lowerBound, upperBound) >= 0) {
+        return 0;
+    }
+    return stSortedSet_getRank(sortedSet, upperBound) - stSortedSet_getRank(sortedSet, lowerBound);
 }
 
 void *stSortedSet_getFirst(stSortedSet *items) {
-    struct avl_traverser traverser;
-    avl_t_init(&traverser, items->sortedSet);
-    return avl_t_first(&traverser, items->sortedSet);
+    Leaf *leaf = getFirstLeaf(items->root);
+    return leaf->size > 0 ? leaf->elements[0] : NULL;
 }
 
 void *stSortedSet_getLast(stSortedSet *items) {
-    struct avl_traverser traverser;
-    avl_t_init(&traverser, items->sortedSet);
-    return avl_t_last(&traverser, items->sortedSet);
+    Leaf *leaf = getLastLeaf(items->root);
+    return leaf->size > 0 ? leaf->elements[leaf->size - 1] : NULL;
 }
 
 stSortedSetIterator *stSortedSet_getIterator(stSortedSet *items) {
     stSortedSetIterator *iterator;
     iterator = st_malloc(sizeof(stSortedSetIterator));
     iterator->sortedSet = items;
-    avl_t_init(&iterator->traverser, items->sortedSet);
+    iterator->leaf = NULL;
+    iterator->index = 0;
+    iterator->inGap = 0;
     items->numberOfLiveIterators++;
     return iterator;
 }
 
 stSortedSetIterator *stSortedSet_getIteratorFrom(stSortedSet *items, void *item) {
-    stSortedSetIterator *iterator = stSortedSet_getIterator(items);
-    if(avl_t_find(&iterator->traverser, items->sortedSet, item) == NULL) {
+    Leaf *leaf = findLeaf(items, item);
+    int32_t i = findIndex(items, leaf->elements, leaf->size, item, 0);
+    if(i == leaf->size || items->compareFn(leaf->elements[i], item) != 0) {
         stThrowNew(SORTED_SET_EXCEPTION_ID, "Tried to create an iterator with an item that is not in the list of items");
     }
+    stSortedSetIterator *iterator = stSortedSet_getIterator(items);
+    iterator->leaf = leaf;
+    iterator->index = i;
     stSortedSet_getPrevious(iterator);
     return iterator;
 }
@@ -189,7 +746,26 @@ void stSortedSet_destructIterator(stSortedSetIterator *iterator) {
 }
 
 void *stSortedSet_getNext(stSortedSetIterator *iterator) {
-    return avl_t_next(&iterator->traverser);
+    /*
+     * Like the traversers of libavl, which this replaced, stepping off either end returns NULL and leaves the
+     * iterator before the first and after the last element, so stepping again wraps around.
+     */
+    if (iterator->inGap) {
+        iterator->inGap = 0;
+        return iterator->leaf != NULL ? iterator->leaf->elements[iterator->index] : NULL;
+    }
+    if (iterator->leaf == NULL) {
+        iterator->leaf = getFirstLeaf(iterator->sortedSet->root);
+        iterator->index = 0;
+    } else if (++iterator->index == iterator->leaf->size) {
+        iterator->leaf = iterator->leaf->next;
+        iterator->index = 0;
+    }
+    if (iterator->leaf == NULL || iterator->leaf->size == 0) {
+        iterator->leaf = NULL;
+        return NULL;
+    }
+    return iterator->leaf->elements[iterator->index];
 }
 
 stSortedSetIterator *stSortedSet_copyIterator(stSortedSetIterator *iterator) {
@@ -197,16 +773,60 @@ stSortedSetIterator *stSortedSet_copyIterator(stSortedSetIterator *iterator) {
     copyIterator = st_malloc(sizeof(stSortedSetIterator));
     copyIterator->sortedSet = iterator->sortedSet;
     copyIterator->sortedSet->numberOfLiveIterators++;
-    avl_t_copy(&copyIterator->traverser, &iterator->traverser);
+    copyIterator->leaf = iterator->leaf;
+    copyIterator->index = iterator->index;
+    copyIterator->inGap = iterator->inGap;
     return copyIterator;
 }
 
 void *stSortedSet_getPrevious(stSortedSetIterator *iterator) {
-    return avl_t_prev(&iterator->traverser);
+    iterator->inGap = 0; //Stepping back from the gap is stepping back from the element after it
+    if (iterator->leaf == NULL) {
+        iterator->leaf = getLastLeaf(iterator->sortedSet->root);
+        iterator->index = iterator->leaf->size - 1;
+    } else if (--iterator->index < 0) {
+        iterator->leaf = iterator->leaf->previous;
+        iterator->index = iterator->leaf != NULL ? iterator->leaf->size - 1 : 0;
+    }
+    if (iterator->leaf == NULL || iterator->leaf->size == 0) {
+        iterator->leaf = NULL;
+        return NULL;
+    }
+    return iterator->leaf->elements[iterator->index];
+}
+
+void *stSortedSet_iteratorRemove(stSortedSetIterator *iterator) {
+    stSortedSet *sortedSet = iterator->sortedSet;
+    checkModifiableByIterator(iterator);
+    if (iterator->leaf == NULL || iterator->inGap) {
+        stThrowNew(SORTED_SET_EXCEPTION_ID, "Tried to remove through an iterator that is not at an element");
+    }
+    void *object = iterator->leaf->elements[iterator->index];
+    removeElement(sortedSet, object);
+    //Rebalancing may have moved elements between leaves, so find the element that followed the removed one afresh
+    Leaf *leaf = findLeaf(sortedSet, object);
+    int32_t i = findIndex(sortedSet, leaf->elements, leaf->size, object, 0);
+    if (i == leaf->size) {
+        leaf = leaf->next;
+        i = 0;
+    }
+    iterator->leaf = leaf;
+    iterator->index = i;
+    iterator->inGap = 1;
+    return object;
+}
+
+void stSortedSet_iteratorInsertAndReposition(stSortedSetIterator *iterator, void *object) {
+    stSortedSet *sortedSet = iterator->sortedSet;
+    checkModifiableByIterator(iterator);
+    insertElement(sortedSet, object);
+    iterator->leaf = findLeaf(sortedSet, object);
+    iterator->index = findIndex(sortedSet, iterator->leaf->elements, iterator->leaf->size, object, 0);
+    iterator->inGap = 0;
 }
 
 static int stSortedSet_comparatorsEqual(stSortedSet *sortedSet1, stSortedSet *sortedSet2) {
-    return stSortedSet_getComparator(sortedSet1)->compareFn == stSortedSet_getComparator(sortedSet2)->compareFn;
+    return sortedSet1->compareFn == sortedSet2->compareFn;
 }
 
 int stSortedSet_equals(stSortedSet *sortedSet1, stSortedSet *sortedSet2) {
@@ -216,7 +836,7 @@ int stSortedSet_equals(stSortedSet *sortedSet1, stSortedSet *sortedSet2) {
     if(!stSortedSet_comparatorsEqual(sortedSet1, sortedSet2)) {
         return 0;
     }
-    int (*cmpFn)(const void *, const void *) = stSortedSet_getComparator(sortedSet1)->compareFn;
+    int (*cmpFn)(const void *, const void *) = sortedSet1->compareFn;
 
     stSortedSetIterator *it1 = stSortedSet_getIterator(sortedSet1);
     stSortedSetIterator *it2 = stSortedSet_getIterator(sortedSet2);
@@ -248,64 +868,117 @@ stList *stSortedSet_getList(stSortedSet *sortedSet) {
     return list;
 }
 
-stSortedSet *stSortedSet_getUnion(stSortedSet *sortedSet1, stSortedSet *sortedSet2) {
+typedef enum _setOperation {
+    setUnion, setIntersection, setDifference
+} SetOperation;
+
+static void checkComparatorsEqual(stSortedSet *sortedSet1, stSortedSet *sortedSet2, const char *operationName) {
     if(!stSortedSet_comparatorsEqual(sortedSet1, sortedSet2)) {
-        stThrowNew(SORTED_SET_EXCEPTION_ID, "Comparators are not equal for creating the union of two sorted sets");
+        stThrowNew(SORTED_SET_EXCEPTION_ID, "Comparators are not equal for creating the %s of two sorted sets", operationName);
     }
-    stSortedSet *sortedSet3 = stSortedSet_construct3(stSortedSet_getComparator(sortedSet1)->compareFn, NULL);
+}
 
-    //Add those from sortedSet1
-    stSortedSetIterator *it= stSortedSet_getIterator(sortedSet1);
-    void *o;
-    while((o = stSortedSet_getNext(it)) != NULL) {
-        stSortedSet_insert(sortedSet3, o);
+/*
+ * Steps through the leaves to the next element, setting leaf to NULL at the end.
+ */
+static void advance(Leaf **leaf, int32_t *index) {
+    if (++*index == (*leaf)->size) {
+        *leaf = (*leaf)->next;
+        *index = 0;
     }
-    stSortedSet_destructIterator(it);
+}
 
-    //Add those from sortedSet2
-    it= stSortedSet_getIterator(sortedSet2);
-    while((o = stSortedSet_getNext(it)) != NULL) {
-        stSortedSet_insert(sortedSet3, o);
+/*
+ * Merges the elements of the two sets into the array, which must have room for both, returning the number written.
+ * Of equal elements in the union, the one from the first set is kept if keepFirst is non-zero, else the one from
+ * the second.
+ */
+static int64_t mergeSets(stSortedSet *sortedSet1, stSortedSet *sortedSet2, SetOperation operation, bool keepFirst,
+        void **merged) {
+    Leaf *leaf1 = getFirstLeaf(sortedSet1->root), *leaf2 = getFirstLeaf(sortedSet2->root);
+    leaf1 = leaf1->size > 0 ? leaf1 : NULL; //Only the root leaf of an empty set is empty
+    leaf2 = leaf2->size > 0 ? leaf2 : NULL;
+    int32_t index1 = 0, index2 = 0;
+    int64_t length = 0;
+    while (leaf1 != NULL && leaf2 != NULL) {
+        void *o1 = leaf1->elements[index1], *o2 = leaf2->elements[index2];
+        int i = sortedSet1->compareFn(o1, o2);
+        if (i < 0) {
+            if (operation != setIntersection) {
+                merged[length++] = o1;
+            }
+            advance(&leaf1, &index1);
+        } else if (i > 0) {
+            if (operation == setUnion) {
+                merged[length++] = o2;
+            }
+            advance(&leaf2, &index2);
+        } else {
+            if (operation == setUnion) {
+                merged[length++] = keepFirst ? o1 : o2;
+            } else if (operation == setIntersection) {
+                merged[length++] = o1;
+            }
+            advance(&leaf1, &index1);
+            advance(&leaf2, &index2);
+        }
     }
-    stSortedSet_destructIterator(it);
+    for (; leaf1 != NULL && operation != setIntersection; advance(&leaf1, &index1)) {
+        merged[length++] = leaf1->elements[index1];
+    }
+    for (; leaf2 != NULL && operation == setUnion; advance(&leaf2, &index2)) {
+        merged[length++] = leaf2->elements[index2];
+    }
+    return length;
+}
 
+static stSortedSet *getMerged(stSortedSet *sortedSet1, stSortedSet *sortedSet2, SetOperation operation) {
+    void **merged = st_malloc((sortedSet1->size + sortedSet2->size + 1) * sizeof(void *));
+    int64_t length = mergeSets(sortedSet1, sortedSet2, operation, 0, merged);
+    stSortedSet *sortedSet3 = stSortedSet_construct3(sortedSet1->compareFn, NULL);
+    buildTree(sortedSet3, merged, length);
+    free(merged);
     return sortedSet3;
 }
 
-stSortedSet *stSortedSet_getIntersection(stSortedSet *sortedSet1, stSortedSet *sortedSet2) {
-    if(!stSortedSet_comparatorsEqual(sortedSet1, sortedSet2)) {
-        stThrowNew(SORTED_SET_EXCEPTION_ID, "Comparators are not equal for creating an intersection of two sorted sets");
-    }
-    stSortedSet *sortedSet3 = stSortedSet_construct3(stSortedSet_getComparator(sortedSet1)->compareFn, NULL);
+static void mergeInPlace(stSortedSet *sortedSet1, stSortedSet *sortedSet2, SetOperation operation) {
+    checkModifiable(sortedSet1);
+    void **merged = st_malloc((sortedSet1->size + sortedSet2->size + 1) * sizeof(void *));
+    int64_t length = mergeSets(sortedSet1, sortedSet2, operation, 1, merged);
+    //Replace the tree of the first set with one built from the merge
+    stPool_destruct(sortedSet1->leafPool);
+    stPool_destruct(sortedSet1->internalPool);
+    constructTree(sortedSet1);
+    buildTree(sortedSet1, merged, length);
+    free(merged);
+}
 
-    //Add those from sortedSet1 only if they are also in sortedSet2
-    stSortedSetIterator *it= stSortedSet_getIterator(sortedSet1);
-    void *o;
-    while((o = stSortedSet_getNext(it)) != NULL) {
-        if(stSortedSet_search(sortedSet2, o) != NULL) {
-            stSortedSet_insert(sortedSet3, o);
-        }
-    }
-    stSortedSet_destructIterator(it);
+stSortedSet *stSortedSet_getUnion(stSortedSet *sortedSet1, stSortedSet *sortedSet2) {
+    checkComparatorsEqual(sortedSet1, sortedSet2, "union");
+    return getMerged(sortedSet1, sortedSet2, setUnion);
+}
 
-    return sortedSet3;
+stSortedSet *stSortedSet_getIntersection(stSortedSet *sortedSet1, stSortedSet *sortedSet2) {
+    checkComparatorsEqual(sortedSet1, sortedSet2, "intersection");
+    return getMerged(sortedSet1, sortedSet2, setIntersection);
 }
 
 stSortedSet *stSortedSet_getDifference(stSortedSet *sortedSet1, stSortedSet *sortedSet2) {
-    if(!stSortedSet_comparatorsEqual(sortedSet1, sortedSet2)) {
-        stThrowNew(SORTED_SET_EXCEPTION_ID, "Comparators are not equal for creating the sorted set difference");
-    }
-    stSortedSet *sortedSet3 = stSortedSet_construct3(stSortedSet_getComparator(sortedSet1)->compareFn, NULL);
+    checkComparatorsEqual(sortedSet1, sortedSet2, "difference");
+    return getMerged(sortedSet1, sortedSet2, setDifference);
+}
 
-    //Add those from sortedSet1 only if they are not in sortedSet2
-    stSortedSetIterator *it= stSortedSet_getIterator(sortedSet1);
-    void *o;
-    while((o = stSortedSet_getNext(it)) != NULL) {
-        if(stSortedSet_search(sortedSet2, o) == NULL) {
-            stSortedSet_insert(sortedSet3, o);
-        }
-    }
-    stSortedSet_destructIterator(it);
+void stSortedSet_unionInPlace(stSortedSet *sortedSet1, stSortedSet *sortedSet2) {
+    checkComparatorsEqual(sortedSet1, sortedSet2, "union");
+    mergeInPlace(sortedSet1, sortedSet2, setUnion);
+}
 
-    return sortedSet3;
+void stSortedSet_intersectionInPlace(stSortedSet *sortedSet1, stSortedSet *sortedSet2) {
+    checkComparatorsEqual(sortedSet1, sortedSet2, "intersection");
+    mergeInPlace(sortedSet1, sortedSet2, setIntersection);
+}
+
+void stSortedSet_differenceInPlace(stSortedSet *sortedSet1, stSortedSet *sortedSet2) {
+    checkComparatorsEqual(sortedSet1, sortedSet2, "difference");
+    mergeInPlace(sortedSet1, sortedSet2, setDifference);
 }
@@ -32,19 +32,7 @@ void stIntTuple_destruct(stIntTuple *intTuple) {
 }
 
 uint32_t stIntTuple_hashKey(stIntTuple *intTuple) {
-    int32_t i;
-    uint32_t j = 0;
-
-    for (i = 0; i < stIntTuple_length(intTuple); i++) {
-        //j += stIntTuple_getPosition(intTuple, i);
-
-        // djb2
-        // This algorithm was first reported by Dan Bernstein
-        // many years ago in comp.lang.c
-        //
-        j = stIntTuple_getPosition(intTuple, i) + (j << 6) + (j << 16) - j;
-    }
-    return j;
+    return (uint32_t) stHash_bytes64(intTuple, sizeof(int32_t) * (stIntTuple_length(intTuple) + 1), 0);
 }
 
 static int intCmp(int32_t i, int32_t j) {
@@ -105,19 +93,7 @@ void stInt64Tuple_destruct(stInt64Tuple *int64Tuple) {
 }
 
 uint32_t stInt64Tuple_hashKey(stInt64Tuple *int64Tuple) {
-    int32_t i;
-    uint32_t j = 0;
-
-    for (i = 0; i < stInt64Tuple_length(int64Tuple); i++) {
-        //j += stIntTuple_getPosition(intTuple, i);
-
-        // djb2
-        // This algorithm was first reported by Dan Bernstein
-        // many years ago in comp.lang.c
-        //
-        j = stInt64Tuple_getPosition(int64Tuple, i) + (j << 6) + (j << 16) - j;
-    }
-    return j;
+    return (uint32_t) stHash_bytes64(int64Tuple, sizeof(int64_t) * (stInt64Tuple_length(int64Tuple) + 1), 0);
 }
 
 static int int64Cmp(int64_t i, int64_t j) {
@@ -175,19 +151,16 @@ void stDoubleTuple_destruct(stDoubleTuple *doubleTuple) {
 }
 
 uint32_t stDoubleTuple_hashKey(stDoubleTuple *doubleTuple) {
-    int32_t i;
-    uint32_t j = 0;
-
-    for (i = 0; i < stDoubleTuple_length(doubleTuple); i++) {
-        //j += stIntTuple_getPosition(intTuple, i);
-
-        // djb2
-        // This algorithm was first reported by Dan Bernstein
-        // many years ago in comp.lang.c
-        //
-        j = stDoubleTuple_getPosition(doubleTuple, i) + (j << 6) + (j << 16) - j;
+    uint64_t j = stHash_mix64(stDoubleTuple_length(doubleTuple));
+    for (int32_t i = 0; i < stDoubleTuple_length(doubleTuple); i++) {
+        double d = stDoubleTuple_getPosition(doubleTuple, i);
+        uint64_t k = 0;
+        if (d != 0.0) { //0.0 and -0.0 are equal, so must hash the same
+            memcpy(&k, &d, sizeof(double));
+        }
+        j = stHash_mix64(j ^ k);
     }
-    return j;
+    return (uint32_t) j;
 }
 
 static int doubleCmp(double i, double j) {
@@ -4,6 +4,7 @@
 #define __HASHTABLE_PRIVATE_CWC22_H__
 
 #include "hashTableC.h"
+#include "sonLibTypes.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -28,6 +29,7 @@ struct hashtable {
     int (*eqfn) (const void *k1, const void *k2);
     void (*keyFree)(void *);
     void (*valueFree)(void *);
+    stPool *entryPool; /* entries are allocated from here, so destroy frees them all at once */
 };
 
 /*****************************************************************************/
@@ -18,7 +18,12 @@
 #include "sonLibString.h"
 #include "sonLibHash.h"
 #include "sonLibSet.h"
+#include "sonLibInt64Hash.h"
+#include "sonLibConcurrentHash.h"
 #include "sonLibSortedSet.h"
+#include "sonLibPool.h"
+#include "sonLibIntervalTree.h"
+#include "sonLibHeap.h"
 #include "sonLibList.h"
 #include "sonLibCommon.h"
 #include "sonLibTuples.h"
@@ -13,6 +13,8 @@
 extern "C" {
 #endif
 
+extern const char *ST_CACHE_EXCEPTION_ID;
+
 ////////////////////////////////////////////////
 ////////////////////////////////////////////////
 ////////////////////////////////////////////////
@@ -21,12 +23,57 @@ extern "C" {
 ////////////////////////////////////////////////
 ////////////////////////////////////////////////
 
+/*
+ * How a cache with a capacity chooses which record fragments to evict.
+ * stCacheEvictionLRU evicts the least recently used fragment.
+ * stCacheEvictionClock approximates LRU with a reference bit per fragment, so a read does not reorder anything.
+ * stCacheEviction2Q keeps fragments that have only been used once in a separate queue, evicting from it first, so a
+ * scan through many records does not flush the records that are used repeatedly.
+ */
+typedef enum {
+    stCacheEvictionLRU,
+    stCacheEvictionClock,
+    stCacheEviction2Q
+} stCacheEvictionPolicy;
+
 /*
  *
  * Create an empty cache.
  */
 stCache *stCache_construct(void);
 
+/*
+ * Create an empty cache that holds at most capacityInBytes bytes of record fragments, evicting fragments according to
+ * the given policy when a set takes it over capacity. The fragment just set is never evicted, so a single fragment
+ * larger than the capacity is kept until the next set. If evict is non-NULL it is called with each fragment
+ * before the fragment is freed, so that, for example, modified data can be written back. It is not called by
+ * stCache_clear or stCache_destruct.
+ */
+stCache *stCache_construct2(int64_t capacityInBytes, stCacheEvictionPolicy policy,
+        void (*evict)(int64_t key, int64_t zeroBasedByteOffset, int64_t sizeInBytes, const void *value, void *extraArg),
+        void *extraArg);
+
+/*
+ * Like stCache_construct2, but the cache can be used by several threads at once. The keys are split between
+ * shardNumber shards, each with its own lock and an equal share of the capacity, so threads using different
+ * shards do not wait for each other. The eviction callback is called with the lock of the fragment's shard held,
+ * so it must not use the cache. stCache_getRecordView can not be used on a concurrent cache.
+ */
+stCache *stCache_constructConcurrent(int64_t shardNumber, int64_t capacityInBytes, stCacheEvictionPolicy policy,
+        void (*evict)(int64_t key, int64_t zeroBasedByteOffset, int64_t sizeInBytes, const void *value, void *extraArg),
+        void *extraArg);
+
+/*
+ * Sets a function called, before the eviction callback, with each maximal run of dirty bytes of a fragment being
+ * evicted, so that the modified data can be written back without rewriting the clean bytes around it. Fragments
+ * without dirty bytes are not passed to it. It takes the same arguments as the write function of stCache_flush,
+ * so the same function can be used for both, and for a concurrent cache it is likewise called with the lock of the
+ * fragment's shard held. Passing NULL removes the function.
+ */
+void stCache_setEvictDirty(stCache *cache,
+        void (*evictDirty)(int64_t key, int64_t zeroBasedByteOffset, int64_t sizeInBytes, const void *value, void *extraArg),
+        void *extraArg);
+
 /*
  * Destructs the cache.
  */
@@ -43,6 +90,30 @@ void stCache_clear(stCache *cache);
  */
 void stCache_setRecord(stCache *cache, int64_t key, int64_t zeroBasedByteOffset, int64_t sizeInBytes, const void *value);
 
+/*
+ * As stCache_setRecord, but if dirty is non-zero the bytes are marked as modified, so that they are passed to the
+ * write function of the next stCache_flush. If dirty is zero they are marked clean, as if just read from the
+ * database. stCache_setRecord is the same as stCache_setRecord2 with dirty zero.
+ */
+void stCache_setRecord2(stCache *cache, int64_t key, int64_t zeroBasedByteOffset, int64_t sizeInBytes, const void *value,
+        bool dirty);
+
+/*
+ * Returns the dirty byte ranges of the record, as a list of stInt64Tuples of offset and size, in order of offset.
+ * Adjacent dirty bytes are reported as one range.
+ */
+stList *stCache_getDirtyRanges(stCache *cache, int64_t key);
+
+/*
+ * Calls write with each range of dirty bytes in the cache, then marks them clean. Adjacent dirty bytes are
+ * written as one range. For a concurrent cache write is called with the lock of the range's shard held, so it must
+ * not use the cache. The dirty ranges of fragments that are evicted are not written by flush; they are passed to the
+ * function given to stCache_setEvictDirty, if any, when the fragments are evicted.
+ */
+void stCache_flush(stCache *cache,
+        void (*write)(int64_t key, int64_t zeroBasedByteOffset, int64_t sizeInBytes, const void *value, void *extraArg),
+        void *extraArg);
+
 /*
  * Returns non-zero if the cache contains all of the given record fragment. If zeroBasedByteOffset=INT64_MAX and
  * sizeInBytes=INT64_MAX then no overlap is required.
@@ -58,6 +129,44 @@ bool stCache_containsRecord(stCache *cache, int64_t key, int64_t zeroBasedByteOf
  */
 void *stCache_getRecord(stCache *cache, int64_t key, int64_t zeroBasedByteOffset, int64_t sizeInBytes, int64_t *recordSize);
 
+/*
+ * Like stCache_getRecord, but returns a pointer into the cache's own copy of the fragment rather than a copy of it.
+ * The pointer must not be freed or written through, and is only valid until the cache is next changed, by a set,
+ * clear or destruct.
+ */
+const void *stCache_getRecordView(stCache *cache, int64_t key, int64_t zeroBasedByteOffset, int64_t sizeInBytes, int64_t *recordSize);
+
+/*
+ * Returns the total number of bytes of record fragments in the cache.
+ */
+int64_t stCache_getSize(stCache *cache);
+
+/*
+ * Returns the number of bytes of the given record in the cache.
+ */
+int64_t stCache_getSizeOfKey(stCache *cache, int64_t key);
+
+/*
+ * Returns the number of bytes of the given range of the record that are in the cache.
+ */
+int64_t stCache_getSizeOfRange(stCache *cache, int64_t key, int64_t zeroBasedByteOffset, int64_t sizeInBytes);
+
+/*
+ * Writes the contents of the cache to the given file, so that a later process can load them with stCache_load.
+ * The file is written under a temporary name and renamed into place, so an interrupted save leaves any previous
+ * snapshot intact. Fragments are written least valuable first, according to the eviction policy. The snapshot
+ * uses the byte order of the host. Throws an exception if unsuccessful.
+ */
+void stCache_save(stCache *cache, const char *fileName);
+
+/*
+ * Adds the fragments in a file written by stCache_save to the cache, with their dirty bytes still dirty. If the
+ * cache has less capacity than the snapshot needs the least valuable fragments are evicted as usual. Throws an
+ * exception if the file can not be read or is not a valid snapshot; fragments read before the problem was found
+ * stay in the cache.
+ */
+void stCache_load(stCache *cache, const char *fileName);
+
 /*
  * Returns non-zero iff the two buffers have the same size and are identical.
  */
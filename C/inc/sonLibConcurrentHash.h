@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2006-2012 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef SONLIB_CONCURRENT_HASH_H_
+#define SONLIB_CONCURRENT_HASH_H_
+
+/*
+ * sonLibConcurrentHash.h
+ *
+ * A hash that many threads can insert into, search and remove from at once, for building a table in parallel.
+ * The keys are split between a number of stripes, each an stHash with its own lock, so threads only wait for each
+ * other when they use the same stripe. Once the parallel phase is over, freeze the hash into an ordinary stHash.
+ */
+
+#include "sonLibTypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Constructs a concurrent hash keyed by pointer with the given number of stripes. More stripes means less
+ * waiting between threads; a few times the number of threads is plenty.
+ */
+stConcurrentHash *stConcurrentHash_construct(int64_t stripeNumber);
+
+/*
+ * Constructs a concurrent hash with the given number of stripes and hash functions, as stHash_construct3.
+ * The hash functions are called from many threads at once, so must be thread safe.
+ */
+stConcurrentHash *stConcurrentHash_construct2(int64_t stripeNumber, uint32_t (*hashKey)(const void *),
+        int (*hashEqualsKey)(const void *, const void *), void (*destructKeys)(void *), void (*destructValues)(void *));
+
+/*
+ * Destructs the hash, which must not be in use by any other thread.
+ */
+void stConcurrentHash_destruct(stConcurrentHash *hash);
+
+/*
+ * Insert key/value into the hash, overriding any previous value of the key.
+ */
+void stConcurrentHash_insert(stConcurrentHash *hash, void *key, void *value);
+
+/*
+ * Inserts the key/value if the key is not present, returning NULL, otherwise returns the present value and leaves
+ * the hash unchanged. Lets threads racing to insert the same key agree on which value won.
+ */
+void *stConcurrentHash_insertIfAbsent(stConcurrentHash *hash, void *key, void *value);
+
+/*
+ * Search for value, returns null if not present.
+ */
+void *stConcurrentHash_search(stConcurrentHash *hash, void *key);
+
+/*
+ * Removes the key from the hash, returning its value, or NULL if not present.
+ */
+void *stConcurrentHash_remove(stConcurrentHash *hash, void *key);
+
+/*
+ * Returns the number of keys in the hash. While other threads are changing the hash it is only approximate.
+ */
+int64_t stConcurrentHash_size(stConcurrentHash *hash);
+
+/*
+ * Makes room for the hash to hold the given number of keys, spread evenly over the stripes, without growing.
+ */
+void stConcurrentHash_reserve(stConcurrentHash *hash, int64_t size);
+
+/*
+ * Moves the keys and values into a new stHash with the same functions, which then owns them, and destructs the
+ * concurrent hash. The hash must not be in use by any other thread.
+ */
+stHash *stConcurrentHash_freeze(stConcurrentHash *hash);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
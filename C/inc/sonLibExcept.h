@@ -156,10 +156,10 @@ struct _stExceptContext {
 };
 
 /* 
- * Exception content Top Of Stack.
+ * Exception content Top Of Stack, one per thread.
  * (Internal structure, don't use directly)
  */
-extern struct _stExceptContext *_cexceptTOS;
+extern __thread struct _stExceptContext *_cexceptTOS;
 
 /// @defgroup CMacros C try/catch macros
 /// @ingroup stExceptions
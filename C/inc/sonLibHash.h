@@ -27,6 +27,18 @@ extern "C" {
  */
 uint32_t stHash_pointer( const void *k );
 
+/*
+ * Mixes the bits of a 64 bit integer, such that every bit of the input affects every bit of the result. Use it to
+ * hash integer keys, or to finish a hash function of your own.
+ */
+uint64_t stHash_mix64(uint64_t i);
+
+/*
+ * A 64 bit hash of the given bytes, in the style of xxHash64. Different seeds give independent hashes of the same bytes.
+ * The hash of a given sequence of bytes may differ between little and big endian machines.
+ */
+uint64_t stHash_bytes64(const void *bytes, int64_t length, uint64_t seed);
+
 /*
  * Constructs hash, with no destructors for keys or values.
  */
@@ -53,6 +65,33 @@ void stHash_destruct(stHash *hash);
  */
 void stHash_insert(stHash *hash, void *key, void *value);
 
+/*
+ * Inserts the key with the value, or if the key is already present replaces its value, keeping the key already
+ * in the hash. Returns the value replaced, or NULL if the key was not present. Only probes the table once.
+ */
+void *stHash_upsert(stHash *hash, void *key, void *value);
+
+/*
+ * Returns a pointer to the value of the key, first inserting the key with a NULL value if it is not present,
+ * in which case inserted is set non-zero (if inserted is not NULL). The caller should then set the value, which must
+ * not be left NULL. Only probes the table once, so counting and memoization loops can use it in place of a search
+ * then an insert. The pointer is valid until the next insert or remove.
+ */
+void **stHash_getOrInsert(stHash *hash, void *key, bool *inserted);
+
+/*
+ * Makes room for the hash to hold the given number of keys without growing.
+ */
+void stHash_reserve(stHash *hash, int64_t size);
+
+/*
+ * Turns incremental resizing on or off (it is off by default). When the hash grows with it on, the entries are
+ * moved to the larger table a few at a time by the following inserts and removes, rather than all at once,
+ * so no single insert stalls on a large table. Searches never move entries, so stay safe to run from many
+ * threads at once, but getting an iterator finishes moving them.
+ */
+void stHash_setIncrementalResize(stHash *hash, bool incrementalResize);
+
 /*
  * Search for value, returns null if not present.
  */
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2006-2012 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef SONLIB_HEAP_H_
+#define SONLIB_HEAP_H_
+
+/*
+ * sonLibHeap.h
+ *
+ * A priority queue of elements, least first by a comparison function, kept as a binary heap in an array.
+ * Inserting an element returns a handle to it, through which it can later be given a lesser priority or
+ * removed, so algorithms that repeatedly update priorities need not remove and reinsert elements.
+ */
+
+#include "sonLibTypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern const char *ST_HEAP_EXCEPTION_ID;
+
+/*
+ * Constructs an empty heap ordered by the comparison function, which returns a negative number, zero or a
+ * positive number as its first argument is less than, equal to or greater than its second. If
+ * destructElementFn is not NULL it is called on each element left in the heap when the heap is destructed.
+ */
+stHeap *stHeap_construct(int (*compareFn)(const void *, const void *), void (*destructElementFn)(void *));
+
+/*
+ * Constructs a heap of the elements of the list in time linear in its length, rather than by inserting them
+ * one at a time. If handles is not NULL the handle of each element is appended to it, in the order of the list.
+ */
+stHeap *stHeap_constructFromList(stList *list, int (*compareFn)(const void *, const void *),
+        void (*destructElementFn)(void *), stList *handles);
+
+/*
+ * Destructs the heap and, with them, the handles of the elements left in it.
+ */
+void stHeap_destruct(stHeap *heap);
+
+/*
+ * Adds the element to the heap, returning its handle, which is valid until the element is popped or removed.
+ */
+stHeapHandle *stHeap_insert(stHeap *heap, void *element);
+
+/*
+ * Returns a least element of the heap, without removing it, in constant time. Returns NULL if the heap is empty.
+ */
+void *stHeap_peek(stHeap *heap);
+
+/*
+ * Removes and returns a least element of the heap. Returns NULL if the heap is empty.
+ */
+void *stHeap_pop(stHeap *heap);
+
+/*
+ * Replaces the element of the handle with the given element, which must not be greater than it, and moves it
+ * up the heap to match. The element may be the same object, after its priority has been lowered in place.
+ * Throws ST_HEAP_EXCEPTION_ID if the new element is greater than the one it replaces.
+ */
+void stHeap_decreaseKey(stHeap *heap, stHeapHandle *handle, void *element);
+
+/*
+ * Removes the element of the handle from the heap and returns it, without destructing it.
+ */
+void *stHeap_remove(stHeap *heap, stHeapHandle *handle);
+
+/*
+ * Returns the element of the handle.
+ */
+void *stHeap_getElement(stHeapHandle *handle);
+
+/*
+ * Returns the number of elements in the heap.
+ */
+int64_t stHeap_size(stHeap *heap);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
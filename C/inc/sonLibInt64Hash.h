@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2006-2012 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef SONLIB_INT64_HASH_H_
+#define SONLIB_INT64_HASH_H_
+
+/*
+ * sonLibInt64Hash.h
+ *
+ * Hashes and sets keyed by int64_t values, stored unboxed. Use them in place of an stHash or stSet of
+ * stInt64Tuples: there is no allocation per key and no call through a hash or equality function, and each slot
+ * takes 17 bytes (9 for a set) rather than a tuple, an entry and a pointer to each. A table grows when it is 7/8
+ * full, to twice the slots, so holds between 7/16 and 7/8 of a key per slot.
+ */
+
+#include "sonLibTypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Constructs a hash of int64_t keys to pointers or int64_t values.
+ */
+stInt64Hash *stInt64Hash_construct(void);
+
+/*
+ * Constructs a hash whose pointer values are destructed with the given function when the hash is destructed.
+ * If destructValues is NULL it is ignored.
+ */
+stInt64Hash *stInt64Hash_construct2(void (*destructValues)(void *));
+
+/*
+ * Destructs the hash.
+ */
+void stInt64Hash_destruct(stInt64Hash *hash);
+
+/*
+ * Insert the key with a pointer value, overriding the value if the key is already present.
+ */
+void stInt64Hash_insert(stInt64Hash *hash, int64_t key, void *value);
+
+/*
+ * Returns the pointer value of the key, or NULL if it is not present.
+ */
+void *stInt64Hash_search(stInt64Hash *hash, int64_t key);
+
+/*
+ * Removes the key, returning its pointer value, or NULL if it is not present.
+ */
+void *stInt64Hash_remove(stInt64Hash *hash, int64_t key);
+
+/*
+ * Insert the key with an integer value, overriding the value if the key is already present.
+ */
+void stInt64Hash_insertInt64(stInt64Hash *hash, int64_t key, int64_t value);
+
+/*
+ * Returns non-zero if the key is present, in which case value (if not NULL) is set to its integer value.
+ */
+bool stInt64Hash_searchInt64(stInt64Hash *hash, int64_t key, int64_t *value);
+
+/*
+ * Returns a pointer to the integer value of the key, first inserting the key with the value 0 if it is not present,
+ * in which case inserted (if not NULL) is set non-zero. Only probes the table once. The pointer is valid until the next
+ * insert or remove.
+ */
+int64_t *stInt64Hash_getOrInsert(stInt64Hash *hash, int64_t key, bool *inserted);
+
+/*
+ * Returns non-zero if the key is present.
+ */
+bool stInt64Hash_contains(stInt64Hash *hash, int64_t key);
+
+/*
+ * Returns the number of keys in the hash.
+ */
+int64_t stInt64Hash_size(stInt64Hash *hash);
+
+/*
+ * Makes room for the hash to hold the given number of keys without growing.
+ */
+void stInt64Hash_reserve(stInt64Hash *hash, int64_t size);
+
+/*
+ * Returns the number of keys the hash can hold before it next grows, which is at least the size last reserved.
+ */
+int64_t stInt64Hash_getCapacity(stInt64Hash *hash);
+
+/*
+ * Returns an iterator over the keys of the hash. The key last returned may be removed while iterating,
+ * but inserts invalidate the iterator.
+ */
+stInt64HashIterator *stInt64Hash_getIterator(stInt64Hash *hash);
+
+/*
+ * Sets key to the next key and returns non-zero, or returns zero if there are no more keys.
+ */
+bool stInt64Hash_getNext(stInt64HashIterator *iterator, int64_t *key);
+
+/*
+ * Destructs the iterator.
+ */
+void stInt64Hash_destructIterator(stInt64HashIterator *iterator);
+
+/*
+ * Constructs a set of int64_t keys.
+ */
+stInt64Set *stInt64Set_construct(void);
+
+/*
+ * Destructs the set.
+ */
+void stInt64Set_destruct(stInt64Set *set);
+
+/*
+ * Inserts the key, if it is not already present.
+ */
+void stInt64Set_insert(stInt64Set *set, int64_t key);
+
+/*
+ * Returns non-zero if the key is present.
+ */
+bool stInt64Set_contains(stInt64Set *set, int64_t key);
+
+/*
+ * Removes the key, returning non-zero if it was present.
+ */
+bool stInt64Set_remove(stInt64Set *set, int64_t key);
+
+/*
+ * Returns the number of keys in the set.
+ */
+int64_t stInt64Set_size(stInt64Set *set);
+
+/*
+ * Makes room for the set to hold the given number of keys without growing.
+ */
+void stInt64Set_reserve(stInt64Set *set, int64_t size);
+
+/*
+ * Returns the number of keys the set can hold before it next grows, which is at least the size last reserved.
+ */
+int64_t stInt64Set_getCapacity(stInt64Set *set);
+
+/*
+ * Returns an iterator over the keys of the set, with the same rules as stInt64Hash_getIterator.
+ */
+stInt64HashIterator *stInt64Set_getIterator(stInt64Set *set);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2006-2012 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef SONLIB_INTERVAL_TREE_H_
+#define SONLIB_INTERVAL_TREE_H_
+
+/*
+ * sonLibIntervalTree.h
+ *
+ * A set of intervals, each a half open range [start, end) on a sequence named by an integer key, with a value.
+ * The intervals are kept in a balanced tree in which every subtree records the greatest end within it, so
+ * subtrees that end too early are skipped. Finding the k intervals that overlap or contain a range takes
+ * O(min(n, (k + 1) log n)) time for n intervals, not O(log n + k), as the path to each one found may pass nodes
+ * that are not. For overlap queries k also counts the empty intervals within the range, which are passed over.
+ * Intervals on different keys never overlap.
+ */
+
+#include "sonLibTypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern const char *ST_INTERVAL_TREE_EXCEPTION_ID;
+
+/*
+ * Constructs an empty interval tree. If destructValueFn is not NULL it is called on the value of each interval
+ * left in the tree when the tree is destructed.
+ */
+stIntervalTree *stIntervalTree_construct(void (*destructValueFn)(void *));
+
+/*
+ * Destructs the tree.
+ */
+void stIntervalTree_destruct(stIntervalTree *intervalTree);
+
+/*
+ * Adds the interval [start, end) on the key, with the value. The same interval may be added many times, with
+ * the same or different values. Throws ST_INTERVAL_TREE_EXCEPTION_ID if end is less than start.
+ */
+void stIntervalTree_insert(stIntervalTree *intervalTree, int64_t key, int64_t start, int64_t end, void *value);
+
+/*
+ * Removes one copy of the interval [start, end) on the key with the value, without destructing the value.
+ * Returns false if there is no such interval.
+ */
+bool stIntervalTree_remove(stIntervalTree *intervalTree, int64_t key, int64_t start, int64_t end, void *value);
+
+/*
+ * Returns the number of intervals in the tree.
+ */
+int64_t stIntervalTree_size(stIntervalTree *intervalTree);
+
+/*
+ * Returns the values of the intervals on the key that share at least one position with [start, end), in order
+ * of start. Empty intervals overlap nothing. The list has no destructor.
+ */
+stList *stIntervalTree_getOverlapping(stIntervalTree *intervalTree, int64_t key, int64_t start, int64_t end);
+
+/*
+ * Returns the values of the intervals on the key that contain [start, end), i.e. that start at or before start
+ * and end at or after end, in order of start. The list has no destructor.
+ */
+stList *stIntervalTree_getContaining(stIntervalTree *intervalTree, int64_t key, int64_t start, int64_t end);
+
+/*
+ * Returns the value of an interval on the key nearest the position: one containing it if there is one, else
+ * the one with the least gap between it and the position, preferring the interval to the left on a tie. Returns
+ * NULL if there are no intervals on the key.
+ */
+void *stIntervalTree_getNearest(stIntervalTree *intervalTree, int64_t key, int64_t position);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -120,6 +120,28 @@ void stKVDatabase_bulkSetRecords(stKVDatabase *database, stList *records);
  */
 void stKVDatabase_bulkRemoveRecords(stKVDatabase *database, stList *records);
 
+/*
+ * Starts a transaction, so that the writes that follow are made together when it is committed,
+ * paying for the synchronisation to disk once rather than per call. Transactions may be nested,
+ * in which case only the outermost commit writes to the database, so a bulk call made inside a
+ * transaction joins it.
+ * Throws a KV_DATABASE exception if unsuccessful, or if the database does not support transactions
+ * (only Tokyo Cabinet and MySQL do).
+ */
+void stKVDatabase_startTransaction(stKVDatabase *database);
+
+/*
+ * Commits the innermost open transaction, see stKVDatabase_startTransaction.
+ * Throws a KV_DATABASE exception if unsuccessful or if no transaction is open.
+ */
+void stKVDatabase_commitTransaction(stKVDatabase *database);
+
+/*
+ * Aborts the open transaction, including all the transactions it is nested in, discarding their writes.
+ * Throws a KV_DATABASE exception if unsuccessful or if no transaction is open.
+ */
+void stKVDatabase_abortTransaction(stKVDatabase *database);
+
 /*
  * Gets a record from the database, given the key. The record is in newly allocated memory, and must be freed.
  * Returns NULL if the database does not contain the given record.
@@ -159,6 +181,45 @@ stList *stKVDatabase_bulkGetRecords(stKVDatabase *database, stList* keys);
  */
 stList *stKVDatabase_bulkGetRecordsRange(stKVDatabase *database, int64_t firstKey, int64_t numRecords);
 
+/*
+ * Bulk get a batch of records, packed into a single buffer. The nth record corresponds to the nth key
+ * from the input keys list. All the values are held in one contiguous block of memory, so however many
+ * records are retrieved the result is freed with a single call to stKVDatabaseBulkResultBuffer_destruct.
+ */
+stKVDatabaseBulkResultBuffer *stKVDatabase_bulkGetRecordsBuffer(stKVDatabase *database, stList* keys);
+
+/*
+ * Bulk get a batch of records from a range of keys, packed into a single buffer (see stKVDatabase_bulkGetRecordsBuffer).
+ */
+stKVDatabaseBulkResultBuffer *stKVDatabase_bulkGetRecordsRangeBuffer(stKVDatabase *database, int64_t firstKey, int64_t numRecords);
+
+/*
+ * Returns the number of records (including absent records) in the buffer.
+ */
+int64_t stKVDatabaseBulkResultBuffer_length(stKVDatabaseBulkResultBuffer *results);
+
+/*
+ * Gets the nth record from the buffer, putting its size in sizeOfRecord. Returns NULL if the database did not contain
+ * the record. The memory is owned by the buffer: it is not copied, must not be freed and is only valid until the buffer is destructed.
+ */
+const void *stKVDatabaseBulkResultBuffer_getRecord(stKVDatabaseBulkResultBuffer *results, int64_t index, int64_t *sizeOfRecord);
+
+/*
+ * Destruct the buffer and all the records in it.
+ */
+void stKVDatabaseBulkResultBuffer_destruct(stKVDatabaseBulkResultBuffer *results);
+
+
+/*
+ * Hints that the records with the given keys (a list of int64_t pointers) will soon be got. They are
+ * fetched in the background into a local cache, from which the next stKVDatabase_getRecord,
+ * stKVDatabase_getRecord2 or stKVDatabase_getInt64 of each key takes its record, overlapping the
+ * fetches with whatever the caller does in the meantime. Writes through the database invalidate
+ * the prefetched records they touch. Databases that can't be opened twice (Tokyo Cabinet, or
+ * Kyoto Tycoon with a big record store) fetch the records immediately, as a single bulk get.
+ * Throws a KV_DATABASE exception if the connection for prefetching can't be opened.
+ */
+void stKVDatabase_prefetch(stKVDatabase *database, stList *keys);
 
 /*
  * Removes a record from the database. Throws an exception if unsuccessful.
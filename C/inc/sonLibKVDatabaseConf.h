@@ -92,6 +92,10 @@ int64_t stKVDatabaseConf_getMaxKTBulkSetSize(stKVDatabaseConf *conf);
 /* get the maximum number of records in  kyoto tycoon bulk set */
 int64_t stKVDatabaseConf_getMaxKTBulkSetNumRecords(stKVDatabaseConf *conf);
 
+/* get the maximum number of connections used to send the batches of a big kyoto tycoon
+ * bulk set at once (max_bulkset_connections in the XML, 4 by default) */
+int64_t stKVDatabaseConf_getMaxKTBulkSetConnections(stKVDatabaseConf *conf);
+
 /* get the user for server based databases */
 const char *stKVDatabaseConf_getUser(stKVDatabaseConf *conf);
 
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2006-2012 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef SONLIB_POOL_H_
+#define SONLIB_POOL_H_
+
+/*
+ * sonLibPool.h
+ *
+ * A pool of fixed size objects, allocated from slabs that grow geometrically, for the nodes of containers.
+ * Allocating and freeing an object is a few instructions, the objects of a container are close together in
+ * memory, and destructing the pool frees all its objects at once with a call to free per slab.
+ */
+
+#include "sonLibTypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Constructs a pool of objects of the given size in bytes.
+ */
+stPool *stPool_construct(int64_t objectSize);
+
+/*
+ * As stPool_construct, but the first slab holds the given number of objects, rather than 8, so that the pools of
+ * containers that are often empty or small cost little. Each later slab is twice the size of the one before.
+ */
+stPool *stPool_construct2(int64_t objectSize, int64_t firstSlabObjects);
+
+/*
+ * Destructs the pool, freeing all of the objects allocated from it.
+ */
+void stPool_destruct(stPool *pool);
+
+/*
+ * Returns an uninitialised object from the pool.
+ */
+void *stPool_malloc(stPool *pool);
+
+/*
+ * Returns the object to the pool, to be reused by a later stPool_malloc.
+ */
+void stPool_free(stPool *pool, void *object);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -43,6 +43,22 @@ stSortedSet *stSortedSet_construct2(void (*destructElementFn)(void *));
 stSortedSet *stSortedSet_construct3(int (*compareFn)(const void *, const void *),
                                       void (*destructElementFn)(void *));
 
+/*
+ * Constructs a sorted set from a list whose elements are in strictly increasing order under the comparison function
+ * (the default if NULL), in time linear in the length of the list. Creates an exception if the list is not sorted or
+ * has equal elements. The list is left unchanged.
+ */
+stSortedSet *stSortedSet_constructFromSortedList(stList *list, int (*compareFn)(const void *, const void *),
+                                                 void (*destructElementFn)(void *));
+
+/*
+ * Constructs a sorted set from the elements of a list in any order, by sorting them and then building the set in
+ * one go, which is much faster than inserting them one at a time. Of elements that compare equal, the last in the
+ * list is kept, as if they had been inserted in turn. The list is left unchanged.
+ */
+stSortedSet *stSortedSet_constructFromList(stList *list, int (*compareFn)(const void *, const void *),
+                                           void (*destructElementFn)(void *));
+
 /*
  * Clones the given sorted set, setting the element destructor to the given function.
  */
@@ -98,6 +114,24 @@ void stSortedSet_remove(stSortedSet *sortedSet, void *object);
  */
 int32_t stSortedSet_size(stSortedSet *sortedSet);
 
+/*
+ * Returns the number of elements in the sorted set less than the object, which if the object is in the set is its
+ * zero based position in order. Takes time logarithmic in the size of the set.
+ */
+int64_t stSortedSet_getRank(stSortedSet *sortedSet, void *object);
+
+/*
+ * Returns the element at zero based position k in order, or NULL if k is not less than the size of the set.
+ * Takes time logarithmic in the size of the set.
+ */
+void *stSortedSet_getKth(stSortedSet *sortedSet, int64_t k);
+
+/*
+ * Returns the number of elements greater than or equal to lowerBound and less than upperBound, which need not be in
+ * the set. Takes time logarithmic in the size of the set, however many elements are in the range.
+ */
+int64_t stSortedSet_getCountInRange(stSortedSet *sortedSet, void *lowerBound, void *upperBound);
+
 /*
  * Gets the first element (with lowest value), in the sorted set.
  */
@@ -139,6 +173,22 @@ void *stSortedSet_getPrevious(stSortedSetIterator *iterator);
  */
 stSortedSetIterator *stSortedSet_copyIterator(stSortedSetIterator *iterator);
 
+/*
+ * Removes the element last returned by stSortedSet_getNext or stSortedSet_getPrevious from the sorted set and
+ * returns it, without destructing it. The iterator stays valid: the next call to stSortedSet_getNext returns the
+ * element that followed the removed one, and to stSortedSet_getPrevious the element that preceded it. The iterator
+ * must be the only live iterator of the set, else an exception is thrown, as it is if the iterator is not at an
+ * element, i.e. has not yet returned one, stepped off an end or has just removed its element.
+ */
+void *stSortedSet_iteratorRemove(stSortedSetIterator *iterator);
+
+/*
+ * Inserts the object into the sorted set, as with stSortedSet_insert, and moves the iterator to it, as if it had
+ * just been returned by stSortedSet_getNext. The iterator must be the only live iterator of the set, else an
+ * exception is thrown.
+ */
+void stSortedSet_iteratorInsertAndReposition(stSortedSetIterator *iterator, void *object);
+
 /*
  * Gets a stList version of the sorted set, sorted in the order of the sorted set.
  * No destructor is defined for the list, so destroying the list will not destroy
@@ -166,6 +216,25 @@ stSortedSet *stSortedSet_getIntersection(stSortedSet *sortedSet1, stSortedSet *s
  */
 stSortedSet *stSortedSet_getDifference(stSortedSet *sortedSet1, stSortedSet *sortedSet2);
 
+/*
+ * Adds the elements of sortedSet2 to sortedSet1. Where the sets have equal elements, the one in sortedSet1 is kept.
+ * Creates exception if they have different comparators. Like the other set operations, takes time linear in the
+ * sizes of the sets.
+ */
+void stSortedSet_unionInPlace(stSortedSet *sortedSet1, stSortedSet *sortedSet2);
+
+/*
+ * Removes the elements of sortedSet1 that are not in sortedSet2, without destructing them.
+ * Creates exception if they have different comparators.
+ */
+void stSortedSet_intersectionInPlace(stSortedSet *sortedSet1, stSortedSet *sortedSet2);
+
+/*
+ * Removes the elements of sortedSet1 that are in sortedSet2, without destructing them.
+ * Creates exception if they have different comparators.
+ */
+void stSortedSet_differenceInPlace(stSortedSet *sortedSet1, stSortedSet *sortedSet2);
+
 #ifdef __cplusplus
 }
 #endif
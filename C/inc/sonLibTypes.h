@@ -33,10 +33,18 @@ extern "C" {
 typedef struct _stTree stTree;
 typedef struct _stHash stHash;
 typedef struct _stSet stSet;
-typedef struct hashtable_itr stHashIterator;
+typedef struct _stHashIterator stHashIterator;
 typedef struct _stSetIterator stSetIterator;
+typedef struct _stInt64Hash stInt64Hash;
+typedef struct _stInt64Set stInt64Set;
+typedef struct _stInt64HashIterator stInt64HashIterator;
+typedef struct _stConcurrentHash stConcurrentHash;
+typedef struct _stPool stPool;
 typedef struct _stSortedSet stSortedSet;
 typedef struct _stSortedSetIterator stSortedSetIterator;
+typedef struct _stIntervalTree stIntervalTree;
+typedef struct _stHeap stHeap;
+typedef struct _stHeapHandle stHeapHandle;
 typedef struct _stList stList;
 typedef struct _stListIterator stListIterator;
 typedef int32_t stIntTuple;
@@ -53,6 +61,7 @@ typedef struct stKVDatabase stKVDatabase;
 typedef struct stKVDatabaseConf stKVDatabaseConf;
 typedef struct stKVDatabaseBulkRequest stKVDatabaseBulkRequest;
 typedef struct stKVDatabaseBulkResult stKVDatabaseBulkResult;
+typedef struct stKVDatabaseBulkResultBuffer stKVDatabaseBulkResultBuffer;
 
 #ifdef __cplusplus
 }
@@ -9,8 +9,13 @@
 CuSuite* sonLib_ETreeTestSuite(void);
 CuSuite* sonLib_stStringTestSuite(void);
 CuSuite* sonLib_stHashTestSuite(void);
+CuSuite* sonLib_stInt64HashTestSuite(void);
+CuSuite* sonLib_stConcurrentHashTestSuite(void);
+CuSuite* sonLib_stPoolTestSuite(void);
 CuSuite* sonLib_stSetTestSuite(void);
 CuSuite* sonLib_stSortedSetTestSuite(void);
+CuSuite* sonLib_stIntervalTreeTestSuite(void);
+CuSuite* sonLib_stHeapTestSuite(void);
 CuSuite* sonLib_stListTestSuite(void);
 CuSuite* sonLib_stCommonTestSuite(void);
 CuSuite* sonLib_stIntTuplesTestSuite(void);
@@ -33,8 +38,13 @@ int sonLibRunAllTests(void) {
     CuSuiteAddSuite(suite, sonLib_stDoubleTuplesTestSuite());
     CuSuiteAddSuite(suite, sonLib_stHashTestSuite());
     CuSuiteAddSuite(suite, sonLib_stSetTestSuite());
+    CuSuiteAddSuite(suite, sonLib_stInt64HashTestSuite());
+    CuSuiteAddSuite(suite, sonLib_stConcurrentHashTestSuite());
+    CuSuiteAddSuite(suite, sonLib_stPoolTestSuite());
     CuSuiteAddSuite(suite, sonLib_stListTestSuite());
     CuSuiteAddSuite(suite, sonLib_stSortedSetTestSuite());
+    CuSuiteAddSuite(suite, sonLib_stIntervalTreeTestSuite());
+    CuSuiteAddSuite(suite, sonLib_stHeapTestSuite());
     CuSuiteAddSuite(suite, sonLib_stExceptTestSuite());
     CuSuiteAddSuite(suite, sonLib_stRandomTestSuite());
     CuSuiteAddSuite(suite, sonLib_stCompressionTestSuite());
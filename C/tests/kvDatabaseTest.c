@@ -381,6 +381,113 @@ static void testBulkGetRecords(CuTest* testCase) {
     teardown();
 }
 
+static void testBulkGetRecordsBuffer(CuTest* testCase) {
+    /*
+     * Tests the bulk get functions that return a single packed buffer
+     */
+    setup();
+    int64_t i = 100, j = 110, k = 120;
+    int64_t ki = 4, kj = 2, kk = 3, kMissing = 10;
+    stKVDatabase_insertRecord(database, ki, &i, sizeof(int64_t));
+    stKVDatabase_insertRecord(database, kj, &j, sizeof(int64_t));
+    stKVDatabase_insertRecord(database, kk, &k, sizeof(int64_t));
+
+    stList* keys = stList_construct2(4);
+    stList_set(keys, 0, &ki);
+    stList_set(keys, 1, &kMissing);
+    stList_set(keys, 2, &kj);
+    stList_set(keys, 3, &kk);
+
+    stKVDatabaseBulkResultBuffer *results = stKVDatabase_bulkGetRecordsBuffer(database, keys);
+    CuAssertIntEquals(testCase, 4, stKVDatabaseBulkResultBuffer_length(results));
+    int64_t size;
+    const void *record = stKVDatabaseBulkResultBuffer_getRecord(results, 0, &size);
+    CuAssertTrue(testCase, record != NULL);
+    CuAssertTrue(testCase, *(int64_t *)record == i && size == sizeof(int64_t));
+    record = stKVDatabaseBulkResultBuffer_getRecord(results, 1, &size);
+    CuAssertTrue(testCase, record == NULL);
+    record = stKVDatabaseBulkResultBuffer_getRecord(results, 2, &size);
+    CuAssertTrue(testCase, record != NULL);
+    CuAssertTrue(testCase, *(int64_t *)record == j && size == sizeof(int64_t));
+    record = stKVDatabaseBulkResultBuffer_getRecord(results, 3, &size);
+    CuAssertTrue(testCase, record != NULL);
+    CuAssertTrue(testCase, *(int64_t *)record == k && size == sizeof(int64_t));
+    stKVDatabaseBulkResultBuffer_destruct(results);
+    stList_destruct(keys);
+
+    results = stKVDatabase_bulkGetRecordsRangeBuffer(database, 1, 4);
+    CuAssertIntEquals(testCase, 4, stKVDatabaseBulkResultBuffer_length(results));
+    CuAssertTrue(testCase, stKVDatabaseBulkResultBuffer_getRecord(results, 0, &size) == NULL);
+    record = stKVDatabaseBulkResultBuffer_getRecord(results, 1, &size);
+    CuAssertTrue(testCase, record != NULL);
+    CuAssertTrue(testCase, *(int64_t *)record == j && size == sizeof(int64_t));
+    record = stKVDatabaseBulkResultBuffer_getRecord(results, 2, &size);
+    CuAssertTrue(testCase, record != NULL);
+    CuAssertTrue(testCase, *(int64_t *)record == k && size == sizeof(int64_t));
+    record = stKVDatabaseBulkResultBuffer_getRecord(results, 3, &size);
+    CuAssertTrue(testCase, record != NULL);
+    CuAssertTrue(testCase, *(int64_t *)record == i && size == sizeof(int64_t));
+    stKVDatabaseBulkResultBuffer_destruct(results);
+
+    //A record of no bytes is present, not absent, even when it is the first in the buffer
+    int64_t kEmpty = 20;
+    stKVDatabase_insertRecord(database, kEmpty, "", 0);
+    keys = stList_construct2(3);
+    stList_set(keys, 0, &kEmpty);
+    stList_set(keys, 1, &kMissing);
+    stList_set(keys, 2, &ki);
+    results = stKVDatabase_bulkGetRecordsBuffer(database, keys);
+    size = -1;
+    CuAssertTrue(testCase, stKVDatabaseBulkResultBuffer_getRecord(results, 0, &size) != NULL);
+    CuAssertTrue(testCase, size == 0);
+    CuAssertTrue(testCase, stKVDatabaseBulkResultBuffer_getRecord(results, 1, &size) == NULL);
+    record = stKVDatabaseBulkResultBuffer_getRecord(results, 2, &size);
+    CuAssertTrue(testCase, record != NULL);
+    CuAssertTrue(testCase, *(int64_t *)record == i && size == sizeof(int64_t));
+    stKVDatabaseBulkResultBuffer_destruct(results);
+    stList_destruct(keys);
+    teardown();
+}
+
+static void testBulkGetRecordsUnsortedWithDuplicates(CuTest* testCase) {
+    /*
+     * Bulk gets sort and dedupe the keys internally, check the results come back in the caller's order
+     */
+    setup();
+    int64_t keyValues[] = { 7, 3, 9, 3, 5, 7, 1 };
+    int32_t n = sizeof(keyValues) / sizeof(int64_t);
+    for (int64_t key = 1; key < 9; key += 2) {
+        int64_t value = key * 10;
+        stKVDatabase_insertRecord(database, key, &value, sizeof(int64_t));
+    }
+    stList *keys = stList_construct();
+    for (int32_t i = 0; i < n; i++) {
+        stList_append(keys, &keyValues[i]);
+    }
+
+    stList *results = stKVDatabase_bulkGetRecords(database, keys);
+    stKVDatabaseBulkResultBuffer *resultsBuffer = stKVDatabase_bulkGetRecordsBuffer(database, keys);
+    CuAssertIntEquals(testCase, n, stList_length(results));
+    CuAssertIntEquals(testCase, n, stKVDatabaseBulkResultBuffer_length(resultsBuffer));
+    for (int32_t i = 0; i < n; i++) {
+        int64_t size;
+        void *record = stKVDatabaseBulkResult_getRecord(stList_get(results, i), &size);
+        const void *record2 = stKVDatabaseBulkResultBuffer_getRecord(resultsBuffer, i, &size);
+        if (keyValues[i] == 9) {
+            CuAssertTrue(testCase, record == NULL);
+            CuAssertTrue(testCase, record2 == NULL);
+        } else {
+            CuAssertTrue(testCase, record != NULL && *(int64_t *)record == keyValues[i] * 10);
+            CuAssertTrue(testCase, record2 != NULL && *(int64_t *)record2 == keyValues[i] * 10);
+            CuAssertTrue(testCase, size == sizeof(int64_t));
+        }
+    }
+    stList_destruct(results);
+    stKVDatabaseBulkResultBuffer_destruct(resultsBuffer);
+    stList_destruct(keys);
+    teardown();
+}
+
 static void testBulkRemoveRecords(CuTest *testCase) {
     /*
      * Tests doing a bulk update of a set of records.
@@ -423,6 +530,108 @@ static void testBulkRemoveRecords(CuTest *testCase) {
     teardown();
 }
 
+/*
+ * Checks that nested transactions and the bulk calls made in them are only written when the outermost
+ * transaction commits, that aborting discards them, and that committing with no open transaction throws.
+ */
+static void testTransactions(CuTest *testCase) {
+    setup();
+    if (stKVDatabaseConf_getType(conf) == stKVDatabaseTypeKyotoTycoon) {
+        //Kyoto Tycoon does not support transactions.
+        stTry {
+                stKVDatabase_startTransaction(database);
+                CuAssertTrue(testCase, false);
+            }
+            stCatch(except)
+                {
+                    CuAssertTrue(testCase, stExcept_getId(except) == ST_KV_DATABASE_EXCEPTION_ID);
+                }stTryEnd;
+        teardown();
+        return;
+    }
+    int64_t i = 1, j = 2;
+    //Nested transactions only write when the outermost commits, and bulk calls join them.
+    stKVDatabase_startTransaction(database);
+    stKVDatabase_insertRecord(database, 1, &i, sizeof(int64_t));
+    stKVDatabase_startTransaction(database);
+    stList *requests = stList_construct3(0, (void(*)(void *)) stKVDatabaseBulkRequest_destruct);
+    stList_append(requests, stKVDatabaseBulkRequest_constructInsertRequest(2, &j, sizeof(int64_t)));
+    stKVDatabase_bulkSetRecords(database, requests);
+    stList_destruct(requests);
+    stKVDatabase_commitTransaction(database);
+    stKVDatabase_abortTransaction(database);
+    CuAssertTrue(testCase, !stKVDatabase_containsRecord(database, 1));
+    CuAssertTrue(testCase, !stKVDatabase_containsRecord(database, 2));
+
+    stKVDatabase_startTransaction(database);
+    stKVDatabase_insertRecord(database, 1, &i, sizeof(int64_t));
+    stKVDatabase_startTransaction(database);
+    stKVDatabase_insertRecord(database, 2, &j, sizeof(int64_t));
+    stKVDatabase_commitTransaction(database);
+    stKVDatabase_commitTransaction(database);
+    CuAssertIntEquals(testCase, 1, stKVDatabase_getInt64(database, 1));
+    CuAssertIntEquals(testCase, 2, stKVDatabase_getInt64(database, 2));
+
+    //Committing with no open transaction is an error.
+    stTry {
+            stKVDatabase_commitTransaction(database);
+            CuAssertTrue(testCase, false);
+        }
+        stCatch(except)
+            {
+                CuAssertTrue(testCase, stExcept_getId(except) == ST_KV_DATABASE_EXCEPTION_ID);
+            }stTryEnd;
+    teardown();
+}
+
+static void testPrefetch(CuTest *testCase) {
+    setup();
+    int64_t keyValues[] = { 1, 2, 3, 4 };
+    for (int32_t i = 0; i < 3; i++) {
+        int64_t value = keyValues[i] * 10;
+        stKVDatabase_insertRecord(database, keyValues[i], &value, sizeof(int64_t));
+    }
+    stList *keys = stList_construct();
+    for (int32_t i = 0; i < 4; i++) {
+        stList_append(keys, &keyValues[i]);
+    }
+    stKVDatabase_prefetch(database, keys);
+    //A write after the prefetch must be seen.
+    int64_t value = 25;
+    stKVDatabase_updateRecord(database, 2, &value, sizeof(int64_t));
+    int64_t recordSize;
+    int64_t *record = stKVDatabase_getRecord2(database, 1, &recordSize);
+    CuAssertTrue(testCase, record != NULL && *record == 10 && recordSize == sizeof(int64_t));
+    free(record);
+    CuAssertIntEquals(testCase, 25, stKVDatabase_getInt64(database, 2));
+    CuAssertIntEquals(testCase, 30, stKVDatabase_getInt64(database, 3));
+    CuAssertPtrEquals(testCase, NULL, stKVDatabase_getRecord(database, 4));
+    //Prefetched records are only used once, later gets go to the database.
+    record = stKVDatabase_getRecord(database, 1);
+    CuAssertTrue(testCase, record != NULL && *record == 10);
+    free(record);
+    stKVDatabase_prefetch(database, keys);
+    //Keys written outside a transaction, or in one that has ended, are prefetched again.
+    value = 15;
+    stKVDatabase_updateRecord(database, 1, &value, sizeof(int64_t));
+    bool transactions = stKVDatabaseConf_getType(conf) != stKVDatabaseTypeKyotoTycoon;
+    if (transactions) {
+        stKVDatabase_startTransaction(database);
+    }
+    value = 35;
+    stKVDatabase_updateRecord(database, 3, &value, sizeof(int64_t));
+    stKVDatabase_prefetch(database, keys);
+    CuAssertIntEquals(testCase, 35, stKVDatabase_getInt64(database, 3));
+    if (transactions) {
+        stKVDatabase_commitTransaction(database);
+    }
+    stKVDatabase_prefetch(database, keys);
+    CuAssertIntEquals(testCase, 15, stKVDatabase_getInt64(database, 1));
+    CuAssertIntEquals(testCase, 35, stKVDatabase_getInt64(database, 3));
+    stList_destruct(keys);
+    teardown();
+}
+
 /*
  * Retrieves really long records from the database.
  */
@@ -550,6 +759,21 @@ static void test_stKVDatabaseConf_constructFromString_tokyoCabinet(CuTest *testC
     CuAssertStrEquals(testCase, "foo", stKVDatabaseConf_getDir(conf));
 }
 
+static void test_stKVDatabaseConf_constructFromString_kyotoTycoon(CuTest *testCase) {
+    const char *xmlTestString =
+            "<st_kv_database_conf type='kyoto_tycoon'><kyoto_tycoon host='localhost' port='1978' database_dir='foo' "
+            "max_bulkset_connections='8'/></st_kv_database_conf>";
+    stKVDatabaseConf *conf = stKVDatabaseConf_constructFromString(xmlTestString);
+    CuAssertTrue(testCase, stKVDatabaseConf_getType(conf) == stKVDatabaseTypeKyotoTycoon);
+    CuAssertStrEquals(testCase, "localhost", stKVDatabaseConf_getHost(conf));
+    CuAssertIntEquals(testCase, 1978, stKVDatabaseConf_getPort(conf));
+    CuAssertIntEquals(testCase, 10000, stKVDatabaseConf_getMaxKTBulkSetNumRecords(conf));
+    stKVDatabaseConf *conf2 = stKVDatabaseConf_constructClone(conf);
+    CuAssertIntEquals(testCase, 8, stKVDatabaseConf_getMaxKTBulkSetConnections(conf2));
+    stKVDatabaseConf_destruct(conf);
+    stKVDatabaseConf_destruct(conf2);
+}
+
 static void test_stKVDatabaseConf_constructFromString_mysql(CuTest *testCase) {
 #ifdef HAVE_MYSQL
     const char *xmlTestString =
@@ -577,10 +801,15 @@ static CuSuite* stKVDatabaseTestSuite(void) {
     SUITE_ADD_TEST(suite, testIncrementRecord);
     SUITE_ADD_TEST(suite, testSetRecord);
     SUITE_ADD_TEST(suite, testBulkRemoveRecords);
+    SUITE_ADD_TEST(suite, testTransactions);
+    SUITE_ADD_TEST(suite, testPrefetch);
     SUITE_ADD_TEST(suite, testBulkSetRecords);
     SUITE_ADD_TEST(suite, testBulkGetRecords);
+    SUITE_ADD_TEST(suite, testBulkGetRecordsBuffer);
+    SUITE_ADD_TEST(suite, testBulkGetRecordsUnsortedWithDuplicates);
     SUITE_ADD_TEST(suite, constructDestructAndDelete);
     SUITE_ADD_TEST(suite, test_stKVDatabaseConf_constructFromString_tokyoCabinet);
+    SUITE_ADD_TEST(suite, test_stKVDatabaseConf_constructFromString_kyotoTycoon);
     SUITE_ADD_TEST(suite, test_stKVDatabaseConf_constructFromString_mysql);
     return suite;
 }
@@ -9,6 +9,7 @@
  *
  */
 
+#include <pthread.h>
 #include "sonLibGlobalsTest.h"
 #include "kvDatabaseTestCommon.h"
 
@@ -117,10 +118,487 @@ static void readAndUpdateRecords(CuTest *testCase) {
     teardown();
 }
 
+static void sizeAccounting(CuTest *testCase) {
+    setup();
+
+    CuAssertTrue(testCase, stCache_getSize(cache) == 0);
+    stCache_setRecord(cache, 1, 5, 6, "hello");
+    stCache_setRecord(cache, 1, 12, 6, "world");
+    CuAssertTrue(testCase, stCache_getSize(cache) == 12);
+    CuAssertTrue(testCase, stCache_getSizeOfKey(cache, 1) == 12);
+    CuAssertTrue(testCase, stCache_getSizeOfRange(cache, 1, 0, 10) == 5);
+    CuAssertTrue(testCase, stCache_getSizeOfRange(cache, 1, 10, 5) == 4);
+    CuAssertTrue(testCase, stCache_getSizeOfRange(cache, 1, 20, 5) == 0);
+
+    stCache_setRecord(cache, 1, 10, 2, "  "); //overlaps the first fragment and fills the gap
+    stCache_setRecord(cache, 2, 0, 4, "abc");
+    CuAssertTrue(testCase, stCache_getSize(cache) == 17);
+    CuAssertTrue(testCase, stCache_getSizeOfKey(cache, 1) == 13);
+    CuAssertTrue(testCase, stCache_getSizeOfKey(cache, 2) == 4);
+    CuAssertTrue(testCase, stCache_getSizeOfKey(cache, 3) == 0);
+
+    stCache_setRecord(cache, 1, 0, 20, "a record that covers"); //replaces the fragments of key 1
+    CuAssertTrue(testCase, stCache_getSize(cache) == 24);
+    CuAssertTrue(testCase, stCache_getSizeOfKey(cache, 1) == 20);
+
+    stCache_clear(cache);
+    CuAssertTrue(testCase, stCache_getSize(cache) == 0);
+
+    teardown();
+}
+
+static void randomReadsAndUpdates(CuTest *testCase) {
+    /*
+     * Compares the cache against a plain array per key, recording which bytes have been set.
+     */
+    setup();
+    const int64_t keyNumber = 5, recordLength = 100;
+    char values[5][100];
+    bool present[5][100];
+    memset(present, 0, sizeof(present));
+    for (int32_t test = 0; test < 5000; test++) {
+        int64_t key = st_randomInt(0, keyNumber);
+        int64_t start = st_randomInt(0, recordLength);
+        int64_t size = st_randomInt(1, recordLength - start + 1);
+        if (st_random() > 0.5) {
+            char value[100];
+            for (int64_t i = 0; i < size; i++) {
+                value[i] = values[key][start + i] = (char) st_randomInt(0, 128);
+                present[key][start + i] = 1;
+            }
+            stCache_setRecord(cache, key, start, size, value);
+        } else {
+            bool contained = 1;
+            for (int64_t i = 0; i < size; i++) {
+                contained = contained && present[key][start + i];
+            }
+            CuAssertTrue(testCase, stCache_containsRecord(cache, key, start, size) == contained);
+            char *value = stCache_getRecord(cache, key, start, size, &recordSize);
+            CuAssertTrue(testCase, (value != NULL) == contained);
+            if (value != NULL) {
+                CuAssertTrue(testCase, recordSize == size);
+                CuAssertTrue(testCase, memcmp(value, values[key] + start, size) == 0);
+                free(value);
+            }
+        }
+        int64_t keySize = 0, rangeSize = 0;
+        for (int64_t i = 0; i < recordLength; i++) {
+            keySize += present[key][i];
+            rangeSize += (i >= start && i < start + size) ? present[key][i] : 0;
+        }
+        CuAssertTrue(testCase, stCache_getSizeOfKey(cache, key) == keySize);
+        CuAssertTrue(testCase, stCache_getSizeOfRange(cache, key, start, size) == rangeSize);
+    }
+    teardown();
+}
+
+static void recordViewsAndAppends(CuTest *testCase) {
+    setup();
+
+    CuAssertTrue(testCase, stCache_getRecordView(cache, 1, 0, INT64_MAX, &recordSize) == NULL);
+    for (int64_t i = 0; i < 100000; i++) { //a stream of appends, which extend one fragment in place
+        char c = (char) (i % 100);
+        stCache_setRecord(cache, 1, i, 1, &c);
+    }
+    stCache_setRecord(cache, 1, 100001, 3, "ab"); //leaves a gap of one byte
+    const char *view = stCache_getRecordView(cache, 1, 0, INT64_MAX, &recordSize);
+    CuAssertTrue(testCase, recordSize == 100000);
+    for (int64_t i = 0; i < 100000; i++) {
+        CuAssertTrue(testCase, view[i] == (char) (i % 100));
+    }
+    CuAssertTrue(testCase, stCache_getRecordView(cache, 1, 10, 5, &recordSize) == view + 10);
+    CuAssertTrue(testCase, recordSize == 5);
+    CuAssertTrue(testCase, stCache_getRecordView(cache, 1, 100000, 2, &recordSize) == NULL);
+
+    stCache_setRecord(cache, 1, 100000, 1, "-"); //fills the gap, joining the fragments
+    view = stCache_getRecordView(cache, 1, 99999, INT64_MAX, &recordSize);
+    CuAssertTrue(testCase, recordSize == 5);
+    CuAssertTrue(testCase, memcmp(view, "c-ab", 5) == 0);
+    CuAssertTrue(testCase, stCache_getSize(cache) == 100004);
+
+    teardown();
+}
+
+static void checkRange(CuTest *testCase, stList *ranges, int32_t index, int64_t start, int64_t size) {
+    stInt64Tuple *range = stList_get(ranges, index);
+    CuAssertTrue(testCase, stInt64Tuple_getPosition(range, 0) == start);
+    CuAssertTrue(testCase, stInt64Tuple_getPosition(range, 1) == size);
+}
+
+static void appendWrite(int64_t key, int64_t start, int64_t size, const void *value, void *extraArg) {
+    stList *writes = extraArg;
+    stList_append(writes, stInt64Tuple_construct(3, key, start, size));
+}
+
+static void dirtyRangesAndFlush(CuTest *testCase) {
+    setup();
+    const char *value = "0123456789abcdefghij";
+
+    stCache_setRecord(cache, 1, 0, 20, value); //clean, as if read from the database
+    stList *ranges = stCache_getDirtyRanges(cache, 1);
+    CuAssertIntEquals(testCase, 0, stList_length(ranges));
+    stList_destruct(ranges);
+
+    stCache_setRecord2(cache, 1, 2, 3, value + 2, 1);
+    stCache_setRecord2(cache, 1, 5, 1, value + 5, 1); //adjacent, so reported with the previous write
+    stCache_setRecord2(cache, 1, 10, 9, value + 10, 1);
+    stCache_setRecord2(cache, 1, 12, 2, value + 12, 0); //cleans part of the previous write
+    stCache_setRecord2(cache, 1, 20, 2, "kl", 1); //extends the fragment
+    stCache_setRecord2(cache, 2, 0, 4, "abc", 1);
+    ranges = stCache_getDirtyRanges(cache, 1);
+    CuAssertIntEquals(testCase, 4, stList_length(ranges));
+    checkRange(testCase, ranges, 0, 2, 4);
+    checkRange(testCase, ranges, 1, 10, 2);
+    checkRange(testCase, ranges, 2, 14, 5);
+    checkRange(testCase, ranges, 3, 20, 2);
+    stList_destruct(ranges);
+
+    stList *writes = stList_construct3(0, (void (*)(void *)) stInt64Tuple_destruct);
+    stCache_flush(cache, appendWrite, writes);
+    CuAssertIntEquals(testCase, 5, stList_length(writes));
+    int64_t writtenBytes = 0;
+    for (int32_t i = 0; i < stList_length(writes); i++) {
+        writtenBytes += stInt64Tuple_getPosition(stList_get(writes, i), 2);
+    }
+    CuAssertTrue(testCase, writtenBytes == 4 + 2 + 5 + 2 + 4);
+    stList_destruct(writes);
+    ranges = stCache_getDirtyRanges(cache, 1);
+    CuAssertIntEquals(testCase, 0, stList_length(ranges));
+    stList_destruct(ranges);
+    writes = stList_construct3(0, (void (*)(void *)) stInt64Tuple_destruct);
+    stCache_flush(cache, appendWrite, writes);
+    CuAssertIntEquals(testCase, 0, stList_length(writes));
+    stList_destruct(writes);
+
+    //Compare against a bitmap kept alongside, over random writes to one record
+    stCache_clear(cache);
+    const int64_t recordLength = 200;
+    bool dirty[200];
+    memset(dirty, 0, sizeof(dirty));
+    char buffer[200];
+    memset(buffer, 'x', sizeof(buffer));
+    for (int32_t test = 0; test < 2000; test++) {
+        int64_t start = st_randomInt(0, recordLength);
+        int64_t size = st_randomInt(1, recordLength - start + 1);
+        bool isDirty = st_random() > 0.3;
+        stCache_setRecord2(cache, 3, start, size, buffer, isDirty);
+        for (int64_t i = start; i < start + size; i++) {
+            dirty[i] = isDirty;
+        }
+        ranges = stCache_getDirtyRanges(cache, 3);
+        int64_t j = 0;
+        for (int32_t i = 0; i < stList_length(ranges); i++) {
+            stInt64Tuple *range = stList_get(ranges, i);
+            int64_t rangeStart = stInt64Tuple_getPosition(range, 0), rangeEnd = rangeStart + stInt64Tuple_getPosition(range, 1);
+            for (; j < rangeStart; j++) {
+                CuAssertTrue(testCase, !dirty[j]);
+            }
+            CuAssertTrue(testCase, j == 0 || !dirty[j - 1]); //ranges are maximal
+            for (; j < rangeEnd; j++) {
+                CuAssertTrue(testCase, dirty[j]);
+            }
+        }
+        for (; j < recordLength; j++) {
+            CuAssertTrue(testCase, !dirty[j]);
+        }
+        stList_destruct(ranges);
+        if (st_random() > 0.95) {
+            writes = stList_construct3(0, (void (*)(void *)) stInt64Tuple_destruct);
+            stCache_flush(cache, appendWrite, writes);
+            stList_destruct(writes);
+            memset(dirty, 0, sizeof(dirty));
+        }
+    }
+
+    teardown();
+}
+
+static void saveAndLoad(CuTest *testCase) {
+    const char *snapshotFile = "sonLibCacheTest.tmp";
+    setup();
+    stCache_setRecord(cache, 1, 5, 6, "hello");
+    stCache_setRecord(cache, 1, 12, 6, "world");
+    stCache_setRecord2(cache, 2, 0, 8, "goodbye", 1);
+    stCache_setRecord2(cache, 1, 13, 2, "OR", 1);
+    stCache_setRecord(cache, INT64_MIN, 3, 1, "");
+    stCache_setRecord(cache, 3, 0, 0, ""); //a fragment with no bytes
+    stCache_save(cache, snapshotFile);
+
+    teardown(); //load into a fresh cache, and check everything came back, including the dirty bytes
+    cache = stCache_construct();
+    stCache_load(cache, snapshotFile);
+    CuAssertTrue(testCase, stCache_getSize(cache) == 6 + 6 + 8 + 1);
+    CuAssertStrEquals(testCase, "hello", stCache_getRecordView(cache, 1, 5, INT64_MAX, &recordSize));
+    CuAssertStrEquals(testCase, "wORld", stCache_getRecordView(cache, 1, 12, INT64_MAX, &recordSize));
+    CuAssertStrEquals(testCase, "goodbye", stCache_getRecordView(cache, 2, 0, INT64_MAX, &recordSize));
+    CuAssertTrue(testCase, stCache_containsRecord(cache, INT64_MIN, 3, 1));
+    CuAssertTrue(testCase, stCache_containsRecord(cache, 3, 0, 0));
+    CuAssertTrue(testCase, stCache_getSizeOfKey(cache, 3) == 0);
+    stList *ranges = stCache_getDirtyRanges(cache, 1);
+    CuAssertIntEquals(testCase, 1, stList_length(ranges));
+    CuAssertTrue(testCase, stInt64Tuple_getPosition(stList_get(ranges, 0), 0) == 13);
+    CuAssertTrue(testCase, stInt64Tuple_getPosition(stList_get(ranges, 0), 1) == 2);
+    stList_destruct(ranges);
+    ranges = stCache_getDirtyRanges(cache, 2);
+    CuAssertIntEquals(testCase, 1, stList_length(ranges));
+    stList_destruct(ranges);
+
+    teardown(); //a smaller cache keeps the most recently used records
+    cache = stCache_construct();
+    for (int64_t key = 0; key < 10; key++) {
+        stCache_setRecord(cache, key, 0, sizeof(int64_t), &key);
+    }
+    free(stCache_getRecord(cache, 0, 0, INT64_MAX, &recordSize));
+    stCache_save(cache, snapshotFile);
+    teardown();
+    cache = stCache_construct2(3 * sizeof(int64_t), stCacheEvictionLRU, NULL, NULL);
+    stCache_load(cache, snapshotFile);
+    CuAssertTrue(testCase, stCache_getSize(cache) == 3 * sizeof(int64_t));
+    CuAssertTrue(testCase, stCache_containsRecord(cache, 0, 0, INT64_MAX));
+    CuAssertTrue(testCase, stCache_containsRecord(cache, 9, 0, INT64_MAX));
+    CuAssertTrue(testCase, stCache_containsRecord(cache, 8, 0, INT64_MAX));
+
+    FILE *fileHandle = fopen(snapshotFile, "wb"); //not a snapshot
+    fprintf(fileHandle, "STCACHE1 but then not very much else");
+    fclose(fileHandle);
+    stTry {
+        stCache_load(cache, snapshotFile);
+        CuAssertTrue(testCase, 0);
+    } stCatch(except) {
+        CuAssertTrue(testCase, stExcept_getId(except) == ST_CACHE_EXCEPTION_ID);
+        stExcept_free(except);
+    } stTryEnd;
+    stFile_rmrf(snapshotFile);
+    teardown();
+}
+
+typedef struct _cacheThreadArgs {
+    int64_t firstKey;
+    int64_t keyNumber;
+    bool evicting; //if non-zero other threads may evict a record before it is read back
+    bool correct;
+} CacheThreadArgs;
+
+static void *readAndUpdateConcurrently(void *arg) {
+    CacheThreadArgs *args = arg;
+    for (int64_t key = args->firstKey; key < args->firstKey + args->keyNumber; key++) {
+        int64_t value[4] = { key, key + 1, key + 2, key + 3 };
+        stCache_setRecord(cache, key, 0, 2 * sizeof(int64_t), value); //written in two adjacent pieces
+        stCache_setRecord(cache, key, 2 * sizeof(int64_t), 2 * sizeof(int64_t), value + 2);
+        int64_t size;
+        int64_t *record = stCache_getRecord(cache, key, 0, INT64_MAX, &size);
+        if (record == NULL ? !args->evicting : (size != 4 * sizeof(int64_t) || record[0] != key || record[3] != key + 3)) {
+            args->correct = 0;
+        }
+        free(record);
+    }
+    return NULL;
+}
+
+static void concurrentReadsAndUpdates(CuTest *testCase) {
+    teardown();
+    cache = stCache_constructConcurrent(8, INT64_MAX, stCacheEvictionLRU, NULL, NULL);
+    int64_t threadNumber = 4, keyNumber = 10000;
+    pthread_t threads[4];
+    CacheThreadArgs args[4];
+    for (int64_t i = 0; i < threadNumber; i++) {
+        args[i].firstKey = i * keyNumber;
+        args[i].keyNumber = keyNumber;
+        args[i].evicting = 0;
+        args[i].correct = 1;
+        CuAssertTrue(testCase, pthread_create(&threads[i], NULL, readAndUpdateConcurrently, &args[i]) == 0);
+    }
+    for (int64_t i = 0; i < threadNumber; i++) {
+        pthread_join(threads[i], NULL);
+        CuAssertTrue(testCase, args[i].correct);
+    }
+    CuAssertTrue(testCase, stCache_getSize(cache) == threadNumber * keyNumber * 4 * sizeof(int64_t));
+    CuAssertTrue(testCase, stCache_getSizeOfKey(cache, 5) == 4 * sizeof(int64_t));
+    stCache_clear(cache);
+    CuAssertTrue(testCase, stCache_getSize(cache) == 0);
+
+    teardown(); //with a capacity each shard evicts on its own
+    cache = stCache_constructConcurrent(8, 800 * 4 * sizeof(int64_t), stCacheEvictionClock, NULL, NULL);
+    for (int64_t i = 0; i < threadNumber; i++) {
+        args[i].evicting = 1;
+        CuAssertTrue(testCase, pthread_create(&threads[i], NULL, readAndUpdateConcurrently, &args[i]) == 0);
+    }
+    for (int64_t i = 0; i < threadNumber; i++) {
+        pthread_join(threads[i], NULL);
+        CuAssertTrue(testCase, args[i].correct);
+    }
+    CuAssertTrue(testCase, stCache_getSize(cache) <= 800 * 4 * sizeof(int64_t));
+    CuAssertTrue(testCase, stCache_getSize(cache) > 0);
+    teardown();
+}
+
+static stList *evictedKeys = NULL;
+static int64_t evictedBytes;
+
+static void recordEviction(int64_t key, int64_t start, int64_t size, const void *value, void *extraArg) {
+    CuTest *testCase = extraArg;
+    CuAssertTrue(testCase, start == 0);
+    CuAssertTrue(testCase, strlen(value) + 1 == size);
+    CuAssertTrue(testCase, atoll(value) == key);
+    stList_append(evictedKeys, stIntTuple_construct(1, (int32_t) key));
+    evictedBytes += size;
+}
+
+static void setupWithCapacity(CuTest *testCase, int64_t capacity, stCacheEvictionPolicy policy) {
+    teardown();
+    cache = stCache_construct2(capacity, policy, recordEviction, testCase);
+    if (evictedKeys != NULL) {
+        stList_destruct(evictedKeys);
+    }
+    evictedKeys = stList_construct3(0, (void (*)(void *)) stIntTuple_destruct);
+    evictedBytes = 0;
+}
+
+static void setNumberedRecord(int64_t key) {
+    char value[4];
+    sprintf(value, "%03" PRIi64, key);
+    stCache_setRecord(cache, key, 0, 4, value);
+}
+
+static void useRecord(CuTest *testCase, int64_t key) {
+    void *value = stCache_getRecord(cache, key, 0, INT64_MAX, &recordSize);
+    CuAssertTrue(testCase, value != NULL);
+    CuAssertTrue(testCase, atoll(value) == key);
+    free(value);
+}
+
+static void checkEvicted(CuTest *testCase, int32_t length, const int32_t *keys) {
+    CuAssertIntEquals(testCase, length, stList_length(evictedKeys));
+    for (int32_t i = 0; i < length; i++) {
+        CuAssertIntEquals(testCase, keys[i], stIntTuple_getPosition(stList_get(evictedKeys, i), 0));
+        CuAssertTrue(testCase, !stCache_containsRecord(cache, keys[i], 0, INT64_MAX));
+    }
+    CuAssertTrue(testCase, evictedBytes == 4 * length);
+}
+
+static void evictLRU(CuTest *testCase) {
+    setupWithCapacity(testCase, 12, stCacheEvictionLRU);
+    setNumberedRecord(1);
+    setNumberedRecord(2);
+    setNumberedRecord(3);
+    checkEvicted(testCase, 0, NULL);
+    useRecord(testCase, 1);
+    setNumberedRecord(4);
+    checkEvicted(testCase, 1, (int32_t[]) { 2 });
+    setNumberedRecord(1); //an update also counts as a use
+    setNumberedRecord(5);
+    checkEvicted(testCase, 2, (int32_t[]) { 2, 3 });
+    setNumberedRecord(6);
+    checkEvicted(testCase, 3, (int32_t[]) { 2, 3, 4 });
+    CuAssertTrue(testCase, stCache_getSize(cache) == 12);
+    teardown();
+}
+
+static void evictClock(CuTest *testCase) {
+    setupWithCapacity(testCase, 12, stCacheEvictionClock);
+    setNumberedRecord(1);
+    setNumberedRecord(2);
+    setNumberedRecord(3);
+    useRecord(testCase, 1);
+    setNumberedRecord(4); //the hand passes over 1, clearing its bit
+    checkEvicted(testCase, 1, (int32_t[]) { 2 });
+    setNumberedRecord(5);
+    checkEvicted(testCase, 2, (int32_t[]) { 2, 3 });
+    setNumberedRecord(6);
+    checkEvicted(testCase, 3, (int32_t[]) { 2, 3, 4 });
+    setNumberedRecord(7); //1 has not been used since the hand passed it
+    checkEvicted(testCase, 4, (int32_t[]) { 2, 3, 4, 1 });
+    CuAssertTrue(testCase, stCache_getSize(cache) == 12);
+    teardown();
+}
+
+static void evict2Q(CuTest *testCase) {
+    setupWithCapacity(testCase, 16, stCacheEviction2Q);
+    setNumberedRecord(1);
+    setNumberedRecord(2);
+    useRecord(testCase, 1);
+    useRecord(testCase, 2);
+    for (int64_t key = 3; key < 10; key++) { //a scan, which should not displace the records used twice
+        setNumberedRecord(key);
+    }
+    checkEvicted(testCase, 5, (int32_t[]) { 3, 4, 5, 6, 7 });
+    useRecord(testCase, 1);
+    useRecord(testCase, 2);
+    useRecord(testCase, 9);
+    useRecord(testCase, 8);
+    setNumberedRecord(10); //the in queue is now small, so the least recently used of the rest goes
+    checkEvicted(testCase, 6, (int32_t[]) { 3, 4, 5, 6, 7, 1 });
+    CuAssertTrue(testCase, stCache_getSize(cache) == 16);
+    teardown();
+}
+
+static void evictOversizedRecord(CuTest *testCase) {
+    setupWithCapacity(testCase, 12, stCacheEvictionLRU);
+    setNumberedRecord(1);
+    stCache_setRecord(cache, 2, 4, 16, "a large fragment");
+    checkEvicted(testCase, 1, (int32_t[]) { 1 });
+    CuAssertTrue(testCase, stCache_getSize(cache) == 16);
+    stCache_setRecord(cache, 2, 0, 4, "002"); //merged with the large fragment, which is kept
+    checkEvicted(testCase, 1, (int32_t[]) { 1 });
+    CuAssertTrue(testCase, stCache_getSize(cache) == 20);
+    CuAssertTrue(testCase, stCache_getSizeOfRange(cache, 2, 0, INT64_MAX) == 20);
+    teardown();
+    stList_destruct(evictedKeys);
+    evictedKeys = NULL;
+}
+
+static void checkWrite(CuTest *testCase, stList *writes, int64_t index, int64_t key, int64_t start, int64_t size) {
+    stInt64Tuple *write = stList_get(writes, index);
+    CuAssertTrue(testCase, stInt64Tuple_getPosition(write, 0) == key);
+    CuAssertTrue(testCase, stInt64Tuple_getPosition(write, 1) == start);
+    CuAssertTrue(testCase, stInt64Tuple_getPosition(write, 2) == size);
+}
+
+static void evictDirtyRanges(CuTest *testCase) {
+    setupWithCapacity(testCase, 8, stCacheEvictionLRU);
+    stList *writes = stList_construct3(0, (void (*)(void *)) stInt64Tuple_destruct);
+    stCache_setEvictDirty(cache, appendWrite, writes);
+    setNumberedRecord(1); //clean, so not passed to evictDirty
+    stCache_setRecord2(cache, 2, 0, 4, "002", 1);
+    stCache_setRecord2(cache, 3, 0, 4, "003", 1);
+    checkEvicted(testCase, 1, (int32_t[]) { 1 });
+    CuAssertIntEquals(testCase, 0, stList_length(writes));
+    stCache_setRecord2(cache, 2, 1, 1, "0", 0); //cleans the middle of the record, leaving two runs
+    stCache_flush(cache, appendWrite, writes); //cleans 3 and writes 2's runs
+    CuAssertIntEquals(testCase, 3, stList_length(writes));
+    stList_destruct(writes);
+    writes = stList_construct3(0, (void (*)(void *)) stInt64Tuple_destruct);
+    stCache_setEvictDirty(cache, appendWrite, writes);
+    stCache_setRecord2(cache, 2, 2, 1, "2", 1);
+    stCache_setRecord2(cache, 2, 0, 1, "0", 1);
+    setNumberedRecord(4); //evicts 3, now clean
+    CuAssertIntEquals(testCase, 0, stList_length(writes));
+    setNumberedRecord(5); //evicts 2, passing just the bytes dirtied since the flush
+    checkEvicted(testCase, 3, (int32_t[]) { 1, 3, 2 });
+    CuAssertIntEquals(testCase, 2, stList_length(writes));
+    checkWrite(testCase, writes, 0, 2, 0, 1);
+    checkWrite(testCase, writes, 1, 2, 2, 1);
+    teardown();
+    stList_destruct(writes);
+    stList_destruct(evictedKeys);
+    evictedKeys = NULL;
+}
+
 CuSuite* stCacheSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, readAndUpdateRecord);
     SUITE_ADD_TEST(suite, readAndUpdateRecords);
+    SUITE_ADD_TEST(suite, sizeAccounting);
+    SUITE_ADD_TEST(suite, randomReadsAndUpdates);
+    SUITE_ADD_TEST(suite, recordViewsAndAppends);
+    SUITE_ADD_TEST(suite, concurrentReadsAndUpdates);
+    SUITE_ADD_TEST(suite, dirtyRangesAndFlush);
+    SUITE_ADD_TEST(suite, saveAndLoad);
+    SUITE_ADD_TEST(suite, evictLRU);
+    SUITE_ADD_TEST(suite, evictClock);
+    SUITE_ADD_TEST(suite, evict2Q);
+    SUITE_ADD_TEST(suite, evictOversizedRecord);
+    SUITE_ADD_TEST(suite, evictDirtyRanges);
 
     return suite;
 }
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2006-2012 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "sonLibGlobalsTest.h"
+#include <pthread.h>
+
+#define THREAD_NUMBER 4
+#define KEY_NUMBER 20000
+#define CONTESTED_KEY_NUMBER 2000
+
+static stConcurrentHash *hash;
+static int64_t keys[KEY_NUMBER];
+static int64_t contestedKeys[CONTESTED_KEY_NUMBER];
+static int64_t winners[CONTESTED_KEY_NUMBER]; //The number of threads that won the race to insert each contested key.
+static pthread_mutex_t winnersLock = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct _threadArgs {
+    int64_t thread;
+    bool failed;
+} ThreadArgs;
+
+static void *insertConcurrently(void *arg) {
+    ThreadArgs *args = arg;
+    for (int64_t i = args->thread; i < KEY_NUMBER; i += THREAD_NUMBER) { //Each thread's own keys
+        stConcurrentHash_insert(hash, &keys[i], &keys[KEY_NUMBER - 1 - i]);
+    }
+    for (int64_t i = 0; i < CONTESTED_KEY_NUMBER; i++) { //Keys all the threads race to insert
+        if (stConcurrentHash_insertIfAbsent(hash, &contestedKeys[i], args) == NULL) {
+            pthread_mutex_lock(&winnersLock);
+            winners[i]++;
+            pthread_mutex_unlock(&winnersLock);
+        }
+    }
+    return NULL;
+}
+
+static void *removeConcurrently(void *arg) {
+    ThreadArgs *args = arg;
+    for (int64_t i = args->thread; i < KEY_NUMBER; i += THREAD_NUMBER) {
+        if (stConcurrentHash_search(hash, &keys[i]) != &keys[KEY_NUMBER - 1 - i]) {
+            args->failed = 1;
+        }
+        if (i % 2 == 1 && stConcurrentHash_remove(hash, &keys[i]) != &keys[KEY_NUMBER - 1 - i]) {
+            args->failed = 1;
+        }
+    }
+    return NULL;
+}
+
+static void runThreads(CuTest *testCase, void *(*fn)(void *)) {
+    pthread_t threads[THREAD_NUMBER];
+    ThreadArgs args[THREAD_NUMBER];
+    for (int64_t i = 0; i < THREAD_NUMBER; i++) {
+        args[i].thread = i;
+        args[i].failed = 0;
+        CuAssertTrue(testCase, pthread_create(&threads[i], NULL, fn, &args[i]) == 0);
+    }
+    for (int64_t i = 0; i < THREAD_NUMBER; i++) {
+        pthread_join(threads[i], NULL);
+        CuAssertTrue(testCase, !args[i].failed);
+    }
+}
+
+static void test_stConcurrentHash_concurrentInsertAndRemove(CuTest *testCase) {
+    hash = stConcurrentHash_construct(16);
+    memset(winners, 0, sizeof(winners));
+    runThreads(testCase, insertConcurrently);
+    CuAssertTrue(testCase, stConcurrentHash_size(hash) == KEY_NUMBER + CONTESTED_KEY_NUMBER);
+    for (int64_t i = 0; i < CONTESTED_KEY_NUMBER; i++) {
+        CuAssertTrue(testCase, winners[i] == 1);
+    }
+
+    runThreads(testCase, removeConcurrently); //Removes the odd keys
+    int64_t size = KEY_NUMBER / 2 + CONTESTED_KEY_NUMBER;
+    CuAssertTrue(testCase, stConcurrentHash_size(hash) == size);
+
+    stHash *frozen = stConcurrentHash_freeze(hash);
+    CuAssertIntEquals(testCase, size, stHash_size(frozen));
+    for (int64_t i = 0; i < KEY_NUMBER; i++) {
+        CuAssertTrue(testCase, stHash_search(frozen, &keys[i]) == (i % 2 == 1 ? NULL : &keys[KEY_NUMBER - 1 - i]));
+    }
+    for (int64_t i = 0; i < CONTESTED_KEY_NUMBER; i++) {
+        CuAssertTrue(testCase, stHash_search(frozen, &contestedKeys[i]) != NULL);
+    }
+    stHash_destruct(frozen);
+}
+
+static void test_stConcurrentHash_insertIfAbsent(CuTest *testCase) {
+    stConcurrentHash *hash2 = stConcurrentHash_construct2(3, (uint32_t (*)(const void *)) stIntTuple_hashKey,
+            (int (*)(const void *, const void *)) stIntTuple_equalsFn, (void (*)(void *)) stIntTuple_destruct,
+            (void (*)(void *)) stIntTuple_destruct);
+    stIntTuple *key = stIntTuple_construct(1, 5), *value = stIntTuple_construct(1, 6);
+    CuAssertTrue(testCase, stConcurrentHash_insertIfAbsent(hash2, key, value) == NULL);
+    stIntTuple *key2 = stIntTuple_construct(1, 5);
+    CuAssertTrue(testCase, stConcurrentHash_insertIfAbsent(hash2, key2, NULL) == value);
+    CuAssertTrue(testCase, stConcurrentHash_search(hash2, key2) == value);
+    stIntTuple_destruct(key2);
+    CuAssertTrue(testCase, stConcurrentHash_size(hash2) == 1);
+    stConcurrentHash_reserve(hash2, 1000);
+    CuAssertTrue(testCase, stConcurrentHash_search(hash2, key) == value);
+    stConcurrentHash_destruct(hash2);
+}
+
+CuSuite* sonLib_stConcurrentHashTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, test_stConcurrentHash_concurrentInsertAndRemove);
+    SUITE_ADD_TEST(suite, test_stConcurrentHash_insertIfAbsent);
+    return suite;
+}
@@ -191,6 +191,238 @@ static void test_stHash_testGetValues(CuTest *testCase) {
     testTeardown();
 }
 
+static void randomInsertAndRemove(CuTest *testCase, bool incrementalResize) {
+    /*
+     * Checks the hash against an array of the keys present, over many random inserts and removes,
+     * so that the table grows and entries are moved about.
+     */
+    const int32_t keyNumber = 10000;
+    int64_t *keys = st_malloc(keyNumber * sizeof(int64_t));
+    bool *present = st_calloc(keyNumber, sizeof(bool));
+    stHash *hash3 = stHash_construct();
+    stHash_setIncrementalResize(hash3, incrementalResize);
+    int32_t size = 0;
+    for (int32_t test = 0; test < 100000; test++) {
+        int32_t i = st_randomInt(0, test < 50000 ? keyNumber : keyNumber / 10);
+        if (st_random() > 0.4) {
+            stHash_insert(hash3, &keys[i], &keys[keyNumber - 1 - i]);
+            size += !present[i];
+            present[i] = 1;
+        } else {
+            CuAssertTrue(testCase, stHash_remove(hash3, &keys[i]) == (present[i] ? &keys[keyNumber - 1 - i] : NULL));
+            size -= present[i];
+            present[i] = 0;
+        }
+        CuAssertIntEquals(testCase, size, stHash_size(hash3));
+        int32_t j = st_randomInt(0, keyNumber);
+        CuAssertTrue(testCase, stHash_search(hash3, &keys[j]) == (present[j] ? &keys[keyNumber - 1 - j] : NULL));
+    }
+    for (int32_t i = 0; i < keyNumber; i++) {
+        CuAssertTrue(testCase, stHash_search(hash3, &keys[i]) == (present[i] ? &keys[keyNumber - 1 - i] : NULL));
+    }
+    stHash_destruct(hash3);
+    free(keys);
+    free(present);
+}
+
+static void test_stHash_randomInsertAndRemove(CuTest *testCase) {
+    randomInsertAndRemove(testCase, 0);
+}
+
+static void test_stHash_incrementalResize(CuTest *testCase) {
+    randomInsertAndRemove(testCase, 1);
+
+    /*
+     * Checks the hash part way through migrating to a larger table.
+     */
+    const int32_t keyNumber = 1000;
+    stHash *hash3 = stHash_construct3((uint32_t(*)(const void *)) stIntTuple_hashKey, (int(*)(const void *, const void *)) stIntTuple_equalsFn,
+            (void(*)(void *)) stIntTuple_destruct, (void(*)(void *)) stIntTuple_destruct);
+    stHash_setIncrementalResize(hash3, 1);
+    for (int32_t i = 0; i < keyNumber; i++) {
+        stHash_insert(hash3, stIntTuple_construct(1, i), stIntTuple_construct(1, -i));
+        CuAssertIntEquals(testCase, i + 1, stHash_size(hash3));
+    }
+    for (int32_t i = 0; i < keyNumber; i++) {
+        stIntTuple *key = stIntTuple_construct(1, i);
+        stIntTuple *value = stHash_search(hash3, key);
+        CuAssertTrue(testCase, value != NULL && stIntTuple_getPosition(value, 0) == -i);
+        if (i % 3 == 0) {
+            stIntTuple_destruct(stHash_removeAndFreeKey(hash3, key));
+        } else if (i % 3 == 1) {
+            bool inserted;
+            void **valuePointer = stHash_getOrInsert(hash3, key, &inserted);
+            CuAssertTrue(testCase, !inserted && *valuePointer == value);
+        }
+        stIntTuple_destruct(key);
+    }
+    CuAssertIntEquals(testCase, keyNumber - (keyNumber + 2) / 3, stHash_size(hash3));
+    stList *keys = stHash_getKeys(hash3);
+    CuAssertIntEquals(testCase, stHash_size(hash3), stList_length(keys));
+    stList_destruct(keys);
+    stHash_destruct(hash3);
+}
+
+static void test_stHash_removeDuringIteration(CuTest *testCase) {
+    /*
+     * Removing the key just returned by an iterator must not cause other keys to be skipped.
+     */
+    const int32_t keyNumber = 5000;
+    stHash *hash3 = stHash_construct3((uint32_t(*)(const void *)) stIntTuple_hashKey, (int(*)(const void *, const void *)) stIntTuple_equalsFn,
+            (void(*)(void *)) stIntTuple_destruct, NULL);
+    for (int32_t i = 0; i < keyNumber; i++) {
+        stHash_insert(hash3, stIntTuple_construct(1, i), hash3);
+    }
+    bool *seen = st_calloc(keyNumber, sizeof(bool));
+    stHashIterator *iterator = stHash_getIterator(hash3);
+    stIntTuple *key;
+    int32_t seenNumber = 0;
+    while ((key = stHash_getNext(iterator)) != NULL) {
+        int32_t i = stIntTuple_getPosition(key, 0);
+        CuAssertTrue(testCase, !seen[i]);
+        seen[i] = 1;
+        seenNumber++;
+        if (i % 2 == 0) {
+            stHash_removeAndFreeKey(hash3, key);
+        }
+    }
+    stHash_destructIterator(iterator);
+    CuAssertIntEquals(testCase, keyNumber, seenNumber);
+    CuAssertIntEquals(testCase, keyNumber / 2, stHash_size(hash3));
+    free(seen);
+    stHash_destruct(hash3);
+}
+
+static void test_stHash_upsertAndGetOrInsert(CuTest *testCase) {
+    testSetup();
+    //Upsert replaces values, keeping the key already present
+    stIntTuple *oneCopy = stIntTuple_construct(1, 0);
+    CuAssertTrue(testCase, stHash_upsert(hash2, oneCopy, four) == two);
+    CuAssertTrue(testCase, stHash_search(hash2, one) == four);
+    stIntTuple *seven = stIntTuple_construct(1, 6);
+    CuAssertTrue(testCase, stHash_upsert(hash, seven, one) == NULL);
+    CuAssertTrue(testCase, stHash_search(hash, seven) == one);
+    CuAssertTrue(testCase, stHash_size(hash) == 4);
+    stHash_remove(hash, seven);
+    stIntTuple_destruct(seven);
+    stHash_insert(hash2, one, two); //put back the value, so it is freed once
+    stIntTuple_destruct(oneCopy);
+    testTeardown();
+
+    //Count occurrences, as a counting loop would, against an array of counts
+    const int32_t keyNumber = 1000;
+    int64_t *counts = st_calloc(keyNumber, sizeof(int64_t));
+    stHash *hash3 = stHash_construct3((uint32_t(*)(const void *)) stIntTuple_hashKey, (int(*)(const void *, const void *)) stIntTuple_equalsFn,
+            (void(*)(void *)) stIntTuple_destruct, free);
+    stHash_reserve(hash3, keyNumber / 2);
+    for (int32_t test = 0; test < 20000; test++) {
+        int32_t i = st_randomInt(0, keyNumber);
+        stIntTuple *key = stIntTuple_construct(1, i);
+        bool inserted;
+        int64_t **count = (int64_t **) stHash_getOrInsert(hash3, key, &inserted);
+        CuAssertTrue(testCase, inserted == (counts[i] == 0));
+        if (inserted) {
+            *count = st_calloc(1, sizeof(int64_t));
+        } else {
+            stIntTuple_destruct(key);
+        }
+        (**count)++;
+        counts[i]++;
+    }
+    int32_t size = 0;
+    for (int32_t i = 0; i < keyNumber; i++) {
+        stIntTuple *key = stIntTuple_construct(1, i);
+        int64_t *count = stHash_search(hash3, key);
+        CuAssertTrue(testCase, counts[i] == 0 ? count == NULL : *count == counts[i]);
+        size += counts[i] > 0;
+        stIntTuple_destruct(key);
+    }
+    CuAssertIntEquals(testCase, size, stHash_size(hash3));
+    stHash_destruct(hash3);
+    free(counts);
+}
+
+static uint32_t constantHashKey(const void *key) {
+    return 1;
+}
+
+static void test_stHash_constantHashFunction(CuTest *testCase) {
+    /*
+     * Every key has the same home slot, so the probes are as long as the hash is big, which must not make the
+     * table grow past what the load needs.
+     */
+    const int32_t keyNumber = 500;
+    for (int32_t incrementalResize = 0; incrementalResize < 2; incrementalResize++) {
+        stHash *hash3 = stHash_construct3(constantHashKey, (int(*)(const void *, const void *)) stIntTuple_equalsFn,
+                (void(*)(void *)) stIntTuple_destruct, NULL);
+        stHash_setIncrementalResize(hash3, incrementalResize);
+        for (int32_t i = 0; i < keyNumber; i++) {
+            stHash_insert(hash3, stIntTuple_construct(1, i), (void *) (int64_t) (i + 1));
+        }
+        CuAssertIntEquals(testCase, keyNumber, stHash_size(hash3));
+        for (int32_t i = 0; i < keyNumber; i++) {
+            stIntTuple *key = stIntTuple_construct(1, i);
+            CuAssertTrue(testCase, stHash_search(hash3, key) == (void *) (int64_t) (i + 1));
+            if (i % 2 == 0) {
+                CuAssertTrue(testCase, stHash_removeAndFreeKey(hash3, key) == (void *) (int64_t) (i + 1));
+            }
+            stIntTuple_destruct(key);
+        }
+        CuAssertIntEquals(testCase, keyNumber / 2, stHash_size(hash3));
+        stIntTuple *key = stIntTuple_construct(1, keyNumber);
+        CuAssertPtrEquals(testCase, NULL, stHash_search(hash3, key));
+        stIntTuple_destruct(key);
+        stList *keys = stHash_getKeys(hash3);
+        CuAssertIntEquals(testCase, keyNumber / 2, stList_length(keys));
+        stList_destruct(keys);
+        stHash_destruct(hash3);
+    }
+}
+
+static void test_stHash_hashFunctions(CuTest *testCase) {
+    //The low bits of the hashes of aligned pointers should be well spread
+    int64_t *pointers = st_malloc(1024 * sizeof(int64_t));
+    bool seen[1024] = { 0 };
+    int32_t distinct = 0;
+    for (int32_t i = 0; i < 1024; i++) {
+        uint32_t j = stHash_pointer(&pointers[i]) & 1023;
+        distinct += !seen[j];
+        seen[j] = 1;
+    }
+    CuAssertTrue(testCase, distinct > 550); //about 632 are expected for random hashes
+    free(pointers);
+
+    //Byte hashes depend on every byte, the length and the seed
+    char bytes[20] = "a string of 19 byte";
+    uint64_t hash = stHash_bytes64(bytes, 19, 0);
+    CuAssertTrue(testCase, hash == stHash_bytes64(bytes, 19, 0));
+    CuAssertTrue(testCase, hash != stHash_bytes64(bytes, 19, 1));
+    CuAssertTrue(testCase, hash != stHash_bytes64(bytes, 20, 0));
+    for (int32_t i = 0; i < 19; i++) {
+        bytes[i]++;
+        CuAssertTrue(testCase, hash != stHash_bytes64(bytes, 19, 0));
+        bytes[i]--;
+    }
+    CuAssertTrue(testCase, stHash_stringKey("hello") == stHash_stringKey("hello"));
+    CuAssertTrue(testCase, stHash_stringKey("hello") != stHash_stringKey("hellp"));
+    CuAssertTrue(testCase, stHash_mix64(1) != stHash_mix64(2));
+
+    //Equal tuples hash the same
+    stDoubleTuple *doubleTuple1 = stDoubleTuple_construct(2, 0.0, 1.5);
+    stDoubleTuple *doubleTuple2 = stDoubleTuple_construct(2, -0.0, 1.5);
+    CuAssertTrue(testCase, stDoubleTuple_hashKey(doubleTuple1) == stDoubleTuple_hashKey(doubleTuple2));
+    stDoubleTuple_destruct(doubleTuple1);
+    stDoubleTuple_destruct(doubleTuple2);
+    stIntTuple *intTuple1 = stIntTuple_construct(2, 1, 2);
+    stIntTuple *intTuple2 = stIntTuple_construct(2, 1, 2);
+    stIntTuple *intTuple3 = stIntTuple_construct(2, 2, 1);
+    CuAssertTrue(testCase, stIntTuple_hashKey(intTuple1) == stIntTuple_hashKey(intTuple2));
+    CuAssertTrue(testCase, stIntTuple_hashKey(intTuple1) != stIntTuple_hashKey(intTuple3));
+    stIntTuple_destruct(intTuple1);
+    stIntTuple_destruct(intTuple2);
+    stIntTuple_destruct(intTuple3);
+}
+
 CuSuite* sonLib_stHashTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, test_stHash_search);
@@ -202,5 +434,11 @@ CuSuite* sonLib_stHashTestSuite(void) {
     SUITE_ADD_TEST(suite, test_stHash_construct);
     SUITE_ADD_TEST(suite, test_stHash_testGetKeys);
     SUITE_ADD_TEST(suite, test_stHash_testGetValues);
+    SUITE_ADD_TEST(suite, test_stHash_randomInsertAndRemove);
+    SUITE_ADD_TEST(suite, test_stHash_removeDuringIteration);
+    SUITE_ADD_TEST(suite, test_stHash_hashFunctions);
+    SUITE_ADD_TEST(suite, test_stHash_constantHashFunction);
+    SUITE_ADD_TEST(suite, test_stHash_upsertAndGetOrInsert);
+    SUITE_ADD_TEST(suite, test_stHash_incrementalResize);
     return suite;
 }
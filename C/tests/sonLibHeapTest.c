@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2006-2012 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "sonLibGlobalsTest.h"
+
+static int comparePriorities(const int64_t *priority1, const int64_t *priority2) {
+    return *priority1 < *priority2 ? -1 : *priority1 > *priority2 ? 1 : 0;
+}
+
+/*
+ * Returns the index of a least priority of those present, or -1 if none are.
+ */
+static int64_t getLeast(int64_t *priorities, stHeapHandle **handles, int64_t elementNumber) {
+    int64_t least = -1;
+    for (int64_t i = 0; i < elementNumber; i++) {
+        if (handles[i] != NULL && (least == -1 || priorities[i] < priorities[least])) {
+            least = i;
+        }
+    }
+    return least;
+}
+
+static void test_stHeap_randomOperations(CuTest *testCase) {
+    /*
+     * Inserts, pops, removes and lowers the priorities of random elements of an array, starting from a heap built
+     * from a list, and checks the least element against a scan of the array after each operation.
+     */
+    const int64_t elementNumber = 1000;
+    int64_t *priorities = st_malloc(elementNumber * sizeof(int64_t));
+    stHeapHandle **handles = st_calloc(elementNumber, sizeof(stHeapHandle *));
+    stList *list = stList_construct();
+    for (int64_t i = 0; i < elementNumber; i += 2) {
+        priorities[i] = st_randomInt(0, 1000);
+        stList_append(list, &priorities[i]);
+    }
+    stList *handleList = stList_construct();
+    stHeap *heap = stHeap_constructFromList(list, (int (*)(const void *, const void *)) comparePriorities, NULL,
+            handleList);
+    CuAssertIntEquals(testCase, stList_length(list), stList_length(handleList));
+    for (int64_t i = 0; i < stList_length(handleList); i++) {
+        handles[2 * i] = stList_get(handleList, i);
+        CuAssertPtrEquals(testCase, &priorities[2 * i], stHeap_getElement(handles[2 * i]));
+    }
+    stList_destruct(list);
+    stList_destruct(handleList);
+    int64_t size = stHeap_size(heap);
+    for (int64_t test = 0; test < 100000; test++) {
+        int64_t i = st_randomInt(0, elementNumber);
+        double r = st_random();
+        if (handles[i] == NULL) {
+            priorities[i] = st_randomInt(0, 1000);
+            handles[i] = stHeap_insert(heap, &priorities[i]);
+            size++;
+        } else if (r < 0.3) {
+            priorities[i] -= st_randomInt(0, 100); //Lowered in place
+            stHeap_decreaseKey(heap, handles[i], &priorities[i]);
+        } else if (r < 0.5) {
+            CuAssertPtrEquals(testCase, &priorities[i], stHeap_remove(heap, handles[i]));
+            handles[i] = NULL;
+            size--;
+        } else if (r < 0.7) {
+            int64_t *element = stHeap_pop(heap);
+            CuAssertIntEquals(testCase, priorities[getLeast(priorities, handles, elementNumber)], *element);
+            handles[element - priorities] = NULL;
+            size--;
+        }
+        CuAssertIntEquals(testCase, size, stHeap_size(heap));
+        int64_t least = getLeast(priorities, handles, elementNumber);
+        if (least == -1) {
+            CuAssertPtrEquals(testCase, NULL, stHeap_peek(heap));
+        } else {
+            CuAssertIntEquals(testCase, priorities[least], *(int64_t *) stHeap_peek(heap));
+        }
+    }
+    int64_t previous = INT64_MIN, *element;
+    while ((element = stHeap_pop(heap)) != NULL) {
+        CuAssertTrue(testCase, previous <= *element);
+        previous = *element;
+        size--;
+    }
+    CuAssertIntEquals(testCase, 0, size);
+    stHeap_destruct(heap);
+    free(handles);
+    free(priorities);
+}
+
+static void test_stHeap_decreaseKeyAndDestruct(CuTest *testCase) {
+    /*
+     * Checks that raising a priority through decreaseKey is rejected and that the destructor frees the elements
+     * left in the heap.
+     */
+    stHeap *heap = stHeap_construct((int (*)(const void *, const void *)) comparePriorities, free);
+    int64_t *priority = st_malloc(sizeof(int64_t));
+    *priority = 10;
+    stHeapHandle *handle = stHeap_insert(heap, priority);
+    for (int64_t i = 0; i < 100; i++) {
+        int64_t *other = st_malloc(sizeof(int64_t));
+        *other = st_randomInt(5, 100);
+        stHeap_insert(heap, other);
+    }
+    int64_t *greater = st_malloc(sizeof(int64_t));
+    *greater = 11;
+    stTry {
+        stHeap_decreaseKey(heap, handle, greater);
+        CuAssertTrue(testCase, 0);
+    } stCatch(except) {
+        CuAssertTrue(testCase, stExcept_getId(except) == ST_HEAP_EXCEPTION_ID);
+        stExcept_free(except);
+    } stTryEnd;
+    *greater = 0;
+    stHeap_decreaseKey(heap, handle, greater);
+    free(priority);
+    CuAssertPtrEquals(testCase, greater, stHeap_peek(heap));
+    CuAssertIntEquals(testCase, 101, stHeap_size(heap));
+    stHeap_destruct(heap);
+}
+
+CuSuite* sonLib_stHeapTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, test_stHeap_randomOperations);
+    SUITE_ADD_TEST(suite, test_stHeap_decreaseKeyAndDestruct);
+    return suite;
+}
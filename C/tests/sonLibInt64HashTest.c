@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2006-2012 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "sonLibGlobalsTest.h"
+
+static int64_t getKey(int32_t i) {
+    return i % 2 == 0 ? (int64_t) i << 32 : -i; //Spread over the high bits, and include negative keys
+}
+
+static void test_stInt64Hash_basics(CuTest *testCase) {
+    stInt64Hash *hash = stInt64Hash_construct();
+    int64_t value;
+    CuAssertTrue(testCase, stInt64Hash_search(hash, 1) == NULL);
+    CuAssertTrue(testCase, !stInt64Hash_searchInt64(hash, 1, &value));
+    CuAssertTrue(testCase, stInt64Hash_remove(hash, 1) == NULL);
+
+    stInt64Hash_insert(hash, 1, hash);
+    stInt64Hash_insertInt64(hash, INT64_MIN, -5);
+    stInt64Hash_insertInt64(hash, 0, 7);
+    CuAssertIntEquals(testCase, 3, stInt64Hash_size(hash));
+    CuAssertTrue(testCase, stInt64Hash_search(hash, 1) == hash);
+    CuAssertTrue(testCase, stInt64Hash_searchInt64(hash, INT64_MIN, &value));
+    CuAssertTrue(testCase, value == -5);
+    CuAssertTrue(testCase, stInt64Hash_contains(hash, 0));
+    CuAssertTrue(testCase, !stInt64Hash_contains(hash, 2));
+
+    stInt64Hash_insertInt64(hash, 0, 8); //Overrides
+    CuAssertIntEquals(testCase, 3, stInt64Hash_size(hash));
+    CuAssertTrue(testCase, stInt64Hash_searchInt64(hash, 0, &value) && value == 8);
+
+    bool inserted;
+    int64_t *count = stInt64Hash_getOrInsert(hash, 2, &inserted);
+    CuAssertTrue(testCase, inserted && *count == 0);
+    (*count)++;
+    count = stInt64Hash_getOrInsert(hash, 2, &inserted);
+    CuAssertTrue(testCase, !inserted && *count == 1);
+    CuAssertIntEquals(testCase, 4, stInt64Hash_size(hash));
+
+    CuAssertTrue(testCase, stInt64Hash_remove(hash, 1) == hash);
+    CuAssertTrue(testCase, !stInt64Hash_contains(hash, 1));
+    CuAssertIntEquals(testCase, 3, stInt64Hash_size(hash));
+    stInt64Hash_destruct(hash);
+
+    hash = stInt64Hash_construct2(free);
+    stInt64Hash_insert(hash, 5, st_malloc(10));
+    stInt64Hash_destruct(hash);
+}
+
+static void test_stInt64Hash_randomInsertAndRemove(CuTest *testCase) {
+    /*
+     * Checks the hash against an array of the values present, over many random inserts and removes.
+     */
+    const int32_t keyNumber = 10000;
+    int64_t *values = st_malloc(keyNumber * sizeof(int64_t));
+    bool *present = st_calloc(keyNumber, sizeof(bool));
+    stInt64Hash *hash = stInt64Hash_construct();
+    int64_t size = 0;
+    for (int32_t test = 0; test < 100000; test++) {
+        int32_t i = st_randomInt(0, test < 50000 ? keyNumber : keyNumber / 10);
+        if (st_random() > 0.4) {
+            values[i] = st_randomInt(-1000, 1000);
+            stInt64Hash_insertInt64(hash, getKey(i), values[i]);
+            size += !present[i];
+            present[i] = 1;
+        } else {
+            CuAssertTrue(testCase, stInt64Hash_contains(hash, getKey(i)) == present[i]);
+            stInt64Hash_remove(hash, getKey(i));
+            size -= present[i];
+            present[i] = 0;
+        }
+        CuAssertTrue(testCase, size == stInt64Hash_size(hash));
+        int32_t j = st_randomInt(0, keyNumber);
+        int64_t value;
+        CuAssertTrue(testCase, stInt64Hash_searchInt64(hash, getKey(j), &value) == present[j]);
+        CuAssertTrue(testCase, !present[j] || value == values[j]);
+    }
+    stInt64Hash_destruct(hash);
+    free(values);
+    free(present);
+}
+
+static void test_stInt64Set_randomInsertAndRemove(CuTest *testCase) {
+    const int32_t keyNumber = 10000;
+    bool *present = st_calloc(keyNumber, sizeof(bool));
+    stInt64Set *set = stInt64Set_construct();
+    stInt64Set_reserve(set, keyNumber);
+    int64_t size = 0;
+    for (int32_t test = 0; test < 100000; test++) {
+        int32_t i = st_randomInt(0, keyNumber);
+        if (st_random() > 0.4) {
+            stInt64Set_insert(set, getKey(i));
+            size += !present[i];
+            present[i] = 1;
+        } else {
+            CuAssertTrue(testCase, stInt64Set_remove(set, getKey(i)) == present[i]);
+            size -= present[i];
+            present[i] = 0;
+        }
+        CuAssertTrue(testCase, size == stInt64Set_size(set));
+    }
+    for (int32_t i = 0; i < keyNumber; i++) {
+        CuAssertTrue(testCase, stInt64Set_contains(set, getKey(i)) == present[i]);
+    }
+    stInt64Set_destruct(set);
+    free(present);
+}
+
+static void test_stInt64Hash_reserve(CuTest *testCase) {
+    /*
+     * Fills tables to just under the load limit with random keys after reserving room for them, and checks that
+     * long probes do not make them grow early.
+     */
+    for (int32_t k = 10; k <= 20; k += 2) {
+        int64_t keyNumber = (int64_t) (0.85 * (1 << k));
+        stInt64Hash *hash = stInt64Hash_construct();
+        stInt64Set *set = stInt64Set_construct();
+        stInt64Hash_reserve(hash, keyNumber);
+        stInt64Set_reserve(set, keyNumber);
+        int64_t capacity = stInt64Hash_getCapacity(hash);
+        CuAssertTrue(testCase, capacity >= keyNumber);
+        CuAssertTrue(testCase, stInt64Set_getCapacity(set) == capacity);
+        for (int64_t i = 0; i < keyNumber; i++) {
+            int64_t key = ((int64_t) st_randomInt(0, INT32_MAX) << 32) ^ st_randomInt(0, INT32_MAX);
+            stInt64Hash_insertInt64(hash, key, i);
+            stInt64Set_insert(set, key);
+        }
+        CuAssertTrue(testCase, stInt64Hash_getCapacity(hash) == capacity);
+        CuAssertTrue(testCase, stInt64Set_getCapacity(set) == capacity);
+        stInt64Hash_destruct(hash);
+        stInt64Set_destruct(set);
+    }
+}
+
+static void test_stInt64Hash_removeDuringIteration(CuTest *testCase) {
+    /*
+     * Removing the key just returned by an iterator must not cause other keys to be skipped.
+     */
+    const int32_t keyNumber = 5000;
+    stInt64Set *set = stInt64Set_construct();
+    for (int32_t i = 0; i < keyNumber; i++) {
+        stInt64Set_insert(set, i);
+    }
+    bool *seen = st_calloc(keyNumber, sizeof(bool));
+    stInt64HashIterator *iterator = stInt64Set_getIterator(set);
+    int64_t key;
+    int32_t seenNumber = 0;
+    while (stInt64Hash_getNext(iterator, &key)) {
+        CuAssertTrue(testCase, key >= 0 && key < keyNumber && !seen[key]);
+        seen[key] = 1;
+        seenNumber++;
+        if (key % 2 == 0) {
+            CuAssertTrue(testCase, stInt64Set_remove(set, key));
+        }
+    }
+    CuAssertTrue(testCase, !stInt64Hash_getNext(iterator, &key));
+    stInt64Hash_destructIterator(iterator);
+    CuAssertIntEquals(testCase, keyNumber, seenNumber);
+    CuAssertIntEquals(testCase, keyNumber / 2, stInt64Set_size(set));
+    free(seen);
+    stInt64Set_destruct(set);
+}
+
+CuSuite* sonLib_stInt64HashTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, test_stInt64Hash_basics);
+    SUITE_ADD_TEST(suite, test_stInt64Hash_randomInsertAndRemove);
+    SUITE_ADD_TEST(suite, test_stInt64Set_randomInsertAndRemove);
+    SUITE_ADD_TEST(suite, test_stInt64Hash_removeDuringIteration);
+    SUITE_ADD_TEST(suite, test_stInt64Hash_reserve);
+    return suite;
+}
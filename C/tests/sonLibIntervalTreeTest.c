@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2006-2012 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "sonLibGlobalsTest.h"
+
+typedef struct _testInterval {
+    int64_t key, start, end;
+    bool present;
+} TestInterval;
+
+static int64_t getGap(TestInterval *interval, int64_t position) {
+    return position < interval->start ? interval->start - position :
+            position >= interval->end ? position - interval->end + 1 : 0;
+}
+
+/*
+ * Checks that the list holds, in order of start, exactly the present intervals on the key that pass the test.
+ */
+static void checkValues(CuTest *testCase, stList *values, TestInterval *intervals, int64_t intervalNumber,
+        int64_t key, int64_t start, int64_t end, bool (*passes)(TestInterval *, int64_t, int64_t)) {
+    int64_t expected = 0;
+    for (int64_t i = 0; i < intervalNumber; i++) {
+        expected += intervals[i].present && intervals[i].key == key && passes(&intervals[i], start, end) ? 1 : 0;
+    }
+    CuAssertIntEquals(testCase, expected, stList_length(values));
+    for (int64_t i = 0; i < stList_length(values); i++) {
+        TestInterval *interval = stList_get(values, i);
+        CuAssertTrue(testCase, interval->present && interval->key == key && passes(interval, start, end));
+        if (i > 0) {
+            CuAssertTrue(testCase, ((TestInterval *) stList_get(values, i - 1))->start <= interval->start);
+        }
+    }
+    stList_destruct(values);
+}
+
+static bool overlaps(TestInterval *interval, int64_t start, int64_t end) {
+    return interval->start < end && start < interval->end && interval->start < interval->end && start < end;
+}
+
+static bool contains(TestInterval *interval, int64_t start, int64_t end) {
+    return interval->start <= start && end <= interval->end;
+}
+
+static void test_stIntervalTree_randomQueries(CuTest *testCase) {
+    /*
+     * Inserts and removes random intervals, many of them long enough to overlap densely, on a few keys, checking
+     * the queries against every interval.
+     */
+    const int64_t intervalNumber = 2000, keyNumber = 3, length = 10000;
+    TestInterval *intervals = st_calloc(intervalNumber, sizeof(TestInterval));
+    stIntervalTree *intervalTree = stIntervalTree_construct(NULL);
+    int64_t size = 0;
+    for (int64_t round = 0; round < 10; round++) {
+        for (int64_t j = 0; j < intervalNumber; j++) {
+            TestInterval *interval = &intervals[st_randomInt(0, intervalNumber)];
+            if (interval->present) {
+                CuAssertTrue(testCase, stIntervalTree_remove(intervalTree, interval->key, interval->start, interval->end, interval));
+                CuAssertTrue(testCase, !stIntervalTree_remove(intervalTree, interval->key, interval->start, interval->end, interval));
+                interval->present = 0;
+                size--;
+            } else if (st_random() < 0.7) {
+                interval->key = st_randomInt(0, keyNumber);
+                interval->start = st_randomInt(0, length);
+                interval->end = interval->start + (st_random() < 0.1 ? 0 : st_randomInt(0, st_random() < 0.5 ? 100 : length));
+                stIntervalTree_insert(intervalTree, interval->key, interval->start, interval->end, interval);
+                interval->present = 1;
+                size++;
+            }
+        }
+        CuAssertIntEquals(testCase, size, stIntervalTree_size(intervalTree));
+        for (int64_t j = 0; j < 100; j++) {
+            int64_t key = st_randomInt(0, keyNumber), start = st_randomInt(-10, length + 10);
+            int64_t end = start + st_randomInt(0, st_random() < 0.5 ? 10 : length);
+            checkValues(testCase, stIntervalTree_getOverlapping(intervalTree, key, start, end), intervals,
+                    intervalNumber, key, start, end, overlaps);
+            checkValues(testCase, stIntervalTree_getContaining(intervalTree, key, start, end), intervals,
+                    intervalNumber, key, start, end, contains);
+            int64_t bestGap = INT64_MAX;
+            for (int64_t i = 0; i < intervalNumber; i++) {
+                if (intervals[i].present && intervals[i].key == key && getGap(&intervals[i], start) < bestGap) {
+                    bestGap = getGap(&intervals[i], start);
+                }
+            }
+            TestInterval *nearest = stIntervalTree_getNearest(intervalTree, key, start);
+            if (bestGap == INT64_MAX) {
+                CuAssertPtrEquals(testCase, NULL, nearest);
+            } else {
+                CuAssertTrue(testCase, nearest != NULL && nearest->present && nearest->key == key);
+                CuAssertIntEquals(testCase, bestGap, getGap(nearest, start));
+            }
+        }
+    }
+    CuAssertPtrEquals(testCase, NULL, stIntervalTree_getNearest(intervalTree, keyNumber, 0));
+    stIntervalTree_destruct(intervalTree);
+    free(intervals);
+}
+
+static void test_stIntervalTree_insertAndDestruct(CuTest *testCase) {
+    /*
+     * Checks that identical intervals are kept separately, that backwards intervals are rejected and that the
+     * destructor frees the values left in the tree.
+     */
+    stIntervalTree *intervalTree = stIntervalTree_construct(free);
+    for (int64_t i = 0; i < 3; i++) {
+        stIntervalTree_insert(intervalTree, 1, 10, 20, st_malloc(1));
+    }
+    stList *values = stIntervalTree_getOverlapping(intervalTree, 1, 19, 30);
+    CuAssertIntEquals(testCase, 3, stList_length(values));
+    CuAssertTrue(testCase, stIntervalTree_remove(intervalTree, 1, 10, 20, stList_get(values, 1)));
+    free(stList_get(values, 1));
+    stList_destruct(values);
+    CuAssertIntEquals(testCase, 2, stIntervalTree_size(intervalTree));
+    values = stIntervalTree_getOverlapping(intervalTree, 1, 20, 30);
+    CuAssertIntEquals(testCase, 0, stList_length(values));
+    stList_destruct(values);
+    stTry {
+        stIntervalTree_insert(intervalTree, 1, 10, 9, NULL);
+        CuAssertTrue(testCase, 0);
+    } stCatch(except) {
+        CuAssertTrue(testCase, stExcept_getId(except) == ST_INTERVAL_TREE_EXCEPTION_ID);
+        stExcept_free(except);
+    } stTryEnd;
+    CuAssertIntEquals(testCase, 2, stIntervalTree_size(intervalTree));
+    stIntervalTree_destruct(intervalTree);
+}
+
+CuSuite* sonLib_stIntervalTreeTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, test_stIntervalTree_randomQueries);
+    SUITE_ADD_TEST(suite, test_stIntervalTree_insertAndDestruct);
+    return suite;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2006-2012 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "sonLibGlobalsTest.h"
+
+/*
+ * Fills objects with a pattern unique to each, frees and reallocates some at random, and checks no object is
+ * handed out twice or overwritten.
+ */
+static void mallocAndFree(CuTest *testCase, stPool *pool, int64_t objectSize) {
+    const int64_t objectNumber = 10000;
+    char **objects = st_calloc(objectNumber, sizeof(char *));
+    for (int64_t test = 0; test < 100000; test++) {
+        int64_t i = st_randomInt(0, objectNumber);
+        if (objects[i] == NULL) {
+            objects[i] = stPool_malloc(pool);
+            CuAssertTrue(testCase, ((size_t) objects[i]) % sizeof(void *) == 0);
+            memset(objects[i], (char) i, objectSize);
+        } else {
+            for (int64_t j = 0; j < objectSize; j++) {
+                CuAssertTrue(testCase, objects[i][j] == (char) i);
+            }
+            stPool_free(pool, objects[i]);
+            objects[i] = NULL;
+        }
+    }
+    for (int64_t i = 0; i < objectNumber; i++) {
+        for (int64_t j = 0; objects[i] != NULL && j < objectSize; j++) {
+            CuAssertTrue(testCase, objects[i][j] == (char) i);
+        }
+    }
+    free(objects);
+    stPool_destruct(pool);
+}
+
+static void test_stPool_mallocAndFree(CuTest *testCase) {
+    mallocAndFree(testCase, stPool_construct(13), 13);
+    mallocAndFree(testCase, stPool_construct2(13, 1), 13); //slabs of 1, 2, 4, ... objects
+    mallocAndFree(testCase, stPool_construct2(288, 1), 288);
+}
+
+CuSuite* sonLib_stPoolTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, test_stPool_mallocAndFree);
+    return suite;
+}
@@ -32,6 +32,26 @@ static void sonLibSortedSetTestSetup() {
 static void test_stSortedSet_construct(CuTest* testCase) {
     sonLibSortedSetTestSetup();
     CuAssertTrue(testCase, sortedSet != NULL);
+    //An empty set shares a root with other empty sets until the first insert, so query it, then insert into both
+    stIntTuple *key = stIntTuple_construct(1, 1);
+    CuAssertPtrEquals(testCase, NULL, stSortedSet_search(sortedSet, key));
+    CuAssertPtrEquals(testCase, NULL, stSortedSet_searchLessThanOrEqual(sortedSet, key));
+    CuAssertPtrEquals(testCase, NULL, stSortedSet_searchGreaterThan(sortedSet, key));
+    CuAssertPtrEquals(testCase, NULL, stSortedSet_getFirst(sortedSet));
+    CuAssertPtrEquals(testCase, NULL, stSortedSet_getLast(sortedSet));
+    CuAssertPtrEquals(testCase, NULL, stSortedSet_getKth(sortedSet, 0));
+    CuAssertIntEquals(testCase, 0, (int32_t) stSortedSet_getRank(sortedSet, key));
+    stSortedSet_remove(sortedSet, key);
+    stSortedSetIterator *iterator = stSortedSet_getIterator(sortedSet);
+    CuAssertPtrEquals(testCase, NULL, stSortedSet_getNext(iterator));
+    CuAssertPtrEquals(testCase, NULL, stSortedSet_getPrevious(iterator));
+    stSortedSet_destructIterator(iterator);
+    stSortedSet_insert(sortedSet, key);
+    stSortedSet_insert(sortedSet2, stIntTuple_construct(1, 2));
+    CuAssertPtrEquals(testCase, key, stSortedSet_getFirst(sortedSet));
+    CuAssertIntEquals(testCase, 1, stSortedSet_size(sortedSet));
+    CuAssertIntEquals(testCase, 1, stSortedSet_size(sortedSet2));
+    CuAssertPtrEquals(testCase, NULL, stSortedSet_search(sortedSet2, key));
     sonLibSortedSetTestTeardown();
 }
 
@@ -427,6 +447,324 @@ static void test_stSortedSet_searchGreaterThan(CuTest* testCase) {
     sonLibSortedSetTestTeardown();
 }
 
+static stIntTuple *getPresent(stIntTuple **elements, int32_t elementNumber, int32_t i, int32_t step) {
+    /*
+     * Returns the first element present at or after (step 1) or before (step -1) index i of the array, or NULL.
+     */
+    for (; i >= 0 && i < elementNumber; i += step) {
+        if (elements[i] != NULL) {
+            return elements[i];
+        }
+    }
+    return NULL;
+}
+
+static void test_stSortedSet_randomInsertAndRemove(CuTest* testCase) {
+    /*
+     * Checks the set against an array of the elements present, over enough random inserts and removes
+     * to split and merge nodes at several levels. Removed and replaced elements are freed, so any use
+     * of them by the set is caught by memory checkers.
+     */
+    const int32_t elementNumber = 20000;
+    stIntTuple **elements = st_calloc(elementNumber, sizeof(stIntTuple *));
+    stSortedSet *sortedSet3 = stSortedSet_construct3((int (*)(const void *, const void *))stIntTuple_cmpFn,
+            (void (*)(void *))stIntTuple_destruct);
+    int32_t size3 = 0;
+    for (int32_t test = 0; test < 200000; test++) {
+        int32_t i = st_randomInt(0, test < 100000 ? elementNumber : elementNumber / 4);
+        if (st_random() > (test < 150000 ? 0.4 : 0.7)) {
+            stIntTuple *element = stIntTuple_construct(1, i);
+            stSortedSet_insert(sortedSet3, element); //Replaces any equal element
+            if (elements[i] != NULL) {
+                stIntTuple_destruct(elements[i]);
+            } else {
+                size3++;
+            }
+            elements[i] = element;
+        } else if (elements[i] != NULL) {
+            stSortedSet_remove(sortedSet3, elements[i]);
+            stIntTuple_destruct(elements[i]);
+            elements[i] = NULL;
+            size3--;
+        }
+        CuAssertIntEquals(testCase, size3, stSortedSet_size(sortedSet3));
+        int32_t j = st_randomInt(0, elementNumber);
+        stIntTuple *key = stIntTuple_construct(1, j);
+        CuAssertTrue(testCase, stSortedSet_search(sortedSet3, key) == elements[j]);
+        CuAssertTrue(testCase, stSortedSet_searchLessThanOrEqual(sortedSet3, key) == getPresent(elements, elementNumber, j, -1));
+        CuAssertTrue(testCase, stSortedSet_searchLessThan(sortedSet3, key) == getPresent(elements, elementNumber, j - 1, -1));
+        CuAssertTrue(testCase, stSortedSet_searchGreaterThanOrEqual(sortedSet3, key) == getPresent(elements, elementNumber, j, 1));
+        CuAssertTrue(testCase, stSortedSet_searchGreaterThan(sortedSet3, key) == getPresent(elements, elementNumber, j + 1, 1));
+        stIntTuple_destruct(key);
+    }
+    CuAssertTrue(testCase, stSortedSet_getFirst(sortedSet3) == getPresent(elements, elementNumber, 0, 1));
+    CuAssertTrue(testCase, stSortedSet_getLast(sortedSet3) == getPresent(elements, elementNumber, elementNumber - 1, -1));
+
+    //Iterate forwards then backwards over the whole set
+    stSortedSetIterator *iterator = stSortedSet_getIterator(sortedSet3);
+    stIntTuple *element;
+    int32_t j = 0;
+    while ((element = stSortedSet_getNext(iterator)) != NULL) {
+        CuAssertTrue(testCase, element == getPresent(elements, elementNumber, j, 1));
+        j = stIntTuple_getPosition(element, 0) + 1;
+    }
+    j = elementNumber - 1;
+    while ((element = stSortedSet_getPrevious(iterator)) != NULL) {
+        CuAssertTrue(testCase, element == getPresent(elements, elementNumber, j, -1));
+        j = stIntTuple_getPosition(element, 0) - 1;
+    }
+    stSortedSet_destructIterator(iterator);
+
+    //Iterate from an element in the middle
+    element = getPresent(elements, elementNumber, elementNumber / 2, 1);
+    iterator = stSortedSet_getIteratorFrom(sortedSet3, element);
+    CuAssertTrue(testCase, stSortedSet_getNext(iterator) == element);
+    CuAssertTrue(testCase, stSortedSet_getNext(iterator) == getPresent(elements, elementNumber, stIntTuple_getPosition(element, 0) + 1, 1));
+    stSortedSet_destructIterator(iterator);
+
+    stSortedSet_destruct(sortedSet3);
+    free(elements);
+}
+
+static void test_stSortedSet_constructFromList(CuTest* testCase) {
+    /*
+     * Builds sets of many sizes from lists, and checks they equal the sets built by inserting the same elements,
+     * and can then be changed like any other set.
+     */
+    for (int32_t length = 0; length < 3000; length += 1 + length / 3) {
+        stList *list = stList_construct3(0, (void (*)(void *))stIntTuple_destruct);
+        for (int32_t i = 0; i < length; i++) {
+            stList_append(list, stIntTuple_construct(1, st_randomInt(0, length + 1)));
+        }
+        stSortedSet *inserted = stSortedSet_construct3((int (*)(const void *, const void *))stIntTuple_cmpFn, NULL);
+        for (int32_t i = 0; i < length; i++) {
+            stSortedSet_insert(inserted, stList_get(list, i));
+        }
+        stSortedSet *built = stSortedSet_constructFromList(list, (int (*)(const void *, const void *))stIntTuple_cmpFn, NULL);
+        CuAssertIntEquals(testCase, stSortedSet_size(inserted), stSortedSet_size(built));
+        stList *insertedList = stSortedSet_getList(inserted), *builtList = stSortedSet_getList(built);
+        for (int32_t i = 0; i < stList_length(insertedList); i++) {
+            CuAssertTrue(testCase, stList_get(insertedList, i) == stList_get(builtList, i)); //The same of equal elements is kept
+        }
+
+        stSortedSet *builtFromSorted = stSortedSet_constructFromSortedList(builtList,
+                (int (*)(const void *, const void *))stIntTuple_cmpFn, NULL);
+        CuAssertTrue(testCase, stSortedSet_equals(builtFromSorted, inserted));
+        for (int32_t i = 0; i < length; i++) {
+            stIntTuple *element = stList_get(list, st_randomInt(0, length));
+            if (st_random() > 0.5) {
+                stSortedSet_insert(inserted, element);
+                stSortedSet_insert(builtFromSorted, element);
+            } else {
+                stSortedSet_remove(inserted, element);
+                stSortedSet_remove(builtFromSorted, element);
+            }
+        }
+        CuAssertTrue(testCase, stSortedSet_equals(builtFromSorted, inserted));
+
+        stSortedSet_destruct(builtFromSorted);
+        stList_destruct(insertedList);
+        stList_destruct(builtList);
+        stSortedSet_destruct(built);
+        stSortedSet_destruct(inserted);
+        stList_destruct(list);
+    }
+
+    stList *list = stList_construct3(0, (void (*)(void *))stIntTuple_destruct);
+    stList_append(list, stIntTuple_construct(1, 2));
+    stList_append(list, stIntTuple_construct(1, 1));
+    stTry {
+        stSortedSet_constructFromSortedList(list, (int (*)(const void *, const void *))stIntTuple_cmpFn, NULL);
+        CuAssertTrue(testCase, 0);
+    } stCatch(except) {
+        CuAssertTrue(testCase, stExcept_getId(except) == SORTED_SET_EXCEPTION_ID);
+        stExcept_free(except);
+    } stTryEnd
+    stList_destruct(list);
+}
+
+static void test_stSortedSet_mergesAndInPlaceMerges(CuTest* testCase) {
+    /*
+     * Checks the merges of random sets of pointers to the elements of an array against the membership of each
+     * element, with the in place merges agreeing with the others.
+     */
+    const int32_t elementNumber = 2000;
+    int32_t *elements = st_malloc(elementNumber * sizeof(int32_t));
+    for (int32_t test = 0; test < 20; test++) {
+        stSortedSet *sortedSet3 = stSortedSet_construct(), *sortedSet4 = stSortedSet_construct();
+        double p3 = st_random(), p4 = st_random();
+        for (int32_t i = 0; i < elementNumber; i++) {
+            if (st_random() < p3) {
+                stSortedSet_insert(sortedSet3, &elements[i]);
+            }
+            if (st_random() < p4) {
+                stSortedSet_insert(sortedSet4, &elements[i]);
+            }
+        }
+        stSortedSet *merges[3] = { stSortedSet_getUnion(sortedSet3, sortedSet4),
+                stSortedSet_getIntersection(sortedSet3, sortedSet4), stSortedSet_getDifference(sortedSet3, sortedSet4) };
+        for (int32_t i = 0; i < elementNumber; i++) {
+            bool in3 = stSortedSet_search(sortedSet3, &elements[i]) != NULL;
+            bool in4 = stSortedSet_search(sortedSet4, &elements[i]) != NULL;
+            CuAssertTrue(testCase, (stSortedSet_search(merges[0], &elements[i]) != NULL) == (in3 || in4));
+            CuAssertTrue(testCase, (stSortedSet_search(merges[1], &elements[i]) != NULL) == (in3 && in4));
+            CuAssertTrue(testCase, (stSortedSet_search(merges[2], &elements[i]) != NULL) == (in3 && !in4));
+        }
+        for (int32_t j = 0; j < 3; j++) {
+            stSortedSet *inPlace = stSortedSet_copyConstruct(sortedSet3, NULL);
+            if (j == 0) {
+                stSortedSet_unionInPlace(inPlace, sortedSet4);
+            } else if (j == 1) {
+                stSortedSet_intersectionInPlace(inPlace, sortedSet4);
+            } else {
+                stSortedSet_differenceInPlace(inPlace, sortedSet4);
+            }
+            CuAssertTrue(testCase, stSortedSet_equals(inPlace, merges[j]));
+            stSortedSet_insert(inPlace, &elements[0]); //The rebuilt set can still be changed
+            stSortedSet_remove(inPlace, &elements[elementNumber - 1]);
+            stSortedSet_destruct(inPlace);
+            stSortedSet_destruct(merges[j]);
+        }
+        stSortedSet_destruct(sortedSet3);
+        stSortedSet_destruct(sortedSet4);
+    }
+    free(elements);
+}
+
+static void checkRanks(CuTest *testCase, stSortedSet *sortedSet3, int32_t *elements, bool *present,
+        int32_t elementNumber) {
+    int64_t rank = 0;
+    for (int32_t i = 0; i < elementNumber; i++) {
+        CuAssertIntEquals(testCase, rank, stSortedSet_getRank(sortedSet3, &elements[i]));
+        if (present[i]) {
+            CuAssertPtrEquals(testCase, &elements[i], stSortedSet_getKth(sortedSet3, rank));
+            rank++;
+        }
+    }
+    CuAssertIntEquals(testCase, stSortedSet_size(sortedSet3), rank);
+    CuAssertPtrEquals(testCase, NULL, stSortedSet_getKth(sortedSet3, rank));
+    CuAssertPtrEquals(testCase, NULL, stSortedSet_getKth(sortedSet3, -1));
+    for (int32_t test = 0; test < 100; test++) {
+        int32_t i = st_randomInt(0, elementNumber), j = st_randomInt(0, elementNumber);
+        int64_t count = 0;
+        for (int32_t k = i; k < j; k++) {
+            count += present[k] ? 1 : 0;
+        }
+        CuAssertIntEquals(testCase, count, stSortedSet_getCountInRange(sortedSet3, &elements[i], &elements[j]));
+    }
+}
+
+static void test_stSortedSet_getRankAndGetKth(CuTest* testCase) {
+    /*
+     * Checks ranks, kth elements and range counts against the membership of each element of an array, as the
+     * set is changed by insertions, removals and in place merges and when it is built in bulk.
+     */
+    const int32_t elementNumber = 3000;
+    int32_t *elements = st_malloc(elementNumber * sizeof(int32_t));
+    bool *present = st_calloc(elementNumber, sizeof(bool));
+    stSortedSet *sortedSet3 = stSortedSet_construct();
+    checkRanks(testCase, sortedSet3, elements, present, elementNumber);
+    for (int32_t test = 0; test < 10; test++) {
+        double p = st_random();
+        for (int32_t i = 0; i < elementNumber; i++) {
+            int32_t j = st_randomInt(0, elementNumber);
+            if (st_random() < p) {
+                stSortedSet_insert(sortedSet3, &elements[j]);
+                present[j] = 1;
+            } else {
+                stSortedSet_remove(sortedSet3, &elements[j]);
+                present[j] = 0;
+            }
+        }
+        checkRanks(testCase, sortedSet3, elements, present, elementNumber);
+    }
+    stList *list = stSortedSet_getList(sortedSet3);
+    stSortedSet *sortedSet4 = stSortedSet_constructFromSortedList(list, NULL, NULL);
+    checkRanks(testCase, sortedSet4, elements, present, elementNumber);
+    stSortedSet_destruct(sortedSet4);
+    stList_destruct(list);
+    sortedSet4 = stSortedSet_construct();
+    for (int32_t i = 0; i < elementNumber; i += 3) {
+        stSortedSet_insert(sortedSet4, &elements[i]);
+    }
+    stSortedSet_unionInPlace(sortedSet3, sortedSet4);
+    for (int32_t i = 0; i < elementNumber; i += 3) {
+        present[i] = 1;
+    }
+    checkRanks(testCase, sortedSet3, elements, present, elementNumber);
+    stSortedSet_destruct(sortedSet3);
+    stSortedSet_destruct(sortedSet4);
+    free(present);
+    free(elements);
+}
+
+static void test_stSortedSet_iteratorRemoveAndInsert(CuTest* testCase) {
+    /*
+     * Filters sets of pointers to the elements of an array in place, walking forwards and backwards, and checks
+     * that insertions through an iterator leave it at the inserted element.
+     */
+    const int32_t elementNumber = 2000;
+    int32_t *elements = st_malloc(elementNumber * sizeof(int32_t));
+    for (int32_t backwards = 0; backwards < 2; backwards++) {
+        stSortedSet *sortedSet3 = stSortedSet_construct();
+        for (int32_t i = 0; i < elementNumber; i++) {
+            stSortedSet_insert(sortedSet3, &elements[i]);
+        }
+        bool *removed = st_calloc(elementNumber, sizeof(bool));
+        stSortedSetIterator *it = stSortedSet_getIterator(sortedSet3);
+        int32_t *element, visited = 0, expected = backwards ? elementNumber - 1 : 0;
+        while ((element = backwards ? stSortedSet_getPrevious(it) : stSortedSet_getNext(it)) != NULL) {
+            CuAssertPtrEquals(testCase, &elements[expected], element);
+            expected += backwards ? -1 : 1;
+            visited++;
+            if (st_random() > 0.3) {
+                CuAssertPtrEquals(testCase, element, stSortedSet_iteratorRemove(it));
+                removed[element - elements] = 1;
+                stTry {
+                    stSortedSet_iteratorRemove(it); //Nothing left to remove at this position
+                    CuAssertTrue(testCase, 0);
+                } stCatch(except) {
+                    CuAssertTrue(testCase, stExcept_getId(except) == SORTED_SET_EXCEPTION_ID);
+                    stExcept_free(except);
+                } stTryEnd;
+            }
+        }
+        CuAssertIntEquals(testCase, elementNumber, visited);
+        stSortedSet_destructIterator(it);
+        int32_t remaining = 0;
+        for (int32_t i = 0; i < elementNumber; i++) {
+            CuAssertTrue(testCase, (stSortedSet_search(sortedSet3, &elements[i]) == NULL) == removed[i]);
+            remaining += removed[i] ? 0 : 1;
+        }
+        CuAssertIntEquals(testCase, remaining, stSortedSet_size(sortedSet3));
+
+        //Put the removed elements back through an iterator, checking its neighbours each time
+        it = stSortedSet_getIterator(sortedSet3);
+        for (int32_t i = 0; i < elementNumber; i++) {
+            if (removed[i]) {
+                stSortedSet_iteratorInsertAndReposition(it, &elements[i]);
+                CuAssertPtrEquals(testCase, stSortedSet_searchGreaterThan(sortedSet3, &elements[i]), stSortedSet_getNext(it));
+                stSortedSet_getPrevious(it);
+                CuAssertPtrEquals(testCase, stSortedSet_searchLessThan(sortedSet3, &elements[i]), stSortedSet_getPrevious(it));
+            }
+        }
+        CuAssertIntEquals(testCase, elementNumber, stSortedSet_size(sortedSet3));
+        stSortedSetIterator *it2 = stSortedSet_copyIterator(it);
+        stTry {
+            stSortedSet_iteratorInsertAndReposition(it, &elements[0]); //Another iterator is live
+            CuAssertTrue(testCase, 0);
+        } stCatch(except) {
+            CuAssertTrue(testCase, stExcept_getId(except) == SORTED_SET_EXCEPTION_ID);
+            stExcept_free(except);
+        } stTryEnd;
+        stSortedSet_destructIterator(it2);
+        stSortedSet_destructIterator(it);
+        free(removed);
+        stSortedSet_destruct(sortedSet3);
+    }
+    free(elements);
+}
+
 CuSuite* sonLib_stSortedSetTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, test_stSortedSet_construct);
@@ -442,5 +780,10 @@ CuSuite* sonLib_stSortedSetTestSuite(void) {
     SUITE_ADD_TEST(suite, test_stSortedSet_searchLessThan);
     SUITE_ADD_TEST(suite, test_stSortedSet_searchGreaterThanOrEqual);
     SUITE_ADD_TEST(suite, test_stSortedSet_searchGreaterThan);
+    SUITE_ADD_TEST(suite, test_stSortedSet_randomInsertAndRemove);
+    SUITE_ADD_TEST(suite, test_stSortedSet_constructFromList);
+    SUITE_ADD_TEST(suite, test_stSortedSet_mergesAndInPlaceMerges);
+    SUITE_ADD_TEST(suite, test_stSortedSet_getRankAndGetKth);
+    SUITE_ADD_TEST(suite, test_stSortedSet_iteratorRemoveAndInsert);
     return suite;
 }